@@ -1,5 +1,6 @@
 #include "ClassControllCamera.h"
 #include "last_jpeg_cache.h"
+#include "camera_frames.h"
 #include "ClassLogFile.h"
 
 #include <stdio.h>
@@ -28,6 +29,7 @@
 #include "freertos/task.h"
 
 #include "esp_camera.h"
+#include "esp_jpg_decode.h"
 
 #include "driver/ledc.h"
 #include "MainFlowControl.h"
@@ -130,6 +132,12 @@ esp_err_t CCamera::InitCam(void)
     CCstatus.ImageQuality = camera_config.jpeg_quality;
     CCstatus.ImageFrameSize = camera_config.frame_size;
 
+    if (!camera_frames::init())
+    {
+        ESP_LOGE(TAG, "Camera Init Failed");
+        return ESP_ERR_NO_MEM;
+    }
+
     // De-init in case it was already initialized
     esp_camera_deinit();
     vTaskDelay(cam_xDelay);
@@ -184,7 +192,7 @@ esp_err_t CCamera::InitCam(void)
 bool CCamera::testCamera(void)
 {
     bool success;
-    camera_fb_t *fb = esp_camera_fb_get();
+    camera_fb_t *fb = camera_frames::get(0);
 
     if (fb)
     {
@@ -195,7 +203,7 @@ bool CCamera::testCamera(void)
         success = false;
     }
 
-    esp_camera_fb_return(fb);
+    camera_frames::release(fb);
 
     return success;
 }
@@ -290,6 +298,7 @@ esp_err_t CCamera::setSensorDatenFromCCstatus(void)
 
         TickType_t cam_xDelay = 100 / portTICK_PERIOD_MS;
         vTaskDelay(cam_xDelay);
+        camera_frames::invalidate(); // Buffered frame still has the old settings
 
         return ESP_OK;
     }
@@ -585,6 +594,7 @@ void CCamera::SetQualityZoomSize(int qual, framesize_t resol, bool zoomEnabled,
     {
         s->set_quality(s, qual);
         SetZoomSize(zoomEnabled, zoomOffsetX, zoomOffsetY, imageSize, imageVflip);
+        camera_frames::invalidate();
     }
     else
     {
@@ -634,14 +644,71 @@ static size_t jpg_encode_stream(void *arg, size_t index, const void *data, size_
     return len;
 }
 
+#if JOMJOL_CAMERA_DIRECT_DECODE
+typedef struct
+{
+    const uint8_t *input;
+    uint8_t *output;
+    int width;
+    int height;
+    bool started;
+} direct_decode_t;
+
+static size_t direct_decode_read(void *arg, size_t index, uint8_t *buf, size_t len)
+{
+    direct_decode_t *d = (direct_decode_t *)arg;
+
+    if (buf)
+    {
+        memcpy(buf, d->input + index, len);
+    }
+
+    return len;
+}
+
+// Gets the decoded MCU blocks (RGB888, row by row) and copies them straight into the target image
+static bool direct_decode_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    direct_decode_t *d = (direct_decode_t *)arg;
+
+    if (!data)
+    {
+        if (!d->started)
+        {
+            // Start of decoding: w/h is the size of the JPEG, abort if it does not fit into the target image
+            d->started = true;
+            return ((w == d->width) && (h == d->height));
+        }
+
+        return true; // End of decoding
+    }
+
+    if ((x + w > d->width) || (y + h > d->height))
+    {
+        return false;
+    }
+
+    for (int row = 0; row < h; ++row)
+    {
+        memcpy(d->output + 3 * ((y + row) * d->width + x), data + 3 * row * w, 3 * w);
+    }
+
+    return true;
+}
+#endif
+
+/* With flash the frame has to start after the flash delay, otherwise a frame buffered shortly before is good enough */
+static int64_t FrameNotBefore(int delay)
+{
+    return esp_timer_get_time() - ((delay > 0) ? 0 : CAMERA_FRAME_MAX_AGE_MS * 1000LL);
+}
+
 esp_err_t CCamera::CaptureToBasisImage(CImageBasis *_Image, int delay)
 {
 #ifdef DEBUG_DETAIL_ON
     LogFile.WriteHeapInfo("CaptureToBasisImage - Start");
 #endif
 
-    _Image->EmptyImage(); // Delete previous stored raw image -> black image
-
     LEDOnOff(true); // Status-LED on
 
     if (delay > 0)
@@ -655,12 +722,12 @@ esp_err_t CCamera::CaptureToBasisImage(CImageBasis *_Image, int delay)
     LogFile.WriteHeapInfo("CaptureToBasisImage - After LightOn");
 #endif
 
-    camera_fb_t *fb = esp_camera_fb_get();
-    esp_camera_fb_return(fb);
-    fb = esp_camera_fb_get();
+    camera_fb_t *fb = camera_frames::get(FrameNotBefore(delay));
 
     if (!fb)
     {
+        _Image->EmptyImage(); // Delete previous stored raw image -> black image
+
         LEDOnOff(false);   // Status-LED off
         LightOnOff(false); // Flash-LED off
 
@@ -692,18 +759,47 @@ esp_err_t CCamera::CaptureToBasisImage(CImageBasis *_Image, int delay)
         }
     }
 
-    CImageBasis *_zwImage = new CImageBasis("zwImage");
+    bool decoded = false;
 
-    if (_zwImage)
+#if JOMJOL_CAMERA_DIRECT_DECODE
+    // Decode the JPEG directly into the target image, no temporary full frame buffer and no extra copy needed
+    if ((fb->format == PIXFORMAT_JPEG) && (_Image->channels == 3) && (_Image->width == CCstatus.ImageWidth) && (_Image->height == CCstatus.ImageHeight))
     {
-        _zwImage->LoadFromMemory(fb->buf, fb->len);
+        direct_decode_t d = {fb->buf, _Image->RGBImageLock(), _Image->width, _Image->height, false};
+
+        if (d.output != NULL)
+        {
+            decoded = (esp_jpg_decode(fb->len, JPG_SCALE_NONE, direct_decode_read, direct_decode_write, &d) == ESP_OK);
+        }
+
+        _Image->RGBImageRelease();
+
+        if (!decoded)
+        {
+            LogFile.WriteToFile(ESP_LOG_WARN, TAG, "CaptureToBasisImage: Direct JPEG decoding failed, using stb_image instead");
+        }
     }
-    else
+#endif
+
+    CImageBasis *_zwImage = NULL;
+
+    if (!decoded)
     {
-        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "CaptureToBasisImage: Can't allocate _zwImage");
+        _Image->EmptyImage(); // Delete previous stored raw image -> black image
+
+        _zwImage = new CImageBasis("zwImage");
+
+        if (_zwImage)
+        {
+            _zwImage->LoadFromMemory(fb->buf, fb->len);
+        }
+        else
+        {
+            LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "CaptureToBasisImage: Can't allocate _zwImage");
+        }
     }
 
-    esp_camera_fb_return(fb);
+    camera_frames::release(fb);
 
 #ifdef DEBUG_DETAIL_ON
     LogFile.WriteHeapInfo("CaptureToBasisImage - After fb_get");
@@ -728,31 +824,30 @@ esp_err_t CCamera::CaptureToBasisImage(CImageBasis *_Image, int delay)
         return ESP_OK;
     }
 
-    stbi_uc *p_target;
-    stbi_uc *p_source;
-    int channels = 3;
-    int width = CCstatus.ImageWidth;
-    int height = CCstatus.ImageHeight;
-
 #ifdef DEBUG_DETAIL_ON
     std::string _zw = "Targetimage: " + std::to_string((int)_Image->rgb_image) + " Size: " + std::to_string(_Image->width) + ", " + std::to_string(_Image->height);
     _zw = _zw + " _zwImage: " + std::to_string((int)_zwImage->rgb_image) + " Size: " + std::to_string(_zwImage->width) + ", " + std::to_string(_zwImage->height);
     LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, _zw);
 #endif
 
-    for (int x = 0; x < width; ++x)
+    if ((_zwImage->width == _Image->width) && (_zwImage->height == _Image->height) && (_zwImage->channels == _Image->channels))
     {
-        for (int y = 0; y < height; ++y)
+        if (_zwImage->OwnsHeapImage() && _Image->OwnsHeapImage())
         {
-            p_target = _Image->rgb_image + (channels * (y * width + x));
-            p_source = _zwImage->rgb_image + (channels * (y * width + x));
-
-            for (int c = 0; c < channels; c++)
-            {
-                p_target[c] = p_source[c];
-            }
+            // Hand the decoded buffer over instead of copying it, the previous buffer of _Image gets freed
+            *_Image = std::move(*_zwImage);
+        }
+        else
+        {
+            // Decoded into the shared PSRAM region (reused by later steps), so the content has to be copied
+            _Image->CopyFromMemory(_zwImage->rgb_image, _Image->width * _Image->height * _Image->channels);
         }
     }
+    else
+    {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "CaptureToBasisImage: Image size does not match: " + std::to_string(_zwImage->width) + "x" + 
+                std::to_string(_zwImage->height) + " instead of " + std::to_string(_Image->width) + "x" + std::to_string(_Image->height));
+    }
 
     delete _zwImage;
 
@@ -776,9 +871,7 @@ esp_err_t CCamera::CaptureToFile(std::string nm, int delay)
         vTaskDelay(xDelay);
     }
 
-    camera_fb_t *fb = esp_camera_fb_get();
-    esp_camera_fb_return(fb);
-    fb = esp_camera_fb_get();
+    camera_fb_t *fb = camera_frames::get(FrameNotBefore(delay));
 
     if (!fb)
     {
@@ -856,7 +949,7 @@ esp_err_t CCamera::CaptureToFile(std::string nm, int delay)
         free(buf);
     }
 
-    esp_camera_fb_return(fb);
+    camera_frames::release(fb);
 
     if (delay > 0)
     {
@@ -881,9 +974,7 @@ esp_err_t CCamera::CaptureToHTTP(httpd_req_t *req, int delay)
         vTaskDelay(xDelay);
     }
 
-    camera_fb_t *fb = esp_camera_fb_get();
-    esp_camera_fb_return(fb);
-    fb = esp_camera_fb_get();
+    camera_fb_t *fb = camera_frames::get(FrameNotBefore(delay));
 
     if (!fb)
     {
@@ -945,7 +1036,7 @@ esp_err_t CCamera::CaptureToHTTP(httpd_req_t *req, int delay)
         }
     }
 
-    esp_camera_fb_return(fb);
+    camera_frames::release(fb);
     int64_t fr_end = esp_timer_get_time();
 
     ESP_LOGI(TAG, "JPG: %dKB %dms", (int)(fb_len / 1024), (int)((fr_end - fr_start) / 1000));
@@ -987,12 +1078,13 @@ esp_err_t CCamera::CaptureToStream(httpd_req_t *req, bool FlashlightOn)
     httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
     httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
 
+    int64_t not_before = esp_timer_get_time();
+
     while (1)
     {
         fr_start = esp_timer_get_time();
-        camera_fb_t *fb = esp_camera_fb_get();
-        esp_camera_fb_return(fb);
-        fb = esp_camera_fb_get();
+        // Any frame newer than the previous one, the driver captured it while the previous one got sent
+        camera_fb_t *fb = camera_frames::get(not_before);
 
         if (!fb)
         {
@@ -1001,6 +1093,7 @@ esp_err_t CCamera::CaptureToStream(httpd_req_t *req, bool FlashlightOn)
         }
 
         fb_len = fb->len;
+        not_before = camera_frames::timestamp(fb) + 1;
 
         if (res == ESP_OK)
         {
@@ -1018,7 +1111,7 @@ esp_err_t CCamera::CaptureToStream(httpd_req_t *req, bool FlashlightOn)
             res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
         }
 
-        esp_camera_fb_return(fb);
+        camera_frames::release(fb);
 
         int64_t fr_end = esp_timer_get_time();
         ESP_LOGD(TAG, "JPG: %dKB %dms", (int)(fb_len / 1024), (int)((fr_end - fr_start) / 1000));
@@ -0,0 +1,97 @@
+#include "camera_frames.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "ClassLogFile.h"
+#include "../../include/defines.h"
+
+static const char *TAG = "CAM_FRAMES";
+
+namespace camera_frames {
+
+static SemaphoreHandle_t mutex_handle = NULL;  // Held from get() until release(), also guards invalidated_us
+static int64_t invalidated_us = 0;
+
+
+bool init()
+{
+    if (mutex_handle == NULL) {
+        mutex_handle = xSemaphoreCreateMutex();
+    }
+
+    return (mutex_handle != NULL);
+}
+
+
+int64_t timestamp(const camera_fb_t *_fb)
+{
+    return (int64_t)_fb->timestamp.tv_sec * 1000000 + _fb->timestamp.tv_usec;
+}
+
+
+camera_fb_t *get(int64_t _not_before_us)
+{
+    if (mutex_handle == NULL) {
+        return NULL;
+    }
+
+    xSemaphoreTake(mutex_handle, portMAX_DELAY);
+
+    if (_not_before_us < invalidated_us) {
+        _not_before_us = invalidated_us;
+    }
+
+    camera_fb_t *fb = esp_camera_fb_get();
+    int grabs = 1;
+
+    while (fb && (timestamp(fb) < _not_before_us) && (grabs < CAMERA_FRAME_MAX_GRABS)) {
+        esp_camera_fb_return(fb);
+        fb = esp_camera_fb_get();
+        grabs++;
+    }
+
+    if (fb == NULL) {
+        xSemaphoreGive(mutex_handle);
+        return NULL;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (timestamp(fb) < _not_before_us) {
+        LOGFILE_WRITE(ESP_LOG_WARN, TAG, "No frame started late enough after %d grabs, using one which is %d ms too old",
+                      grabs, (int)((_not_before_us - timestamp(fb)) / 1000));
+    }
+    else {
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Frame age: %d ms, grabs: %d", (int)((now - timestamp(fb)) / 1000), grabs);
+    }
+
+    return fb;
+}
+
+
+void release(camera_fb_t *_fb)
+{
+    if (_fb == NULL) {
+        return;
+    }
+
+    esp_camera_fb_return(_fb);
+    xSemaphoreGive(mutex_handle);
+}
+
+
+void invalidate()
+{
+    if (mutex_handle == NULL) {
+        return;
+    }
+
+    // 64 bit, so it gets written under the mutex as well
+    xSemaphoreTake(mutex_handle, portMAX_DELAY);
+    invalidated_us = esp_timer_get_time();
+    xSemaphoreGive(mutex_handle);
+}
+
+}
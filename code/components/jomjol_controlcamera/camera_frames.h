@@ -0,0 +1,32 @@
+#pragma once
+
+#ifndef CAMERA_FRAMES_H
+#define CAMERA_FRAMES_H
+
+#include <stdint.h>
+
+#include "esp_camera.h"
+
+/* All frames get taken from the camera driver here. With one frame buffer the driver captures the next frame
+ * right after the previous one got returned, so the buffered frame can be minutes old. The frame timestamp
+ * (start of the frame, esp_timer_get_time() time base) tells whether it can be used or has to be replaced. */
+namespace camera_frames {
+
+/* Creates the mutex, called once by CCamera::InitCam() before any task takes a frame */
+bool init();
+
+/* Frame which started at or after _not_before_us (and after the last invalidate()). Older frames get returned
+ * and replaced by the next one, at most CAMERA_FRAME_MAX_GRABS frames. NULL if the camera delivers no frame.
+ * Other callers wait until the frame got released */
+camera_fb_t *get(int64_t _not_before_us);
+void release(camera_fb_t *_fb);
+
+/* Frames started before now do not get used anymore, e.g. after changing the sensor settings. Waits until a frame
+ * which is still in use got released */
+void invalidate();
+
+int64_t timestamp(const camera_fb_t *_fb);
+
+}
+
+#endif //CAMERA_FRAMES_H
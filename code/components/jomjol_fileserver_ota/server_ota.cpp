@@ -15,6 +15,8 @@ https://docs.espressif.com/projects/esp-idf/en/latest/esp32/migration-guides/rel
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_system.h"
 #include "esp_log.h"
 #include <esp_ota_ops.h>
@@ -39,12 +41,14 @@ https://docs.espressif.com/projects/esp-idf/en/latest/esp32/migration-guides/rel
 #include "server_GPIO.h"
 #ifdef ENABLE_MQTT
     #include "interface_mqtt.h"
+    #include "mqtt_backlog.h"
 #endif //ENABLE_MQTT
 #include "ClassControllCamera.h"
 #include "connect_wlan.h"
 
 
 #include "ClassLogFile.h"
+#include "model_store.h"
 
 #include "Helper.h"
 #include "statusled.h"
@@ -478,6 +482,9 @@ esp_err_t DownloadModel(const std::string &url,
         return ESP_FAIL;
     }
 
+    // A stored copy of the old file is outdated, the new one gets stored in flash when it is loaded the first time
+    model_store::remove(final_path);
+
     if (set_active) {
         const std::string active = rel_path + "\n";
         if (!write_text_file_atomic(kActiveModelFile, active)) {
@@ -818,6 +825,69 @@ static void send_bad_gateway(httpd_req_t *req, const char *message)
     httpd_resp_send(req, message, HTTPD_RESP_USE_STRLEN);
 }
 
+/* Buffer handed from the HTTP reader to the OTA writer task */
+struct OtaStreamChunk {
+    uint8_t *data;
+    size_t len;                         // 0 = end of the stream
+};
+
+struct OtaStreamWriter {
+    esp_ota_handle_t handle;
+    QueueHandle_t filled;               // Reader -> writer
+    QueueHandle_t empty;                // Writer -> reader
+    SemaphoreHandle_t done;
+    volatile esp_err_t err;
+};
+
+/* Writes the chunks into the OTA partition while the reader already receives the next one */
+static void task_OtaWriter(void *pvParameter)
+{
+    OtaStreamWriter *writer = (OtaStreamWriter *)pvParameter;
+    OtaStreamChunk chunk;
+
+    while (xQueueReceive(writer->filled, &chunk, portMAX_DELAY) == pdTRUE) {
+        if (chunk.len == 0) {
+            break;
+        }
+
+        if (writer->err == ESP_OK) {
+            writer->err = esp_ota_write(writer->handle, chunk.data, chunk.len);
+        }
+        xQueueSend(writer->empty, &chunk, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(writer->done);
+    vTaskDelete(NULL);
+}
+
+/* Opens the request, from _offset on (range request) if the download gets resumed */
+static esp_err_t ota_stream_open(esp_http_client_handle_t client, size_t _offset)
+{
+    if (_offset > 0) {
+        const std::string range = "bytes=" + std::to_string(_offset) + "-";
+        esp_http_client_set_header(client, "Range", range.c_str());
+    }
+
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    esp_http_client_fetch_headers(client);
+    int status = esp_http_client_get_status_code(client);
+
+    if (status != ((_offset > 0) ? 206 : 200)) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Firmware download: unexpected HTTP status " + std::to_string(status) + 
+                                                ((_offset > 0) ? " for range request" : ""));
+        esp_http_client_close(client);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/* Streams the firmware directly into the OTA partition (no copy on the file system). The SHA-256 gets calculated
+ * while reading, a dropped connection gets resumed with a range request (max. OTA_STREAM_MAX_RESUMES times). */
 static esp_err_t http_stream_firmware_to_ota_partition_with_sha256(const std::string &url,
                                                                    const std::string &expected_sha256_hex)
 {
@@ -825,68 +895,121 @@ static esp_err_t http_stream_firmware_to_ota_partition_with_sha256(const std::st
     cfg.url = url.c_str();
     cfg.method = HTTP_METHOD_GET;
     cfg.timeout_ms = 30000;
+    cfg.buffer_size = 4096;
     if (apply_tls_settings(cfg) != ESP_OK) {
         return ESP_FAIL;
     }
 
-    esp_http_client_handle_t client = esp_http_client_init(&cfg);
-    if (!client) {
-        return ESP_FAIL;
-    }
-
     const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
     if (!update_partition) {
-        esp_http_client_cleanup(client);
         return ESP_FAIL;
     }
 
-    esp_ota_handle_t update_handle = 0;
-    esp_err_t err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &update_handle);
+    // Two buffers: one gets filled by the HTTP client, the other one written into the flash
+    uint8_t *buffers = (uint8_t *)heap_caps_malloc(2 * OTA_STREAM_BUFFER_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (buffers == NULL) {
+        buffers = (uint8_t *)heap_caps_malloc(2 * OTA_STREAM_BUFFER_SIZE, MALLOC_CAP_8BIT);
+    }
+
+    OtaStreamWriter writer = {};
+    writer.filled = xQueueCreate(3, sizeof(OtaStreamChunk));
+    writer.empty = xQueueCreate(2, sizeof(OtaStreamChunk));
+    writer.done = xSemaphoreCreateBinary();
+    writer.err = ESP_OK;
+
+    esp_http_client_handle_t client = esp_http_client_init(&cfg);
+
+    auto cleanup = [&]() {
+        if (client) esp_http_client_cleanup(client);
+        if (writer.filled) vQueueDelete(writer.filled);
+        if (writer.empty) vQueueDelete(writer.empty);
+        if (writer.done) vSemaphoreDelete(writer.done);
+        free(buffers);
+    };
+
+    if (!client || !buffers || !writer.filled || !writer.empty || !writer.done) {
+        cleanup();
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &writer.handle);
     if (err != ESP_OK) {
-        esp_http_client_cleanup(client);
+        cleanup();
         return err;
     }
 
+    err = ota_stream_open(client, 0);
+    if ((err != ESP_OK) ||
+        (xTaskCreate(&task_OtaWriter, "task_OtaWriter", 4 * 1024, &writer, uxTaskPriorityGet(NULL), NULL) != pdPASS)) {
+        esp_ota_abort(writer.handle);
+        cleanup();
+        return (err != ESP_OK) ? err : ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        OtaStreamChunk chunk = {buffers + i * OTA_STREAM_BUFFER_SIZE, 0};
+        xQueueSend(writer.empty, &chunk, 0);
+    }
+
     mbedtls_sha256_context sha;
     mbedtls_sha256_init(&sha);
     mbedtls_sha256_starts(&sha, 0);
 
-    err = esp_http_client_open(client, 0);
-    if (err != ESP_OK) {
-        esp_ota_end(update_handle);
-        esp_http_client_cleanup(client);
-        mbedtls_sha256_free(&sha);
-        return err;
-    }
+    int64_t starttime = esp_timer_get_time();
+    size_t total = 0;
+    int resumes = 0;
+    bool finished = false;
 
-    int status = esp_http_client_fetch_headers(client);
-    (void)status;
+    while (!finished && (err == ESP_OK) && (writer.err == ESP_OK)) {
+        OtaStreamChunk chunk;
+        xQueueReceive(writer.empty, &chunk, portMAX_DELAY);
+        chunk.len = 0;
 
-    char buf[SERVER_OTA_SCRATCH_BUFSIZE];
-    size_t total = 0;
-    while (true) {
-        int r = esp_http_client_read(client, buf, sizeof(buf));
-        if (r < 0) {
-            err = ESP_FAIL;
-            break;
-        }
-        if (r == 0) {
-            err = ESP_OK;
-            break;
+        while ((chunk.len < OTA_STREAM_BUFFER_SIZE) && (err == ESP_OK)) {
+            int r = esp_http_client_read(client, (char *)chunk.data + chunk.len, OTA_STREAM_BUFFER_SIZE - chunk.len);
+
+            if ((r > 0)) {
+                chunk.len += r;
+                continue;
+            }
+
+            if ((r == 0) && esp_http_client_is_complete_data_received(client)) {
+                finished = true;
+                break;
+            }
+
+            // Connection lost, continue where it stopped
+            esp_http_client_close(client);
+            if (resumes++ >= OTA_STREAM_MAX_RESUMES) {
+                err = ESP_FAIL;
+                break;
+            }
+            LogFile.WriteToFile(ESP_LOG_WARN, TAG, "Firmware download interrupted after " + std::to_string(total + chunk.len) + " bytes, resuming...");
+            vTaskDelay(1000 / portTICK_PERIOD_MS);
+            err = ota_stream_open(client, total + chunk.len);
         }
 
-        total += (size_t)r;
+        total += chunk.len;
         if (total > update_partition->size) {
             err = ESP_ERR_INVALID_SIZE;
-            break;
         }
 
-        err = esp_ota_write(update_handle, buf, (size_t)r);
-        if (err != ESP_OK) {
-            break;
+        if ((err == ESP_OK) && (chunk.len > 0)) {
+            mbedtls_sha256_update(&sha, chunk.data, chunk.len);
+            xQueueSend(writer.filled, &chunk, portMAX_DELAY);
+        }
+        else {
+            xQueueSend(writer.empty, &chunk, portMAX_DELAY);
         }
+    }
 
-        mbedtls_sha256_update(&sha, (const unsigned char *)buf, (size_t)r);
+    // Let the writer finish the queued chunks
+    OtaStreamChunk end = {NULL, 0};
+    xQueueSend(writer.filled, &end, portMAX_DELAY);
+    xSemaphoreTake(writer.done, portMAX_DELAY);
+
+    if (err == ESP_OK) {
+        err = writer.err;
     }
 
     uint8_t digest[32];
@@ -894,23 +1017,27 @@ static esp_err_t http_stream_firmware_to_ota_partition_with_sha256(const std::st
     mbedtls_sha256_free(&sha);
 
     esp_http_client_close(client);
-    esp_http_client_cleanup(client);
+    cleanup();
 
     if (err != ESP_OK) {
-        esp_ota_end(update_handle);
+        esp_ota_abort(writer.handle);
         return err;
     }
 
+    LogFile.WriteToFile(ESP_LOG_INFO, TAG, "Firmware written: " + std::to_string(total) + " bytes in " + 
+                                           std::to_string((esp_timer_get_time() - starttime) / 1000) + " ms" +
+                                           ((resumes > 0) ? " (resumed " + std::to_string(resumes) + "x)" : ""));
+
     if (!expected_sha256_hex.empty()) {
         const std::string actual_hex = bytes_to_hex(digest, sizeof(digest));
         if (actual_hex != expected_sha256_hex) {
             LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "SHA256 mismatch for firmware.bin expected=" + expected_sha256_hex + " actual=" + actual_hex);
-            esp_ota_end(update_handle);
+            esp_ota_abort(writer.handle);
             return ESP_ERR_INVALID_CRC;
         }
     }
 
-    err = esp_ota_end(update_handle);
+    err = esp_ota_end(writer.handle);
     if (err != ESP_OK) {
         return err;
     }
@@ -1680,11 +1807,13 @@ void task_reboot(void *DeleteMainFlow)
 
     /* Stop service tasks */
     #ifdef ENABLE_MQTT
+        mqtt_backlog::persist();
         MQTTdestroy_client(true);
     #endif //ENABLE_MQTT
     gpio_handler_destroy();
     esp_camera_deinit();
     WIFIDestroy();
+    LogFile.Flush();
 
     vTaskDelay(3000 / portTICK_PERIOD_MS);
     esp_restart();      // Reset type: CPU reset (Reset both CPUs)
@@ -1719,6 +1848,7 @@ void doRebootOTA()
     Camera.LightOnOff(false);
     StatusLEDOff();
     esp_camera_deinit();
+    LogFile.Flush();
 
     vTaskDelay(5000 / portTICK_PERIOD_MS);
     esp_restart();      // Reset type: CPU reset (Reset both CPUs)
@@ -2028,6 +2158,7 @@ static esp_err_t handler_models_sync(httpd_req_t *req)
             deleted.push_back(p);
             if (!dry_run) {
                 (void)unlink((std::string("/spiffs") + p).c_str());
+                model_store::remove(std::string("/spiffs") + p);
             }
         }
     }
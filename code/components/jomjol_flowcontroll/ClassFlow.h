@@ -8,6 +8,8 @@
 
 #include "Helper.h"
 #include "CImageBasis.h"
+#include "result_snapshot.h"
+#include "image_cache.h"
 
 using namespace std;
 
@@ -47,6 +49,13 @@ public:
 	virtual string getHTMLSingleStep(string host);
 	virtual string name(){return "ClassFlow";};
 
+	// Steps which only send the results of a round (MQTT, InfluxDB, Webhook). They get called with doPublish()
+	// instead of doFlow(), with the pipelined flow on their own task while the next round is already running.
+	virtual bool isPublisher(){return false;};
+	// True if doPublish() needs alg_roi.jpg of the round
+	virtual bool wantsImage(const result_snapshot::Snapshot &_snapshot){return false;};
+	virtual bool doPublish(const result_snapshot::SnapshotRef &_snapshot, const image_cache::JpegRef &_image){return true;};
+
 };
 
 #endif //CLASSFLOW_H
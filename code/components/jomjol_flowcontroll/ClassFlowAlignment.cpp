@@ -3,7 +3,7 @@
 #include "ClassFlow.h"
 #include "MainFlowControl.h"
 
-#include "CRotateImage.h"
+#include "affine_warp.h"
 #include "esp_log.h"
 
 #include "ClassLogFile.h"
@@ -33,6 +33,8 @@ void ClassFlowAlignment::SetInitialParameter(void)
     previousElement = NULL;
     disabled = false;
     SAD_criteria = 0.05;
+    References[0].tpl = &RefTemplates[0];
+    References[1].tpl = &RefTemplates[1];
 }
 
 ClassFlowAlignment::ClassFlowAlignment(std::vector<ClassFlow *> *lfc)
@@ -135,6 +137,9 @@ bool ClassFlowAlignment::ReadParameter(FILE *pfile, string &aktparamgraph)
                 // no align algo if set to 3 = off => no draw ref //add disable aligment algo |01.2023
                 alg_algo = 3;
             }
+            if (toUpper(splitted[1]) == "PYRAMID") {
+                alg_algo = 4;
+            }
         }
     }
 
@@ -209,7 +214,9 @@ bool ClassFlowAlignment::doFlow(string time)
         return false;
     }
 
-    CRotateImage rt("rawImage", AlignAndCutImage, ImageTMP, initialflip);
+    int raw_width = AlignAndCutImage->width;
+    int raw_height = AlignAndCutImage->height;
+    bool initialtransform = (initialrotate != 0) || initialflip;
 
     if (initialflip) {
         int _zw = ImageBasis->height;
@@ -219,27 +226,49 @@ bool ClassFlowAlignment::doFlow(string time)
         _zw = ImageTMP->width;
         ImageTMP->width = ImageTMP->height;
         ImageTMP->height = _zw;
+
+        AlignAndCutImage->width = ImageBasis->width;
+        AlignAndCutImage->height = ImageBasis->height;
     }
 
-    if ((initialrotate != 0) || initialflip) {
-        if (use_antialiasing) {
-            rt.RotateAntiAliasing(initialrotate);
-        }
-        else {
-            rt.Rotate(initialrotate);
-        }
-
-        if (SaveAllFiles && JOMJOL_ENABLE_IMAGE_PERSISTENCE) {
-            AlignAndCutImage->SaveToFile(FormatFileName("/spiffs/img_tmp/rot.jpg"));
-        }
-    }
+    // Initial rotation/flip and the alignment get combined into one transformation of the raw image,
+    // so the full frame only gets warped (and copied back) once per round
+    affine_warp::Transform initial = affine_warp::initial_rotation(initialrotate, initialflip, raw_width, raw_height);
 
     // no align algo if set to 3 = off //add disable aligment algo |01.2023
     if (References[0].alignment_algo != 3) {
-        if (!AlignAndCutImage->Align(&References[0], &References[1])) {
+        // Decode the reference images only once (again if a file got changed)
+        for (int i = 0; i < anz_ref; ++i) {
+            RefTemplateUpdate(&RefTemplates[i], References[i].image_file, ImageBasis->channels);
+        }
+
+        uint8_t *searchimage = AlignAndCutImage->rgb_image;
+
+        if (initialtransform) {
+            // The references get searched in the rotated image, it is only needed within the search fields
+            bool saverotated = SaveAllFiles && JOMJOL_ENABLE_IMAGE_PERSISTENCE;
+            AlignAndCutImage->PrepareSearchImage(&References[0], &References[1], initial, raw_width, raw_height, use_antialiasing, saverotated);
+
+            if (saverotated) {
+                ImageTMP->SaveToFile(FormatFileName("/spiffs/img_tmp/rot.jpg"));
+            }
+            searchimage = ImageTMP->rgb_image;
+        }
+
+        affine_warp::Transform align;
+        if (!AlignAndCutImage->FindAlignment(&References[0], &References[1], searchimage, align)) {
             SaveReferenceAlignmentValues();
         }
+
+        AlignAndCutImage->Warp(affine_warp::compose(initial, align), raw_width, raw_height, use_antialiasing);
     } // no align
+    else if (initialtransform) {
+        AlignAndCutImage->Warp(initial, raw_width, raw_height, use_antialiasing);
+
+        if (SaveAllFiles && JOMJOL_ENABLE_IMAGE_PERSISTENCE) {
+            AlignAndCutImage->SaveToFile(FormatFileName("/spiffs/img_tmp/rot.jpg"));
+        }
+    }
 
 #ifdef ALGROI_LOAD_FROM_MEM_AS_JPG
     if (AlgROI) {
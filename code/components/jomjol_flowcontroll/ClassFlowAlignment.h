@@ -19,6 +19,7 @@ protected:
     bool initialflip;
     bool use_antialiasing;
     RefInfo References[2];
+    RefTemplate RefTemplates[2];        // decoded reference images, kept between the rounds
     int anz_ref;
     string namerawimage;
     bool SaveAllFiles;
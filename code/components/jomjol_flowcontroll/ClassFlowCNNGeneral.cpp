@@ -3,8 +3,10 @@
 #include <math.h>
 #include <sys/types.h>
 #include <cstdio>
+#include <esp_timer.h>
 
 #include "CTfLiteClass.h"
+#include "roi_workers.h"
 #include "ClassLogFile.h"
 #include "esp_log.h"
 #include "../../include/defines.h"
@@ -54,7 +56,7 @@ string ClassFlowCNNGeneral::getReadout(int _analog = 0, bool _extendedResolution
         return result;
     }
     
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "getReadout _analog=" + std::to_string(_analog) + ", _extendedResolution=" + std::to_string(_extendedResolution) + ", prev=" + std::to_string(prev));
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "getReadout _analog=%d, _extendedResolution=%d, prev=%d", _analog, _extendedResolution, prev);
  
     if (CNNType == Analogue || CNNType == Analogue100) {
         float number = GENERAL[_analog]->ROI[GENERAL[_analog]->ROI.size() - 1]->result_float;
@@ -98,7 +100,8 @@ string ClassFlowCNNGeneral::getReadout(int _analog = 0, bool _extendedResolution
 
                 result = std::to_string(result_before_decimal_point) + std::to_string(result_after_decimal_point);
                 prev = result_before_decimal_point;
-                LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "getReadout(dig100-ext) result_before_decimal_point=" + std::to_string(result_before_decimal_point) + ", result_after_decimal_point=" + std::to_string(result_after_decimal_point) + ", prev=" + std::to_string(prev));
+                LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "getReadout(dig100-ext) result_before_decimal_point=%d, result_after_decimal_point=%d, prev=%d",
+                              result_before_decimal_point, result_after_decimal_point, prev);
             }
             else {
                 if (_before_narrow_Analog >= 0) {
@@ -111,7 +114,7 @@ string ClassFlowCNNGeneral::getReadout(int _analog = 0, bool _extendedResolution
                 // is necessary because a number greater than 9.994999 returns a 10! (for further details see check in PointerEvalHybridNew)
                 if ((prev >= 0) && (prev < 10)) {
                     result = std::to_string(prev);
-                    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "getReadout(dig100)  prev=" + std::to_string(prev));
+                    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "getReadout(dig100)  prev=%d", prev);
                 }
                 else {
                     result = "N";
@@ -128,14 +131,14 @@ string ClassFlowCNNGeneral::getReadout(int _analog = 0, bool _extendedResolution
         for (int i = GENERAL[_analog]->ROI.size() - 2; i >= 0; --i) {
             if ((GENERAL[_analog]->ROI[i]->result_float >= 0) && (GENERAL[_analog]->ROI[i]->result_float < 10)) {
                 prev = PointerEvalHybridNew(GENERAL[_analog]->ROI[i]->result_float, GENERAL[_analog]->ROI[i+1]->result_float, prev);
-                LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "getReadout#PointerEvalHybridNew()= " + std::to_string(prev));
+                LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "getReadout#PointerEvalHybridNew()= %d", prev);
                 result = std::to_string(prev) + result;
-                LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "getReadout#result= " + result);
+                LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "getReadout#result= %s", result.c_str());
             }
             else {
                 prev = -1;
                 result = "N" + result;
-                LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "getReadout(result_float<0 /'N')  result_float=" + std::to_string(GENERAL[_analog]->ROI[i]->result_float));
+                LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "getReadout(result_float<0 /'N')  result_float=%f", GENERAL[_analog]->ROI[i]->result_float);
             }
         }
         return result;
@@ -173,15 +176,17 @@ int ClassFlowCNNGeneral::PointerEvalHybridNew(float number, float number_of_pred
         // Another alternative would be "result = (int) ((int) trunc(round((number+10 % 10)*1000))) / 1000;", which could, however, lead to other errors?
         result = (int) ((int) trunc(round((number+10 % 10)*100)) )  / 100;
 
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "PointerEvalHybridNew - No predecessor - Result = " + std::to_string(result) +
-                                                    " number: " + std::to_string(number) + " number_of_predecessors = " + std::to_string(number_of_predecessors)+ " eval_predecessors = " + std::to_string(eval_predecessors) + " Digit_Uncertainty = " +  std::to_string(Digit_Uncertainty));
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "PointerEvalHybridNew - No predecessor - Result = %d"
+                      " number: %f number_of_predecessors = %f eval_predecessors = %d Digit_Uncertainty = %f",
+                      result, number, number_of_predecessors, eval_predecessors, Digit_Uncertainty);
         return result;
     }
 
     if (Analog_Predecessors) {
         result = PointerEvalAnalogToDigitNew(number, number_of_predecessors, eval_predecessors, digitAnalogTransitionStart);
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "PointerEvalHybridNew - Analog predecessor, evaluation over PointerEvalAnalogNew = " + std::to_string(result) +
-                                                    " number: " + std::to_string(number) + " number_of_predecessors = " + std::to_string(number_of_predecessors)+ " eval_predecessors = " + std::to_string(eval_predecessors) + " Digit_Uncertainty = " +  std::to_string(Digit_Uncertainty));
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "PointerEvalHybridNew - Analog predecessor, evaluation over PointerEvalAnalogNew = %d"
+                      " number: %f number_of_predecessors = %f eval_predecessors = %d Digit_Uncertainty = %f",
+                      result, number, number_of_predecessors, eval_predecessors, Digit_Uncertainty);
         return result;
     }
 
@@ -195,8 +200,9 @@ int ClassFlowCNNGeneral::PointerEvalHybridNew(float number, float number_of_pred
             result = ((int) trunc(number) + 10) % 10;
         }
 
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "PointerEvalHybridNew - NO analogue predecessor, no change of digits, as pre-decimal point far enough away = " + std::to_string(result) +
-                                                    " number: " + std::to_string(number) + " number_of_predecessors = " + std::to_string(number_of_predecessors)+ " eval_predecessors = " + std::to_string(eval_predecessors) + " Digit_Uncertainty = " +  std::to_string(Digit_Uncertainty));
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "PointerEvalHybridNew - NO analogue predecessor, no change of digits, as pre-decimal point far enough away = %d"
+                      " number: %f number_of_predecessors = %f eval_predecessors = %d Digit_Uncertainty = %f",
+                      result, number, number_of_predecessors, eval_predecessors, Digit_Uncertainty);
         return result;
     }  
 
@@ -212,8 +218,9 @@ int ClassFlowCNNGeneral::PointerEvalHybridNew(float number, float number_of_pred
             // Act. digit and predecessor have zero crossing
             result =  result_before_decimal_point % 10;
         }
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "PointerEvalHybridNew - NO analogue predecessor, zero crossing has taken placen = " + std::to_string(result) +
-                                                    " number: " + std::to_string(number) + " number_of_predecessors = " + std::to_string(number_of_predecessors)+ " eval_predecessors = " + std::to_string(eval_predecessors) + " Digit_Uncertainty = " +  std::to_string(Digit_Uncertainty));
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "PointerEvalHybridNew - NO analogue predecessor, zero crossing has taken placen = %d"
+                      " number: %f number_of_predecessors = %f eval_predecessors = %d Digit_Uncertainty = %f",
+                      result, number, number_of_predecessors, eval_predecessors, Digit_Uncertainty);
         return result;
     }
 
@@ -232,8 +239,9 @@ int ClassFlowCNNGeneral::PointerEvalHybridNew(float number, float number_of_pred
         result =  (result_before_decimal_point - 1 + 10) % 10;
     }
 
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "PointerEvalHybridNew - O analogue predecessor, >= 9.5 --> no zero crossing yet = " + std::to_string(result) +
-                                                " number: " + std::to_string(number) + " number_of_predecessors = " + std::to_string(number_of_predecessors)+ " eval_predecessors = " + std::to_string(eval_predecessors) + " Digit_Uncertainty = " +  std::to_string(Digit_Uncertainty) + " result_after_decimal_point = " + std::to_string(result_after_decimal_point));
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "PointerEvalHybridNew - O analogue predecessor, >= 9.5 --> no zero crossing yet = %d"
+                  " number: %f number_of_predecessors = %f eval_predecessors = %d Digit_Uncertainty = %f result_after_decimal_point = %d",
+                  result, number, number_of_predecessors, eval_predecessors, Digit_Uncertainty, result_after_decimal_point);
     return result;
 }
 
@@ -251,15 +259,13 @@ int ClassFlowCNNGeneral::PointerEvalAnalogToDigitNew(float number, float numeral
         // before/ after decimal point, because we adjust the number based on the uncertainty.
         result_after_decimal_point = ((int) floor(result * 10)) % 10;
         result_before_decimal_point = ((int) floor(result) + 10) % 10;
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "PointerEvalAnalogToDigitNew - Digit Uncertainty - Result = " + std::to_string(result) +
-                                                    " number: " + std::to_string(number) + " numeral_preceder: " + std::to_string(numeral_preceder) +
-                                                    " erg before comma: " + std::to_string(result_before_decimal_point) + 
-                                                    " erg after comma: " + std::to_string(result_after_decimal_point));
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "PointerEvalAnalogToDigitNew - Digit Uncertainty - Result = %d number: %f numeral_preceder: %f erg before comma: %d erg after comma: %d",
+                      result, number, numeral_preceder, result_before_decimal_point, result_after_decimal_point);
     } 
     else {
         result = (int) ((int) trunc(number) + 10) % 10;
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "PointerEvalAnalogToDigitNew - NO digit Uncertainty - Result = " + std::to_string(result) +
-                                                    " number: " + std::to_string(number) + " numeral_preceder = " + std::to_string(numeral_preceder));
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "PointerEvalAnalogToDigitNew - NO digit Uncertainty - Result = %d number: %f numeral_preceder = %f",
+                      result, number, numeral_preceder);
     }
 
     // No zero crossing has taken place.
@@ -267,10 +273,8 @@ int ClassFlowCNNGeneral::PointerEvalAnalogToDigitNew(float number, float numeral
     // numeral_preceder<=0.1 & eval_predecessors=9 corresponds to analogue was reset because of previous analogue that are not yet at 0.
     if ((eval_predecessors>=6 && (numeral_preceder>AnalogToDigitTransitionStart || numeral_preceder<=0.2) && roundedUp)) {
         result =  ((result_before_decimal_point+10) - 1) % 10;
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "PointerEvalAnalogToDigitNew - Nulldurchgang noch nicht stattgefunden = " + std::to_string(result) +
-                                    " number: " + std::to_string(number) + 
-                                    " numeral_preceder = " + std::to_string(numeral_preceder) + 
-                                    " eerg after comma = " +  std::to_string(result_after_decimal_point));
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "PointerEvalAnalogToDigitNew - Nulldurchgang noch nicht stattgefunden = %d number: %f numeral_preceder = %f eerg after comma = %d",
+                      result, number, numeral_preceder, result_after_decimal_point);
     }
 
     return result;
@@ -282,8 +286,9 @@ int ClassFlowCNNGeneral::PointerEvalAnalogNew(float number, int numeral_preceder
 
     if (numeral_preceder == -1) {
         result = (int) floor(number);
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "PointerEvalAnalogNew - No predecessor - Result = " + std::to_string(result) +
-                                                    " number: " + std::to_string(number) + " numeral_preceder = " + std::to_string(numeral_preceder) + " Analog_error = " +  std::to_string(Analog_error));
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "PointerEvalAnalogNew - No predecessor - Result = %d"
+                      " number: %f numeral_preceder = %d Analog_error = %d",
+                      result, number, numeral_preceder, Analog_error);
         return result;
     }
 
@@ -293,21 +298,24 @@ int ClassFlowCNNGeneral::PointerEvalAnalogNew(float number, int numeral_preceder
     if ((int) floor(number_max) - (int) floor(number_min) != 0) {
         if (numeral_preceder <= Analog_error) {
             result = ((int) floor(number_max) + 10) % 10;
-            LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "PointerEvalAnalogNew - number ambiguous, correction upwards - result = " + std::to_string(result) +
-                                                        " number: " + std::to_string(number) + " numeral_preceder = " + std::to_string(numeral_preceder) + " Analog_error = " +  std::to_string(Analog_error));
+            LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "PointerEvalAnalogNew - number ambiguous, correction upwards - result = %d"
+                          " number: %f numeral_preceder = %d Analog_error = %d",
+                          result, number, numeral_preceder, Analog_error);
             return result;
         }
         if (numeral_preceder >= 10 - Analog_error) {
             result = ((int) floor(number_min) + 10) % 10;
-            LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "PointerEvalAnalogNew - number ambiguous, downward correction - result = " + std::to_string(result) +
-                                                        " number: " + std::to_string(number) + " numeral_preceder = " + std::to_string(numeral_preceder) + " Analog_error = " +  std::to_string(Analog_error));
+            LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "PointerEvalAnalogNew - number ambiguous, downward correction - result = %d"
+                          " number: %f numeral_preceder = %d Analog_error = %d",
+                          result, number, numeral_preceder, Analog_error);
             return result;
         }
     }
     
     result = ((int) floor(number) + 10) % 10;
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "PointerEvalAnalogNew - number unambiguous, no correction necessary - result = " + std::to_string(result) +
-                                                " number: " + std::to_string(number) + " numeral_preceder = " + std::to_string(numeral_preceder) + " Analog_error = " +  std::to_string(Analog_error));
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "PointerEvalAnalogNew - number unambiguous, no correction necessary - result = %d"
+                  " number: %f numeral_preceder = %d Analog_error = %d",
+                  result, number, numeral_preceder, Analog_error);
 
     return result;
 }
@@ -539,7 +547,7 @@ bool ClassFlowCNNGeneral::doFlow(string time) {
         return false;
     }
 
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "doFlow after alignment");
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "doFlow after alignment");
 
     doNeuralNetwork(time);
 
@@ -560,29 +568,36 @@ bool ClassFlowCNNGeneral::doAlignAndCut(string time) {
 
     CAlignAndCutImage *caic = flowpostalignment->GetAlignAndCutImage();    
 
+    std::vector<roi*> rois;
     for (int _ana = 0; _ana < GENERAL.size(); ++_ana) {
         for (int i = 0; i < GENERAL[_ana]->ROI.size(); ++i) {
-            ESP_LOGD(TAG, "General %d - Align&Cut", i);
-            
-            caic->CutAndSave(GENERAL[_ana]->ROI[i]->posx, GENERAL[_ana]->ROI[i]->posy, GENERAL[_ana]->ROI[i]->deltax, GENERAL[_ana]->ROI[i]->deltay, GENERAL[_ana]->ROI[i]->image_org);
-            if (SaveAllFiles && JOMJOL_ENABLE_IMAGE_PERSISTENCE) {
-                if (GENERAL[_ana]->name == "default") {
-                    GENERAL[_ana]->ROI[i]->image_org->SaveToFile(FormatFileName("/spiffs/img_tmp/" + GENERAL[_ana]->ROI[i]->name + ".jpg"));
-                }
-                else {
-                    GENERAL[_ana]->ROI[i]->image_org->SaveToFile(FormatFileName("/spiffs/img_tmp/" + GENERAL[_ana]->name + "_" + GENERAL[_ana]->ROI[i]->name + ".jpg"));
-                }
-            } 
+            rois.push_back(GENERAL[_ana]->ROI[i]);
+        }
+    }
 
-            GENERAL[_ana]->ROI[i]->image_org->Resize(modelxsize, modelysize, GENERAL[_ana]->ROI[i]->image);
-            if (SaveAllFiles && JOMJOL_ENABLE_IMAGE_PERSISTENCE) {
-                if (GENERAL[_ana]->name == "default") {
-                    GENERAL[_ana]->ROI[i]->image->SaveToFile(FormatFileName("/spiffs/img_tmp/" + GENERAL[_ana]->ROI[i]->name + ".jpg"));
-                }
-                else {
-                    GENERAL[_ana]->ROI[i]->image->SaveToFile(FormatFileName("/spiffs/img_tmp/" + GENERAL[_ana]->name + "_" + GENERAL[_ana]->ROI[i]->name + ".jpg"));
-                }
-            } 
+    // Every ROI only reads the aligned image and writes its own images, so they can be cut on both cores
+    roi_workers::run(rois.size(), [&](int _index, int _worker) {
+        roi *r = rois[_index];
+        caic->CutAndSave(r->posx, r->posy, r->deltax, r->deltay, r->image_org);
+        r->image_org->Resize(modelxsize, modelysize, r->image);
+    });
+
+    if (!SaveAllFiles || !JOMJOL_ENABLE_IMAGE_PERSISTENCE) {
+        return true;
+    }
+
+    for (int _ana = 0; _ana < GENERAL.size(); ++_ana) {
+        for (int i = 0; i < GENERAL[_ana]->ROI.size(); ++i) {
+            ESP_LOGD(TAG, "General %d - Save", i);
+            
+            if (GENERAL[_ana]->name == "default") {
+                GENERAL[_ana]->ROI[i]->image_org->SaveToFile(FormatFileName("/spiffs/img_tmp/" + GENERAL[_ana]->ROI[i]->name + ".jpg"));
+                GENERAL[_ana]->ROI[i]->image->SaveToFile(FormatFileName("/spiffs/img_tmp/" + GENERAL[_ana]->ROI[i]->name + ".jpg"));
+            }
+            else {
+                GENERAL[_ana]->ROI[i]->image_org->SaveToFile(FormatFileName("/spiffs/img_tmp/" + GENERAL[_ana]->name + "_" + GENERAL[_ana]->ROI[i]->name + ".jpg"));
+                GENERAL[_ana]->ROI[i]->image->SaveToFile(FormatFileName("/spiffs/img_tmp/" + GENERAL[_ana]->name + "_" + GENERAL[_ana]->ROI[i]->name + ".jpg"));
+            }
         }
     }
 
@@ -625,20 +640,13 @@ bool ClassFlowCNNGeneral::getNetworkParameter() {
     zwcnn = FormatFileName(zwcnn);
     ESP_LOGD(TAG, "%s", zwcnn.c_str());
     
-    if (!tflite->LoadModel(zwcnn)) {
+    if (!tflite->LoadModelCached(zwcnn)) {
         LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Can't load tflite model " + cnnmodelfile + " -> Init aborted!");
         LogFile.WriteHeapInfo("getNetworkParameter-LoadModel");
         delete tflite;
         return false;
     } 
 
-    if (!tflite->MakeAllocate()) {
-        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Can't allocate tflite model -> Init aborted!");
-        LogFile.WriteHeapInfo("getNetworkParameter-MakeAllocate");
-        delete tflite;
-        return false;
-    }
-
     if (CNNType == AutoDetect) {
         tflite->GetInputDimension(false);
         modelxsize = tflite->ReadInputDimenstion(0);
@@ -699,41 +707,65 @@ bool ClassFlowCNNGeneral::doNeuralNetwork(string time) {
     zwcnn = FormatFileName(zwcnn);
     ESP_LOGD(TAG, "%s", zwcnn.c_str());
 
-    if (!tflite->LoadModel(zwcnn)) {
+    // Model and interpreter stay resident between rounds if there is enough PSRAM (see CTfLiteClass::LoadModelCached)
+    if (!tflite->LoadModelCached(zwcnn)) {
         LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Can't load tflite model " + cnnmodelfile + " -> Exec aborted this round!");
         LogFile.WriteHeapInfo("doNeuralNetwork-LoadModel");
         delete tflite;
         return false;
     }
 
-    if (!tflite->MakeAllocate()) {
-        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Can't allocate tfilte model -> Exec aborted this round!");
-        LogFile.WriteHeapInfo("doNeuralNetwork-MakeAllocate");
+    // Run all ROIs of all NUMBERS through the model in one go (on both cores if possible), the results are evaluated afterwards
+    std::vector<CImageBasis*> roiimages;
+    std::vector<std::vector<float>> roioutputs;
+
+    for (int n = 0; n < GENERAL.size(); ++n) {
+        for (int roi = 0; roi < GENERAL[n]->ROI.size(); ++roi) {
+            roiimages.push_back(GENERAL[n]->ROI[roi]->image);
+        }
+    }
+
+    int64_t inference_start = esp_timer_get_time();
+
+    if (!tflite->InvokeBatch(roiimages, roioutputs, true)) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Inference of the ROIs failed -> Exec aborted this round!");
         delete tflite;
         return false;
     }
 
+    int64_t inference_duration = esp_timer_get_time() - inference_start;
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Inference of %d ROIs took %ld ms", (int)roiimages.size(), (long)(inference_duration / 1000));
+
+#ifdef DEBUG_ENABLE_TFLITE_BENCHMARK
+    // Compare with the per-ROI path (resolve input tensor, fill, invoke for every single ROI)
+    int64_t single_start = esp_timer_get_time();
+    for (int i = 0; i < roiimages.size(); ++i) {
+        tflite->LoadInputImageBasis(roiimages[i]);
+        tflite->Invoke();
+    }
+    int64_t single_duration = esp_timer_get_time() - single_start;
+    LogFile.WriteToFile(ESP_LOG_INFO, TAG, "TFLite benchmark: " + std::to_string(roiimages.size()) + " ROIs, batched: " + 
+                                           std::to_string((long)inference_duration) + " us, per ROI: " + std::to_string((long)single_duration) + " us");
+#endif
+
+    int roiindex = 0;
+
     // For each NUMBER
     for (int n = 0; n < GENERAL.size(); ++n) {
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Processing Number '" + GENERAL[n]->name + "'");
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Processing Number '%s'", GENERAL[n]->name.c_str());
         // For each ROI
-        for (int roi = 0; roi < GENERAL[n]->ROI.size(); ++roi) {
-            LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "ROI #" + std::to_string(roi) + " - TfLite");
+        for (int roi = 0; roi < GENERAL[n]->ROI.size(); ++roi, ++roiindex) {
+            LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "ROI #%d - TfLite", roi);
             //ESP_LOGD(TAG, "General %d - TfLite", i);
+            const std::vector<float> &output = roioutputs[roiindex];
 
             switch (CNNType) {
                 case Analogue:
-                    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "CNN Type: Analogue");
+                    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "CNN Type: Analogue");
                     {
                         float f1, f2;
-                        f1 = 0; f2 = 0;
-
-                        tflite->LoadInputImageBasis(GENERAL[n]->ROI[roi]->image);        
-                        tflite->Invoke();
-                        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "After Invoke");
-
-                        f1 = tflite->GetOutputValue(0);
-                        f2 = tflite->GetOutputValue(1);
+                        f1 = output[0];
+                        f2 = output[1];
                         float result = fmod(atan2(f1, f2) / (M_PI * 2) + 2, 1);
                               
                         if(GENERAL[n]->ROI[roi]->CCW) {
@@ -750,10 +782,10 @@ bool ClassFlowCNNGeneral::doNeuralNetwork(string time) {
                     } break;
 
                 case Digit:
-                    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "CNN Type: Digit");
+                    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "CNN Type: Digit");
                     {
                         GENERAL[n]->ROI[roi]->result_klasse = 0;
-                        GENERAL[n]->ROI[roi]->result_klasse = tflite->GetClassFromImageBasis(GENERAL[n]->ROI[roi]->image);
+                        GENERAL[n]->ROI[roi]->result_klasse = CTfLiteClass::GetClassification(output);
                         ESP_LOGD(TAG, "General result (Digit)%i: %d", roi, GENERAL[n]->ROI[roi]->result_klasse);
 
                         if (isLogImage) {
@@ -771,23 +803,19 @@ bool ClassFlowCNNGeneral::doNeuralNetwork(string time) {
 
                 case DoubleHyprid10:
                     {
-                    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "CNN Type: DoubleHyprid10");
+                    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "CNN Type: DoubleHyprid10");
                         int _num, _numplus, _numminus;
                         float _val, _valplus, _valminus;
                         float _fit;
                         float _result_save_file;
 
-                        tflite->LoadInputImageBasis(GENERAL[n]->ROI[roi]->image);        
-                        tflite->Invoke();
-                        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "After Invoke");
-
-                        _num = tflite->GetOutClassification(0, 9);
+                        _num = CTfLiteClass::GetClassification(output, 0, 9);
                         _numplus = (_num + 1) % 10;
                         _numminus = (_num - 1 + 10) % 10;
 
-                        _val = tflite->GetOutputValue(_num);
-                        _valplus = tflite->GetOutputValue(_numplus);
-                        _valminus = tflite->GetOutputValue(_numminus);
+                        _val = output[_num];
+                        _valplus = output[_numplus];
+                        _valminus = output[_numminus];
 
                         float result = _num;
 
@@ -808,10 +836,8 @@ bool ClassFlowCNNGeneral::doNeuralNetwork(string time) {
                             result = result + 10;
                         }
 
-                        string zw = "_num (p, m): " + to_string(_num) + " " + to_string(_numplus) + " " + to_string(_numminus);
-                        zw = zw + " _val (p, m): " + to_string(_val) + " " + to_string(_valplus) + " " + to_string(_valminus);
-                        zw = zw + " result: " + to_string(result) + " _fit: " + to_string(_fit);
-                        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, zw);
+                        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "_num (p, m): %d %d %d _val (p, m): %f %f %f result: %f _fit: %f",
+                                      _num, _numplus, _numminus, _val, _valplus, _valminus, result, _fit);
 
                         _result_save_file = result;
 
@@ -844,14 +870,11 @@ bool ClassFlowCNNGeneral::doNeuralNetwork(string time) {
                 case Digit100:
                 case Analogue100:
                     {
-                    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "CNN Type: Digit100 or Analogue100");
+                    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "CNN Type: Digit100 or Analogue100");
                         int _num;
                         float _result_save_file;
                         
-                        tflite->LoadInputImageBasis(GENERAL[n]->ROI[roi]->image);        
-                        tflite->Invoke();
-    
-                        _num = tflite->GetOutClassification();
+                        _num = CTfLiteClass::GetClassification(output);
                         
                         if(GENERAL[n]->ROI[roi]->CCW) {
                             GENERAL[n]->ROI[roi]->result_float = 10 - ((float)_num / 10.0);
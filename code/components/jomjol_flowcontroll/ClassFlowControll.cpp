@@ -4,6 +4,8 @@
 #include "read_wlanini.h"
 
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
 
 #include <sys/stat.h>
 
@@ -26,6 +28,10 @@ extern "C" {
 
 #include "server_help.h"
 #include "MainFlowControl.h"
+#include "flow_stats.h"
+#include "image_cache.h"
+#include "result_snapshot.h"
+#include "psram.h"
 #include "basic_auth.h"
 #include "../../include/defines.h"
 
@@ -33,6 +39,41 @@ static const char* TAG = "FLOWCTRL";
 
 //#define DEBUG_DETAIL_ON
 
+/* Results of a round for the publisher steps, see ClassFlowControll::PublishRound() */
+struct PublishJob {
+    result_snapshot::SnapshotRef snapshot;
+    std::vector<std::pair<ClassFlow*, image_cache::JpegRef>> steps;     // Publisher step + the image it wants
+};
+
+static QueueHandle_t publishQueue = NULL;
+
+
+static void publishJob(PublishJob *_job)
+{
+    int64_t start = esp_timer_get_time();
+
+    for (int i = 0; i < _job->steps.size(); ++i) {
+        _job->steps[i].first->doPublish(_job->snapshot, _job->steps[i].second);
+    }
+
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Round %lu published in %lld ms", _job->snapshot ? (unsigned long)_job->snapshot->round : 0UL,
+                  (esp_timer_get_time() - start) / 1000);
+    delete _job;
+}
+
+
+static void task_FlowPublish(void *pvParameter)
+{
+    PublishJob *job;
+
+    while (true) {
+        if (xQueueReceive(publishQueue, &job, portMAX_DELAY) == pdTRUE) {
+            publishJob(job);
+        }
+    }
+}
+
+
 std::string ClassFlowControll::doSingleStep(std::string _stepname, std::string _host)
 {
     std::string _classname = "";
@@ -88,6 +129,8 @@ std::string ClassFlowControll::doSingleStep(std::string _stepname, std::string _
         }
     }
 
+    image_cache::invalidate(getCountFlowRounds());      // The step updated the images
+
     ESP_LOGD(TAG, "Step %s end", _stepname.c_str());
 
     return result;
@@ -209,6 +252,7 @@ void ClassFlowControll::SetInitialParameter(void)
     AutoStart = true;
     SetupModeActive = false;
     AutoInterval = 10; // Minutes
+    PipelinedFlow = false;
     flowdigit = NULL;
     flowanalog = NULL;
     flowpostprocessing = NULL;
@@ -407,7 +451,22 @@ bool ClassFlowControll::doFlow(string time)
 
     //checkNtpStatus(0);
 
+    flow_stats::round_start(getCountFlowRounds());
+    bool imagesComplete = false;
+
     for (int i = 0; i < FlowControll.size(); ++i) {
+        if (FlowControll[i]->isPublisher()) {
+            if (!imagesComplete) {
+                // Post-processing is done, the images of this round don't change anymore
+                image_cache::invalidate(getCountFlowRounds());
+                imagesComplete = true;
+            }
+
+            if (PipelinedFlow) {
+                continue;   // See PublishRound()
+            }
+        }
+
         zw_time = getCurrentTimeString("%H:%M:%S");
         aktstatus = TranslateAktstatus(FlowControll[i]->name());
         aktstatusWithTime = aktstatus + " (" + zw_time + ")";
@@ -421,7 +480,18 @@ bool ClassFlowControll::doFlow(string time)
             LogFile.WriteHeapInfo(zw);
         #endif
 
-        if (!FlowControll[i]->doFlow(time)) {
+        flow_stats::step_start(StepName(FlowControll[i]));
+        bool stepresult;
+        if (FlowControll[i]->isPublisher()) {
+            result_snapshot::SnapshotRef snapshot = result_snapshot::get();
+            stepresult = FlowControll[i]->doPublish(snapshot, GetPublishImage(FlowControll[i], snapshot));
+        }
+        else {
+            stepresult = FlowControll[i]->doFlow(time);
+        }
+        flow_stats::step_end(stepresult);
+
+        if (!stepresult) {
             repeat++;
             LogFile.WriteToFile(ESP_LOG_WARN, TAG, "Fehler im vorheriger Schritt - wird zum " + to_string(repeat) + ". Mal wiederholt");
             if (i) { i -= 1; }   // vPrevious step must be repeated (probably take pictures)
@@ -441,6 +511,16 @@ bool ClassFlowControll::doFlow(string time)
         #endif
     }
 
+    flow_stats::round_end();
+
+    if (!imagesComplete) {
+        image_cache::invalidate(getCountFlowRounds());
+    }
+
+    if (PipelinedFlow) {
+        PublishRound();
+    }
+
     zw_time = getCurrentTimeString("%H:%M:%S");
     aktstatus = "Flow finished";
     aktstatusWithTime = aktstatus + " (" + zw_time + ")";
@@ -456,21 +536,26 @@ bool ClassFlowControll::doFlow(string time)
 string ClassFlowControll::getReadoutAll(int _type)
 {
     std::string out = "";
-	
-    if (flowpostprocessing) {
-        std::vector<NumberPost*> *numbers = flowpostprocessing->GetNumbers();
+    result_snapshot::SnapshotRef snapshot = result_snapshot::get();
+
+    if (!snapshot && flowpostprocessing) {
+        snapshot = flowpostprocessing->MakeSnapshot();     // No round completed yet
+    }
 
-        for (int i = 0; i < (*numbers).size(); ++i) {
-            out = out + (*numbers)[i]->name + "\t";
+    if (snapshot) {
+        const std::vector<result_snapshot::Number> &numbers = snapshot->numbers;
+
+        for (int i = 0; i < numbers.size(); ++i) {
+            out = out + numbers[i].name + "\t";
 		
             switch (_type) {
                 case READOUT_TYPE_VALUE:
-                    out = out + (*numbers)[i]->ReturnValue;
+                    out = out + numbers[i].value;
                     break;
                 case READOUT_TYPE_PREVALUE:
-                    if (flowpostprocessing->PreValueUse) {
-                        if ((*numbers)[i]->PreValueOkay) {
-                            out = out + (*numbers)[i]->ReturnPreValue;
+                    if (snapshot->pre_value_use) {
+                        if (numbers[i].pre_okay) {
+                            out = out + numbers[i].pre;
                         }
                         else {
                             out = out + "PreValue too old"; 
@@ -481,14 +566,14 @@ string ClassFlowControll::getReadoutAll(int _type)
                     }
                     break;
                 case READOUT_TYPE_RAWVALUE:
-                    out = out + (*numbers)[i]->ReturnRawValue;
+                    out = out + numbers[i].raw;
                     break;
                 case READOUT_TYPE_ERROR:
-                    out = out + (*numbers)[i]->ErrorMessageText;
+                    out = out + numbers[i].error;
                     break;
             }
 		
-            if (i < (*numbers).size()-1) {
+            if (i < numbers.size()-1) {
                 out = out + "\r\n";
             }
         }
@@ -500,8 +585,14 @@ string ClassFlowControll::getReadoutAll(int _type)
 
 string ClassFlowControll::getReadout(bool _rawvalue = false, bool _noerror = false, int _number = 0)
 {
-    if (flowpostprocessing) {
-        return flowpostprocessing->getReadoutParam(_rawvalue, _noerror, _number);
+    result_snapshot::SnapshotRef snapshot = result_snapshot::get();
+
+    if (snapshot && (_number < snapshot->numbers.size())) {
+        return _rawvalue ? snapshot->numbers[_number].raw : snapshot->numbers[_number].value;
+    }
+
+    if (!snapshot && flowpostprocessing) {
+        return flowpostprocessing->getReadoutParam(_rawvalue, _noerror, _number);     // No round completed yet
     }
 
     return std::string("");
@@ -575,6 +666,10 @@ bool ClassFlowControll::ReadParameter(FILE* pfile, string& aktparamgraph)
             }
         }
 
+        if ((toUpper(splitted[0]) == "PIPELINEDFLOW") && (splitted.size() > 1)) {
+            PipelinedFlow = alphanumericToBoolean(splitted[1]);
+        }
+
         if ((toUpper(splitted[0]) == "DATALOGACTIVE") && (splitted.size() > 1)) {
             LogFile.SetDataLogToSD(alphanumericToBoolean(splitted[1]));
         }
@@ -689,6 +784,118 @@ esp_err_t ClassFlowControll::SendRawJPG(httpd_req_t *req)
     return flowtakeimage != NULL ? flowtakeimage->SendRawJPG(req) : ESP_FAIL;
 }
 
+/* Name of the step in flow_stats, the digit and the analog step are both ClassFlowCNNGeneral */
+std::string ClassFlowControll::StepName(ClassFlow *_step)
+{
+    if (_step == flowdigit) {
+        return _step->name() + ":Digits";
+    }
+    if (_step == flowanalog) {
+        return _step->name() + ":Analog";
+    }
+
+    return _step->name();
+}
+
+
+/* Encoder for alg_roi.jpg (see image_cache::get()), empty if there is no image yet */
+image_cache::Encoder ClassFlowControll::GetAlgROIEncoder()
+{
+    #ifdef ALGROI_LOAD_FROM_MEM_AS_JPG      // no CImageBasis needed to create alg_roi.jpg (ca. 790kB less RAM)
+        if (flowalignment && flowalignment->AlgROI && (flowalignment->AlgROI->size > 0)) {
+            return [this](size_t *_size) {
+                size_t size = flowalignment->AlgROI->size;
+                uint8_t *data = (uint8_t *)malloc_psram_heap(std::string(TAG) + "->alg_roi.jpg", size, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+                if (data) {
+                    memcpy(data, flowalignment->AlgROI->data, size);
+                    *_size = size;
+                }
+                return data;
+            };
+        }
+
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "ClassFlowControll::GetAlgROIEncoder: alg_roi.jpg not available -> alg.jpg is going to be used!");
+        if (flowalignment && flowalignment->ImageBasis->ImageOkay()) {
+            return [this](size_t *_size) { return flowalignment->ImageBasis->EncodeJPG(_size); };
+        }
+
+        return NULL;
+    #else
+        if (!flowalignment) {
+            ESP_LOGD(TAG, "ClassFlowControll::GetAlgROIEncoder: FlowAlignment is not (yet) initialized");
+            return NULL;
+        }
+
+        return [this](size_t *_size) {
+            CImageBasis *_roi = new CImageBasis("alg_roi", flowalignment->ImageBasis);
+            uint8_t *data;
+
+            if (_roi->ImageOkay()) {
+                flowalignment->DrawRef(_roi);
+                if (flowdigit) { flowdigit->DrawROI(_roi); }
+                if (flowanalog) { flowanalog->DrawROI(_roi); }
+                data = _roi->EncodeJPG(_size);
+            }
+            else {
+                LogFile.WriteToFile(ESP_LOG_WARN, TAG, "ClassFlowControll::GetAlgROIEncoder: Not enough memory to create alg_roi.jpg -> alg.jpg is going to be used!");
+                data = flowalignment->ImageBasis->ImageOkay() ? flowalignment->ImageBasis->EncodeJPG(_size) : NULL;
+            }
+
+            delete _roi;
+            return data;
+        };
+    #endif
+}
+
+
+/* alg_roi.jpg of the current round if the publisher step wants to send it. Taken from the image cache, so it stays
+ * valid while the next round is already running. */
+image_cache::JpegRef ClassFlowControll::GetPublishImage(ClassFlow *_step, const result_snapshot::SnapshotRef &_snapshot)
+{
+    if (!_snapshot || !_step->wantsImage(*_snapshot)) {
+        return NULL;
+    }
+
+    image_cache::Encoder encode = GetAlgROIEncoder();
+    return encode ? image_cache::get("alg_roi.jpg", encode) : NULL;
+}
+
+
+/* Pipelined flow: hands the results of the round over to task_FlowPublish(), so the next round can start while
+ * they get sent. Blocks as long as the previous round is still queued, the publishers never fall behind more than
+ * one round and keep the order. */
+void ClassFlowControll::PublishRound()
+{
+    PublishJob *job = new PublishJob;
+    job->snapshot = result_snapshot::get();
+
+    for (int i = 0; i < FlowControll.size(); ++i) {
+        if (FlowControll[i]->isPublisher()) {
+            job->steps.push_back(std::make_pair(FlowControll[i], GetPublishImage(FlowControll[i], job->snapshot)));
+        }
+    }
+
+    if (publishQueue == NULL) {
+        publishQueue = xQueueCreate(1, sizeof(PublishJob*));
+
+        if ((publishQueue == NULL) ||
+            (xTaskCreatePinnedToCore(&task_FlowPublish, "task_FlowPublish", FLOW_PUBLISH_TASK_STACK_SIZE, NULL,
+                                     uxTaskPriorityGet(NULL), NULL, FLOW_PUBLISH_TASK_CORE) != pdPASS)) {
+            LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to create task_FlowPublish, publishing on the flow task");
+            if (publishQueue) {
+                vQueueDelete(publishQueue);
+                publishQueue = NULL;
+            }
+            PipelinedFlow = false;
+            publishJob(job);
+            return;
+        }
+    }
+
+    xQueueSend(publishQueue, &job, portMAX_DELAY);
+}
+
+
 esp_err_t ClassFlowControll::GetJPGStream(std::string _fn, httpd_req_t *req)
 {
     ESP_LOGD(TAG, "ClassFlowControll::GetJPGStream %s", _fn.c_str());
@@ -697,13 +904,12 @@ esp_err_t ClassFlowControll::GetJPGStream(std::string _fn, httpd_req_t *req)
         LogFile.WriteHeapInfo("ClassFlowControll::GetJPGStream - Start");
     #endif
 
-    CImageBasis *_send = NULL;
-    esp_err_t result = ESP_FAIL;
-    bool _sendDelete = false;
+    // Only gets called if the image is not in the cache yet (once per round)
+    image_cache::Encoder encode;
 
     if (_fn == "alg.jpg") {
         if (flowalignment && flowalignment->ImageBasis->ImageOkay()) {
-            _send = flowalignment->ImageBasis;
+            encode = [this](size_t *_size) { return flowalignment->ImageBasis->EncodeJPG(_size); };
         }
         else {
             LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "ClassFlowControll::GetJPGStream: alg.jpg cannot be served");
@@ -711,50 +917,14 @@ esp_err_t ClassFlowControll::GetJPGStream(std::string _fn, httpd_req_t *req)
         }
     }
     else if (_fn == "alg_roi.jpg") {
-        #ifdef ALGROI_LOAD_FROM_MEM_AS_JPG      // no CImageBasis needed to create alg_roi.jpg (ca. 790kB less RAM)
-            if (flowalignment && flowalignment->AlgROI) {
-                httpd_resp_set_type(req, "image/jpeg");
-                result = httpd_resp_send(req, (const char *)flowalignment->AlgROI->data, flowalignment->AlgROI->size);
-            }
-            else {
-                LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "ClassFlowControll::GetJPGStream: alg_roi.jpg cannot be served -> alg.jpg is going to be served!");
-                if (flowalignment && flowalignment->ImageBasis->ImageOkay()) {
-                    _send = flowalignment->ImageBasis;
-                }
-                else {
-                    httpd_resp_send(req, NULL, 0);
-                    return ESP_OK;
-                }
-            }
-        #else
-            if (!flowalignment) {
-                ESP_LOGD(TAG, "ClassFloDControll::GetJPGStream: FlowAlignment is not (yet) initialized. Interrupt serving!");
-                httpd_resp_send(req, NULL, 0);
-                return ESP_FAIL;
-            }
-
-            _send = new CImageBasis("alg_roi", flowalignment->ImageBasis);
-			
-            if (_send->ImageOkay()) {
-                if (flowalignment) { flowalignment->DrawRef(_send); }
-                if (flowdigit) { flowdigit->DrawROI(_send); }
-                if (flowanalog) { flowanalog->DrawROI(_send); }
-                _sendDelete = true; // delete temporary _send element after sending
-            }
-            else {
-                LogFile.WriteToFile(ESP_LOG_WARN, TAG, "ClassFlowControll::GetJPGStream: Not enough memory to create alg_roi.jpg -> alg.jpg is going to be served!");
-                
-                if (flowalignment && flowalignment->ImageBasis->ImageOkay()) {
-                    _send = flowalignment->ImageBasis;
-                }
-                else {
-                    httpd_resp_send(req, NULL, 0);
-                    return ESP_OK;
-                }
-            }
-        #endif
+        encode = GetAlgROIEncoder();
+        if (!encode) {
+            httpd_resp_send(req, NULL, 0);
+            return ESP_OK;
+        }
     }
     else {
+        CImageBasis *_send = NULL;
         std::vector<HTMLInfo*> htmlinfo;
     
         htmlinfo = GetAllDigit();
@@ -796,28 +966,27 @@ esp_err_t ClassFlowControll::GetJPGStream(std::string _fn, httpd_req_t *req)
             }
             htmlinfo.clear();
         }
+
+        if (!_send) {
+            return ESP_FAIL;
+        }
+
+        encode = [_send](size_t *_size) { return _send->EncodeJPG(_size); };
     }
 
     #ifdef DEBUG_DETAIL_ON 
         LogFile.WriteHeapInfo("ClassFlowControll::GetJPGStream - before send");
     #endif
 
-    if (_send) {
-        ESP_LOGD(TAG, "Sending file: %s ...", _fn.c_str());
-        set_content_type_from_file(req, _fn.c_str());
-        result = _send->SendJPGtoHTTP(req);
-	
-        /* Respond with an empty chunk to signal HTTP response completion */
-        httpd_resp_send_chunk(req, NULL, 0);
-        ESP_LOGD(TAG, "File sending complete");
-
-        if (_sendDelete) {
-            delete _send;
-        }
-            
-        _send = NULL;  
+    image_cache::JpegRef jpeg = image_cache::get(_fn, encode);
+    if (!jpeg) {
+        return ESP_FAIL;
     }
 
+    ESP_LOGD(TAG, "Sending file: %s ...", _fn.c_str());
+    esp_err_t result = image_cache::send(req, jpeg);
+    ESP_LOGD(TAG, "File sending complete");
+
     #ifdef DEBUG_DETAIL_ON 
         LogFile.WriteHeapInfo("ClassFlowControll::GetJPGStream - done");
     #endif
@@ -832,7 +1001,12 @@ string ClassFlowControll::getNumbersName()
 
 string ClassFlowControll::getJSON()
 {
-    return flowpostprocessing->GetJSON();
+    result_snapshot::SnapshotRef snapshot = result_snapshot::get();
+    if (snapshot) {
+        return snapshot->json;
+    }
+
+    return flowpostprocessing->GetJSON();     // No round completed yet
 }
 
 /** 
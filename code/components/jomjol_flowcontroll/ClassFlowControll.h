@@ -37,11 +37,17 @@ protected:
 
 	bool AutoStart;
 	float AutoInterval;
+	bool PipelinedFlow;				// Publisher steps run on task_FlowPublish, see PublishRound()
 	void SetInitialParameter(void);	
 	std::string aktstatusWithTime;
 	std::string aktstatus;
 	int aktRunNr;
 
+	std::string StepName(ClassFlow *_step);
+	image_cache::Encoder GetAlgROIEncoder();
+	image_cache::JpegRef GetPublishImage(ClassFlow *_step, const result_snapshot::SnapshotRef &_snapshot);
+	void PublishRound();
+
 public:
 	bool SetupModeActive;
 
@@ -130,7 +130,7 @@ bool ClassFlowInfluxDB::ReadParameter(FILE* pfile, string& aktparamgraph)
     return true;
 }
 
-bool ClassFlowInfluxDB::doFlow(string zwtime)
+bool ClassFlowInfluxDB::doPublish(const result_snapshot::SnapshotRef &_snapshot, const image_cache::JpegRef &_image)
 {
     if (!InfluxDBenable)
         return true;
@@ -145,19 +145,21 @@ bool ClassFlowInfluxDB::doFlow(string zwtime)
     string zw = "";
     string namenumber = "";
 
-    if (flowpostprocessing)
+    if (flowpostprocessing && _snapshot)
     {
+        // Measurement and field names are settings, the values are taken from the snapshot of the round
         std::vector<NumberPost*>* NUMBERS = flowpostprocessing->GetNumbers();
+        const std::vector<result_snapshot::Number> &numbers = _snapshot->numbers;
 
-        for (int i = 0; i < (*NUMBERS).size(); ++i)
+        for (int i = 0; (i < numbers.size()) && (i < (*NUMBERS).size()); ++i)
         {
             measurement = (*NUMBERS)[i]->MeasurementV1;
-            result =  (*NUMBERS)[i]->ReturnValue;
-            resultraw =  (*NUMBERS)[i]->ReturnRawValue;
-            resulterror = (*NUMBERS)[i]->ErrorMessageText;
-            resultrate = (*NUMBERS)[i]->ReturnRateValue;
-            resulttimestamp = (*NUMBERS)[i]->timeStamp;
-            timeutc = (*NUMBERS)[i]->timeStampTimeUTC;
+            result =  numbers[i].value;
+            resultraw =  numbers[i].raw;
+            resulterror = numbers[i].error;
+            resultrate = numbers[i].rate;
+            resulttimestamp = numbers[i].timestamp;
+            timeutc = numbers[i].time_utc;
 
             if ((*NUMBERS)[i]->FieldV1.length() > 0)
             {
@@ -165,7 +167,7 @@ bool ClassFlowInfluxDB::doFlow(string zwtime)
             }
             else
             {
-                namenumber = (*NUMBERS)[i]->name;
+                namenumber = numbers[i].name;
                 if (namenumber == "default")
                     namenumber = "value";
                 else
@@ -175,11 +177,14 @@ bool ClassFlowInfluxDB::doFlow(string zwtime)
             if (result.length() > 0)   
 //////////////////////// NEW //////////////////////////            
 //                InfluxDBPublish(measurement, namenumber, result, timeutc);
-                influxDB.InfluxDBPublish(measurement, namenumber, result, timeutc);
+                influxDB.InfluxDBAddPoint(measurement, namenumber, result, timeutc);
 //////////////////////// NEW //////////////////////////
 
 
         }
+
+        // all points of the round in one request
+        influxDB.InfluxDBEndRound();
     }
    
     OldValue = result;
@@ -39,7 +39,8 @@ public:
 //    string GetInfluxDBMeasurement();
 
     bool ReadParameter(FILE* pfile, string& aktparamgraph);
-    bool doFlow(string time);
+    bool isPublisher(){return true;};
+    bool doPublish(const result_snapshot::SnapshotRef &_snapshot, const image_cache::JpegRef &_image);
     string name(){return "ClassFlowInfluxDB";};
 };
 
@@ -191,7 +191,7 @@ void ClassFlowInfluxDBv2::handleMeasurement(string _decsep, string _value)
 }
 
 
-bool ClassFlowInfluxDBv2::doFlow(string zwtime)
+bool ClassFlowInfluxDBv2::doPublish(const result_snapshot::SnapshotRef &_snapshot, const image_cache::JpegRef &_image)
 {
     if (!InfluxDBenable)
         return true;
@@ -207,19 +207,21 @@ bool ClassFlowInfluxDBv2::doFlow(string zwtime)
     string namenumber = "";
 
 
-    if (flowpostprocessing)
+    if (flowpostprocessing && _snapshot)
     {
+        // Measurement and field names are settings, the values are taken from the snapshot of the round
         std::vector<NumberPost*>* NUMBERS = flowpostprocessing->GetNumbers();
+        const std::vector<result_snapshot::Number> &numbers = _snapshot->numbers;
 
-        for (int i = 0; i < (*NUMBERS).size(); ++i)
+        for (int i = 0; (i < numbers.size()) && (i < (*NUMBERS).size()); ++i)
         {
             measurement = (*NUMBERS)[i]->MeasurementV2;
-            result =  (*NUMBERS)[i]->ReturnValue;
-            resultraw =  (*NUMBERS)[i]->ReturnRawValue;
-            resulterror = (*NUMBERS)[i]->ErrorMessageText;
-            resultrate = (*NUMBERS)[i]->ReturnRateValue;
-            resulttimestamp = (*NUMBERS)[i]->timeStamp;
-            resulttimeutc = (*NUMBERS)[i]->timeStampTimeUTC;
+            result =  numbers[i].value;
+            resultraw =  numbers[i].raw;
+            resulterror = numbers[i].error;
+            resultrate = numbers[i].rate;
+            resulttimestamp = numbers[i].timestamp;
+            resulttimeutc = numbers[i].time_utc;
 
 
             if ((*NUMBERS)[i]->FieldV2.length() > 0)
@@ -228,7 +230,7 @@ bool ClassFlowInfluxDBv2::doFlow(string zwtime)
             }
             else
             {
-                namenumber = (*NUMBERS)[i]->name;
+                namenumber = numbers[i].name;
                 if (namenumber == "default")
                     namenumber = "value";
                 else
@@ -238,9 +240,12 @@ bool ClassFlowInfluxDBv2::doFlow(string zwtime)
             printf("vor sende Influx_DB_V2 - namenumber. %s, result: %s, timestampt: %s", namenumber.c_str(), result.c_str(), resulttimestamp.c_str());
 
             if (result.length() > 0)   
-                influxdb.InfluxDBPublish(measurement, namenumber, result, resulttimeutc);
+                influxdb.InfluxDBAddPoint(measurement, namenumber, result, resulttimeutc);
 //                InfluxDB_V2_Publish(measurement, namenumber, result, resulttimeutc);
         }
+
+        // all points of the round in one request
+        influxdb.InfluxDBEndRound();
     }
    
     OldValue = result;
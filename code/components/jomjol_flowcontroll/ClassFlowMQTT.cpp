@@ -9,6 +9,7 @@
 
 #include "time_sntp.h"
 #include "interface_mqtt.h"
+#include "mqtt_backlog.h"
 #include "ClassFlowPostProcessing.h"
 #include "ClassFlowControll.h"
 
@@ -47,6 +48,7 @@ void ClassFlowMQTT::SetInitialParameter(void)
     user = "";
     password = ""; 
     SetRetainFlag = false;
+    publishCombined = false;
     previousElement = NULL;
     ListFlowControll = NULL; 
     disabled = false;
@@ -140,6 +142,11 @@ bool ClassFlowMQTT::ReadParameter(FILE* pfile, string& aktparamgraph)
             SetRetainFlag = alphanumericToBoolean(splitted[1]);
             setMqtt_Server_Retain(SetRetainFlag);
         }
+        if ((toUpper(_param) == "PUBLISHMODE") && (splitted.size() > 1))
+        {
+            publishCombined = (toUpper(splitted[1]) == "COMBINED");
+            mqttServer_setPublishCombined(publishCombined);
+        }
         if ((toUpper(_param) == "HOMEASSISTANTDISCOVERY") && (splitted.size() > 1))
         {
             if (toUpper(splitted[1]) == "TRUE")
@@ -251,7 +258,46 @@ bool ClassFlowMQTT::Start(float AutoInterval)
 }
 
 
-bool ClassFlowMQTT::doFlow(string zwtime)
+/* Rate in the unit selected by the meter type */
+static std::string getRatePerTimeUnit(const result_snapshot::Number &_number)
+{
+    if (getTimeUnit() == "h") { // Need conversion to be per hour
+        return to_string(_number.flow_rate_act * 60); // per minutes => per hour
+    }
+
+    return _number.rate; // Keep per minute
+}
+
+
+/* All numbers in one compact JSON message, keyed by the number name:
+ * {"main":{"value":"..","raw":"..","pre":"..","error":"..","rate":"..","rate_per_time_unit":"..","rate_per_digitization_round":"..","timestamp":".."}} */
+std::string ClassFlowMQTT::getCombinedPayload(const result_snapshot::Snapshot &_snapshot)
+{
+    std::string json = "{";
+
+    for (int i = 0; i < _snapshot.numbers.size(); ++i) {
+        const result_snapshot::Number &number = _snapshot.numbers[i];
+
+        if (i > 0) {
+            json += ",";
+        }
+
+        json += "\"" + number.name + "\":{" +
+                "\"value\":\"" + number.value + "\"," +
+                "\"raw\":\"" + number.raw + "\"," +
+                "\"pre\":\"" + number.pre + "\"," +
+                "\"error\":\"" + number.error + "\"," +
+                "\"rate\":\"" + number.rate + "\"," +
+                "\"rate_per_time_unit\":\"" + ((number.rate.length() > 0) ? getRatePerTimeUnit(number) : "") + "\"," +
+                "\"rate_per_digitization_round\":\"" + number.change_absolute + "\"," +
+                "\"timestamp\":\"" + number.timestamp + "\"}";
+    }
+
+    return json + "}";
+}
+
+
+bool ClassFlowMQTT::doPublish(const result_snapshot::SnapshotRef &_snapshot, const image_cache::JpegRef &_image)
 {
     bool success;
     std::string result;
@@ -259,7 +305,6 @@ bool ClassFlowMQTT::doFlow(string zwtime)
     std::string resultraw = "";
     std::string resultpre = "";
     std::string resultrate = ""; // Always Unit / Minute
-    std::string resultRatePerTimeUnit = ""; // According to selection
     std::string resulttimestamp = "";
     std::string resultchangabs = "";
     string zw = "";
@@ -273,50 +318,61 @@ bool ClassFlowMQTT::doFlow(string zwtime)
 
     success = publishSystemData(qos);
 
-    if (flowpostprocessing && getMQTTisConnected())
+    if (_snapshot)
     {
-        std::vector<NumberPost*>* NUMBERS = flowpostprocessing->GetNumbers();
+        const std::vector<result_snapshot::Number> &numbers = _snapshot->numbers;
+        bool connected = getMQTTisConnected();
+
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, connected ? "Publishing MQTT topics..." : "Not connected, queuing the readings");
 
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Publishing MQTT topics...");
+        if (publishCombined) {
+            // One message per round, Homeassistant takes the fields out of it with value templates (see MQTThomeassistantDiscovery)
+            success |= mqtt_backlog::publish(maintopic + "/" + MQTT_COMBINED_TOPIC, getCombinedPayload(*_snapshot), qos, SetRetainFlag, time(NULL));
+        }
 
-        for (int i = 0; i < (*NUMBERS).size(); ++i)
+        for (int i = 0; i < numbers.size(); ++i)
         {
-            result =  (*NUMBERS)[i]->ReturnValue;
-            resultraw =  (*NUMBERS)[i]->ReturnRawValue;
-            resultpre =  (*NUMBERS)[i]->ReturnPreValue;
-            resulterror = (*NUMBERS)[i]->ErrorMessageText;
-            resultrate = (*NUMBERS)[i]->ReturnRateValue; // Unit per minutes
-            resultchangabs = (*NUMBERS)[i]->ReturnChangeAbsolute; // Units per round
-            resulttimestamp = (*NUMBERS)[i]->timeStamp;
-
-            DomoticzIdx = (*NUMBERS)[i]->DomoticzIdx;
+            result =  numbers[i].value;
+            resultraw =  numbers[i].raw;
+            resultpre =  numbers[i].pre;
+            resulterror = numbers[i].error;
+            resultrate = numbers[i].rate; // Unit per minutes
+            resultchangabs = numbers[i].change_absolute; // Units per round
+            resulttimestamp = numbers[i].timestamp;
+
+            DomoticzIdx = numbers[i].domoticz_idx;
             domoticzpayload = "{\"command\":\"udevice\",\"idx\":" + DomoticzIdx + ",\"svalue\":\""+ result + "\"}";
 
-            namenumber = (*NUMBERS)[i]->name;
+            namenumber = numbers[i].name;
             if (namenumber == "default")
                 namenumber = maintopic + "/";
             else
                 namenumber = maintopic + "/" + namenumber + "/";
 
-            if ((domoticzintopic.length() > 0) && (result.length() > 0)) 
+            if (connected && (domoticzintopic.length() > 0) && (result.length() > 0)) 
                 success |= MQTTPublish(domoticzintopic, domoticzpayload, qos, SetRetainFlag);
 
+            if (publishCombined)
+                continue;
+
+            // The readings (value + json) get queued if they can't be published and are sent after the reconnect,
+            // the other topics only show the current state
+            time_t readingTime = numbers[i].time_last_value;
+
             if (result.length() > 0)
-                success |= MQTTPublish(namenumber + "value", result, qos, SetRetainFlag);
+                success |= mqtt_backlog::publish(namenumber + "value", result, qos, SetRetainFlag, readingTime);
+
+            success |= mqtt_backlog::publish(namenumber + "json", numbers[i].json, qos, SetRetainFlag, readingTime);
+
+            if (!connected)
+                continue;
+
             if (resulterror.length() > 0)  
                 success |= MQTTPublish(namenumber + "error", resulterror, qos, SetRetainFlag);
 
             if (resultrate.length() > 0) {
                 success |= MQTTPublish(namenumber + "rate", resultrate, qos, SetRetainFlag);
-                
-                std::string resultRatePerTimeUnit;
-                if (getTimeUnit() == "h") { // Need conversion to be per hour
-                    resultRatePerTimeUnit = resultRatePerTimeUnit = to_string((*NUMBERS)[i]->FlowRateAct * 60); // per minutes => per hour
-                }
-                else { // Keep per minute
-                    resultRatePerTimeUnit = resultrate;
-                }
-                success |= MQTTPublish(namenumber + "rate_per_time_unit", resultRatePerTimeUnit, qos, SetRetainFlag);
+                success |= MQTTPublish(namenumber + "rate_per_time_unit", getRatePerTimeUnit(numbers[i]), qos, SetRetainFlag);
             }
 
             if (resultchangabs.length() > 0) {
@@ -329,9 +385,6 @@ bool ClassFlowMQTT::doFlow(string zwtime)
 
             if (resulttimestamp.length() > 0)
                 success |= MQTTPublish(namenumber + "timestamp", resulttimestamp, qos, SetRetainFlag);
-
-            std::string json = flowpostprocessing->getJsonFromNumber(i, "\n");
-            success |= MQTTPublish(namenumber + "json", json, qos, SetRetainFlag);
         }
     }
     
@@ -8,6 +8,7 @@
 #include "ClassFlow.h"
 
 #include "ClassFlowPostProcessing.h"
+#include "result_snapshot.h"
 
 #include <string>
 
@@ -22,11 +23,13 @@ protected:
     std::string caCertFilename, clientCertFilename, clientKeyFilename;
     bool validateServerCert;
     bool SetRetainFlag;
+    bool publishCombined;   // One message per round instead of a topic per field
     int keepAlive; // Seconds
     float roundInterval; // Minutes
     std::string maintopic, domoticzintopic; 
 	void SetInitialParameter(void);        
     void handleIdx(string _decsep, string _value);   
+    std::string getCombinedPayload(const result_snapshot::Snapshot &_snapshot);
 
 public:
     ClassFlowMQTT();
@@ -36,7 +39,8 @@ public:
     bool Start(float AutoInterval);
 
     bool ReadParameter(FILE* pfile, string& aktparamgraph);
-    bool doFlow(string time);
+    bool isPublisher(){return true;};
+    bool doPublish(const result_snapshot::SnapshotRef &_snapshot, const image_cache::JpegRef &_image);
     string name(){return "ClassFlowMQTT";};
 };
 #endif //CLASSFFLOWMQTT_H
@@ -8,6 +8,9 @@
 #include "time_sntp.h"
 
 #include "esp_log.h"
+#include "result_snapshot.h"
+#include "openmetrics.h"
+#include "MainFlowControl.h"
 #include "../../include/defines.h"
 
 static const char* TAG = "POSTPROC";
@@ -41,13 +44,25 @@ std::string ClassFlowPostProcessing::getNumbersName() {
 }
 
 std::string ClassFlowPostProcessing::GetJSON(std::string _lineend) {
-    std::string json="{" + _lineend;
+    std::vector<result_snapshot::Number> numbers;
+    numbers.reserve(NUMBERS.size());
 
     for (int i = 0; i < NUMBERS.size(); ++i) {
-        json += "\"" + NUMBERS[i]->name + "\":"  + _lineend;
-        json += getJsonFromNumber(i, _lineend) + _lineend;
+        numbers.push_back(SnapshotNumber(i));
+    }
+
+    return GetJSON(numbers, _lineend);
+}
+
+/* Also used to rebuild the JSON of a published snapshot (see PublishPreValue()) */
+std::string ClassFlowPostProcessing::GetJSON(const std::vector<result_snapshot::Number> &_numbers, std::string _lineend) {
+    std::string json="{" + _lineend;
+
+    for (int i = 0; i < _numbers.size(); ++i) {
+        json += "\"" + _numbers[i].name + "\":"  + _lineend;
+        json += getJsonFromNumber(_numbers[i], _lineend) + _lineend;
 
-        if ((i+1) < NUMBERS.size()) {
+        if ((i+1) < _numbers.size()) {
             json += "," + _lineend;
         }
     }
@@ -58,29 +73,33 @@ std::string ClassFlowPostProcessing::GetJSON(std::string _lineend) {
 }
 
 string ClassFlowPostProcessing::getJsonFromNumber(int i, std::string _lineend) {
+    return getJsonFromNumber(SnapshotNumber(i), _lineend);
+}
+
+std::string ClassFlowPostProcessing::getJsonFromNumber(const result_snapshot::Number &_number, std::string _lineend) {
     std::string json = "";
 
     json += "  {" + _lineend;
 
-    if (NUMBERS[i]->ReturnValue.length() > 0) {
-        json += "    \"value\": \"" + NUMBERS[i]->ReturnValue + "\"," + _lineend;
+    if (_number.value.length() > 0) {
+        json += "    \"value\": \"" + _number.value + "\"," + _lineend;
     }
     else {
         json += "    \"value\": \"\"," + _lineend;
     }
 
-    json += "    \"raw\": \"" + NUMBERS[i]->ReturnRawValue + "\"," + _lineend;
-    json += "    \"pre\": \"" + NUMBERS[i]->ReturnPreValue + "\"," + _lineend;
-    json += "    \"error\": \"" + NUMBERS[i]->ErrorMessageText + "\"," + _lineend;
+    json += "    \"raw\": \"" + _number.raw + "\"," + _lineend;
+    json += "    \"pre\": \"" + _number.pre + "\"," + _lineend;
+    json += "    \"error\": \"" + _number.error + "\"," + _lineend;
 
-    if (NUMBERS[i]->ReturnRateValue.length() > 0) {
-        json += "    \"rate\": \"" + NUMBERS[i]->ReturnRateValue + "\"," + _lineend;
+    if (_number.rate.length() > 0) {
+        json += "    \"rate\": \"" + _number.rate + "\"," + _lineend;
     }
     else {
         json += "    \"rate\": \"\"," + _lineend;
     }
 
-    json += "    \"timestamp\": \"" + NUMBERS[i]->timeStamp + "\"" + _lineend;
+    json += "    \"timestamp\": \"" + _number.timestamp + "\"" + _lineend;
     json += "  }" + _lineend;
 
     return json;
@@ -145,6 +164,7 @@ bool ClassFlowPostProcessing::SetPreValue(double _newvalue, string _numbers, boo
             
             UpdatePreValueINI = true;   // Only update prevalue file if a new value is set
             SavePreValue();
+            PublishPreValue(j);
 
             LogFile.WriteToFile(ESP_LOG_INFO, TAG, "SetPreValue: PreValue for " + NUMBERS[j]->name + " set to " + std::to_string(NUMBERS[j]->PreValue));
             return true;
@@ -693,6 +713,7 @@ void ClassFlowPostProcessing::InitNUMBERS() {
 
         _number->FlowRateAct = 0; // m3 / min
         _number->PreValueOkay = false;
+        _number->ErrorMessage = false;
         _number->AllowNegativeRates = false;
         _number->IgnoreLeadingNaN = false;
         _number->MaxRateValue = 0.1;
@@ -920,15 +941,14 @@ bool ClassFlowPostProcessing::doFlow(string zwtime) {
             }
 
             if ((!NUMBERS[j]->AllowNegativeRates) && (NUMBERS[j]->Value < NUMBERS[j]->PreValue)) {
-                LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "handleAllowNegativeRate for device: " + NUMBERS[j]->name);
+                LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "handleAllowNegativeRate for device: %s", NUMBERS[j]->name.c_str());
 					
                 if ((NUMBERS[j]->Value < NUMBERS[j]->PreValue)) {
                     // more debug if extended resolution is on, see #2447
                     if (NUMBERS[j]->isExtendedResolution) {
                         const double pow10 = pow10_int(NUMBERS[j]->Nachkomma);
-                        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Neg: value=" + std::to_string(NUMBERS[j]->Value) 
-                                                            + ", preValue=" + std::to_string(NUMBERS[j]->PreValue) 
-                                                            + ", preToll=" + std::to_string(NUMBERS[j]->PreValue - (2 / pow10)));
+                        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Neg: value=%f, preValue=%f, preToll=%f",
+                                      NUMBERS[j]->Value, NUMBERS[j]->PreValue, NUMBERS[j]->PreValue - (2 / pow10));
                     } 
 
                     NUMBERS[j]->ErrorMessageText = NUMBERS[j]->ErrorMessageText + "Neg. Rate - Read: " + zwvalue + " - Raw: " + NUMBERS[j]->ReturnRawValue + " - Pre: " + RundeOutput(NUMBERS[j]->PreValue, NUMBERS[j]->Nachkomma) + " "; 
@@ -1004,9 +1024,95 @@ bool ClassFlowPostProcessing::doFlow(string zwtime) {
     }
 
     SavePreValue();
+    PublishSnapshot();
     return true;
 }
 
+
+/* Current values of NUMBERS[i], without the JSON */
+result_snapshot::Number ClassFlowPostProcessing::SnapshotNumber(int i)
+{
+    result_snapshot::Number number;
+    number.name = NUMBERS[i]->name;
+    number.value = NUMBERS[i]->ReturnValue;
+    number.raw = NUMBERS[i]->ReturnRawValue;
+    number.pre = NUMBERS[i]->ReturnPreValue;
+    number.pre_okay = NUMBERS[i]->PreValueOkay;
+    number.error_flag = NUMBERS[i]->ErrorMessage;
+    number.error = NUMBERS[i]->ErrorMessageText;
+    number.rate = NUMBERS[i]->ReturnRateValue;
+    number.flow_rate_act = NUMBERS[i]->FlowRateAct;
+    number.change_absolute = NUMBERS[i]->ReturnChangeAbsolute;
+    number.timestamp = NUMBERS[i]->timeStamp;
+    number.time_last_value = NUMBERS[i]->timeStampLastValue;
+    number.time_last_pre_value = NUMBERS[i]->timeStampLastPreValue;
+    number.time_utc = NUMBERS[i]->timeStampTimeUTC;
+    number.domoticz_idx = NUMBERS[i]->DomoticzIdx;
+
+    return number;
+}
+
+
+/* Copies the current results into a new snapshot (see result_snapshot.h) */
+result_snapshot::SnapshotRef ClassFlowPostProcessing::MakeSnapshot()
+{
+    std::shared_ptr<result_snapshot::Snapshot> snapshot = std::make_shared<result_snapshot::Snapshot>();
+
+    snapshot->round = getCountFlowRounds();
+    snapshot->pre_value_use = PreValueUse;
+    snapshot->numbers.reserve(NUMBERS.size());
+
+    for (int i = 0; i < NUMBERS.size(); ++i) {
+        result_snapshot::Number number = SnapshotNumber(i);
+        number.json = getJsonFromNumber(number, "\n");
+        snapshot->numbers.push_back(number);
+    }
+
+    snapshot->json = GetJSON(snapshot->numbers);
+    snapshot->metrics = createSequenceMetrics(OPENMETRICS_PREFIX, NUMBERS);
+
+    return snapshot;
+}
+
+
+/* Publishes the results of this round */
+void ClassFlowPostProcessing::PublishSnapshot()
+{
+    result_snapshot::publish(MakeSnapshot());
+}
+
+
+/* A PreValue set via /setPreValue or MQTT replaces the one of the current snapshot. The rest of the snapshot stays
+ * as it is, the flow might be in the middle of the next round */
+void ClassFlowPostProcessing::PublishPreValue(int _index)
+{
+    while (true) {
+        result_snapshot::SnapshotRef current = result_snapshot::get();
+        if (!current) {
+            return;     // No round completed yet, the readers use NUMBERS directly
+        }
+
+        std::shared_ptr<result_snapshot::Snapshot> snapshot = std::make_shared<result_snapshot::Snapshot>(*current);
+
+        for (int i = 0; i < snapshot->numbers.size(); ++i) {
+            result_snapshot::Number &number = snapshot->numbers[i];
+            if (number.name == NUMBERS[_index]->name) {
+                number.pre = NUMBERS[_index]->ReturnPreValue;
+                number.pre_okay = NUMBERS[_index]->PreValueOkay;
+                number.time_last_pre_value = NUMBERS[_index]->timeStampLastPreValue;
+                number.json = getJsonFromNumber(number, "\n");
+            }
+        }
+
+        snapshot->json = GetJSON(snapshot->numbers);
+
+        if (result_snapshot::replace(current, snapshot)) {
+            return;
+        }
+        // A round got completed in between, patch the new snapshot
+    }
+}
+
 void ClassFlowPostProcessing::WriteDataLog(int _index) {
     if (!LogFile.GetDataLogToSD()) {
         return;
@@ -7,6 +7,7 @@
 #include "ClassFlowTakeImage.h"
 #include "ClassFlowCNNGeneral.h"
 #include "ClassFlowDefineTypes.h"
+#include "result_snapshot.h"
 
 #include <string>
 
@@ -45,6 +46,9 @@ protected:
     void handlecheckDigitIncreaseConsistency(std::string _decsep, std::string _value);
 
     void WriteDataLog(int _index);
+    result_snapshot::Number SnapshotNumber(int i);
+    void PublishSnapshot();
+    void PublishPreValue(int _index);
 
 public:
     bool PreValueUse;
@@ -61,15 +65,18 @@ public:
     string getReadoutTimeStamp(int _number = 0);
     void SavePreValue();
     string getJsonFromNumber(int i, std::string _lineend);
+    static std::string getJsonFromNumber(const result_snapshot::Number &_number, std::string _lineend);
     string GetPreValue(std::string _number = "");
     bool SetPreValue(double zw, string _numbers, bool _extern = false);
 
     std::string GetJSON(std::string _lineend = "\n");
+    static std::string GetJSON(const std::vector<result_snapshot::Number> &_numbers, std::string _lineend = "\n");
     std::string getNumbersName();
 
     void UpdateNachkommaDecimalShift();
 
     std::vector<NumberPost*>* GetNumbers(){return &NUMBERS;};
+    result_snapshot::SnapshotRef MakeSnapshot();
 
     string name(){return "ClassFlowPostProcessing";};
 };
@@ -148,21 +148,39 @@ void ClassFlowWebhook::handleMeasurement(string _decsep, string _value)
 }
 
 
-bool ClassFlowWebhook::doFlow(string zwtime)
+bool ClassFlowWebhook::wantsImage(const result_snapshot::Snapshot &_snapshot)
+{
+    if (!WebhookEnable || (WebhookUploadImg == 0))
+        return false;
+
+    if (WebhookUploadImg == 1)
+        return true;
+
+    // UploadImg = 2: only if a number has an error
+    for (int i = 0; i < _snapshot.numbers.size(); ++i)
+    {
+        if (_snapshot.numbers[i].error_flag)
+            return true;
+    }
+
+    return false;
+}
+
+
+bool ClassFlowWebhook::doPublish(const result_snapshot::SnapshotRef &_snapshot, const image_cache::JpegRef &_image)
 {
     if (!WebhookEnable)
         return true;
 
-    if (flowpostprocessing)
+    if (_snapshot)
     {
         printf("vor sende WebHook");
-        bool numbersWithError = WebhookPublish(flowpostprocessing->GetNumbers());
+        WebhookPublish(_snapshot->numbers);
 
-        #ifdef ALGROI_LOAD_FROM_MEM_AS_JPG
-            if ((WebhookUploadImg == 1 || (WebhookUploadImg != 0 && numbersWithError)) && flowAlignment && flowAlignment->AlgROI) {
-                WebhookUploadPic(flowAlignment->AlgROI);
-            }
-        #endif
+        // alg_roi.jpg of the round, see wantsImage()
+        if (_image) {
+            WebhookUploadPic(_image->data, _image->size);
+        }
     }
        
     return true;
@@ -35,7 +35,9 @@ public:
     ClassFlowWebhook(std::vector<ClassFlow*>* lfc, ClassFlow *_prev);
 
     bool ReadParameter(FILE* pfile, string& aktparamgraph);
-    bool doFlow(string time);
+    bool isPublisher(){return true;};
+    bool wantsImage(const result_snapshot::Snapshot &_snapshot);
+    bool doPublish(const result_snapshot::SnapshotRef &_snapshot, const image_cache::JpegRef &_image);
     string name(){return "ClassFlowWebhook";};
 };
 
@@ -27,6 +27,8 @@
 #include "connect_wlan.h"
 #include "psram.h"
 #include "basic_auth.h"
+#include "flow_stats.h"
+#include "result_snapshot.h"
 
 // support IDF 5.x
 #ifndef portTICK_RATE_MS
@@ -495,6 +497,22 @@ esp_err_t handler_json(httpd_req_t *req)
     return ESP_OK;
 }
 
+/**
+ * Duration and heap usage of the flow steps of the last rounds (see flow_stats.h)
+ */
+esp_err_t handler_flow_stats(httpd_req_t *req)
+{
+    ESP_LOGD(TAG, "handler_flow_stats uri: %s", req->uri);
+
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_type(req, "application/json");
+
+    std::string zw = flow_stats::get_json();
+    httpd_resp_send(req, zw.c_str(), zw.length());
+
+    return ESP_OK;
+}
+
 /**
  * Generates a http response containing the OpenMetrics (https://openmetrics.io/) text wire format 
  * according to https://github.com/OpenObservability/OpenMetrics/blob/main/specification/OpenMetrics.md#text-format.
@@ -524,10 +542,11 @@ esp_err_t handler_openmetrics(httpd_req_t *req)
         httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
         httpd_resp_set_type(req, "text/plain"); // application/openmetrics-text is not yet supported by prometheus so we use text/plain for now
 
-        const string metricNamePrefix = "ai_on_the_edge_device";
+        const string metricNamePrefix = OPENMETRICS_PREFIX;
 
-        // get current measurement (flow)
-        string response = createSequenceMetrics(metricNamePrefix, flowctrl.getNumbers());
+        // get current measurement (flow), serialized once per round
+        result_snapshot::SnapshotRef snapshot = result_snapshot::get();
+        string response = snapshot ? snapshot->metrics : createSequenceMetrics(metricNamePrefix, flowctrl.getNumbers());
 
         // CPU Temperature
         response += createMetric(metricNamePrefix + "_cpu_temperature_celsius", "current cpu temperature in celsius", "gauge", std::to_string((int)temperatureRead())); 
@@ -544,6 +563,25 @@ esp_err_t handler_openmetrics(httpd_req_t *req)
         // data aquisition round
         response += createMetric(metricNamePrefix + "_rounds_total", "data aquisition rounds since device startup", "counter", std::to_string(countRounds));
 
+        // duration and heap usage of the flow steps of the last completed round
+        flow_stats::Round round;
+        if (flow_stats::get_last_round(round))
+        {
+            std::vector<std::pair<std::string, std::string>> duration, internal_min_free, spiram_min_free;
+
+            for (int i = 0; i < round.step_count; ++i)
+            {
+                duration.push_back({round.steps[i].name, std::to_string(round.steps[i].duration_us / 1e6)});
+                internal_min_free.push_back({round.steps[i].name, std::to_string(round.steps[i].heap_internal_min_free)});
+                spiram_min_free.push_back({round.steps[i].name, std::to_string(round.steps[i].heap_spiram_min_free)});
+            }
+
+            response += createMetric(metricNamePrefix + "_round_duration_seconds", "duration of the last completed round", "gauge", std::to_string(round.duration_us / 1e6));
+            response += createMetric(metricNamePrefix + "_flow_step_duration_seconds", "duration of the flow step in the last completed round", "gauge", "step", duration);
+            response += createMetric(metricNamePrefix + "_flow_step_heap_internal_min_free_bytes", "lowest free internal heap during the flow step in the last completed round", "gauge", "step", internal_min_free);
+            response += createMetric(metricNamePrefix + "_flow_step_heap_spiram_min_free_bytes", "lowest free PSRAM during the flow step in the last completed round", "gauge", "step", spiram_min_free);
+        }
+
         // the response always contains at least the metadata (HELP, TYPE) for the MetricFamily so no length check is needed
         httpd_resp_send(req, response.c_str(), response.length());
     }
@@ -1897,6 +1935,11 @@ void register_server_main_flow_task_uri(httpd_handle_t server)
     camuri.user_ctx = (void *)"stream";
     httpd_register_uri_handler(server, &camuri);
 
+    camuri.uri = "/flow_stats";
+    camuri.handler = APPLY_BASIC_AUTH_FILTER(handler_flow_stats);
+    camuri.user_ctx = (void *)"flow_stats";
+    httpd_register_uri_handler(server, &camuri);
+
     /** will handle metrics requests */
     camuri.uri = "/metrics";
     camuri.handler = APPLY_BASIC_AUTH_FILTER(handler_openmetrics);
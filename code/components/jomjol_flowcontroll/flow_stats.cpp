@@ -0,0 +1,209 @@
+#include "flow_stats.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "esp_heap_caps.h"
+#include "esp_idf_version.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "psram.h"
+
+static const char* TAG = "FLOW_STATS";
+
+namespace flow_stats {
+
+static SemaphoreHandle_t mutex_handle = NULL;
+static Round *rounds = NULL;            // ring buffer, FLOW_STATS_ROUNDS entries
+static Round *current = NULL;           // round in progress, only used by the flow task
+static int next_index = 0;
+static int round_count = 0;
+
+static int64_t round_start_us = 0;
+static int64_t step_start_us = 0;
+static Step *active_step = NULL;
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 1, 0)
+static uint32_t step_internal_free_start = 0;
+static uint32_t step_spiram_free_start = 0;
+#endif
+
+
+static bool init()
+{
+    if (rounds != NULL) {
+        return true;
+    }
+
+    if (mutex_handle == NULL) {
+        mutex_handle = xSemaphoreCreateMutex();
+    }
+
+    // Rarely read and too large for the internal RAM
+    Round *buffer = (Round *)calloc_psram_heap(std::string(TAG) + "->rounds", FLOW_STATS_ROUNDS + 1, sizeof(Round), MALLOC_CAP_SPIRAM);
+
+    if ((mutex_handle == NULL) || (buffer == NULL)) {
+        ESP_LOGE(TAG, "Can't allocate the flow statistics");
+        return false;
+    }
+
+    current = &buffer[FLOW_STATS_ROUNDS];
+    rounds = buffer;
+
+    return true;
+}
+
+
+void round_start(uint32_t _round)
+{
+    if (!init()) {
+        return;
+    }
+
+    memset(current, 0, sizeof(Round));
+    current->round = _round;
+    time(&current->start_time);
+    active_step = NULL;
+    round_start_us = esp_timer_get_time();
+}
+
+
+void round_end()
+{
+    if (current == NULL) {
+        return;
+    }
+
+    current->duration_us = esp_timer_get_time() - round_start_us;
+
+    if (xSemaphoreTake(mutex_handle, pdMS_TO_TICKS(100)) != pdTRUE) {
+        return;
+    }
+
+    rounds[next_index] = *current;
+    next_index = (next_index + 1) % FLOW_STATS_ROUNDS;
+    round_count = std::min(round_count + 1, FLOW_STATS_ROUNDS);
+
+    xSemaphoreGive(mutex_handle);
+}
+
+
+void step_start(const std::string &_name)
+{
+    if (current == NULL) {
+        return;
+    }
+
+    active_step = NULL;
+
+    // A step which gets repeated after a failure accumulates into its existing entry
+    for (int i = 0; i < current->step_count; ++i) {
+        if (_name == current->steps[i].name) {
+            active_step = &current->steps[i];
+        }
+    }
+
+    if (active_step == NULL) {
+        if (current->step_count >= FLOW_STATS_MAX_STEPS) {
+            return;
+        }
+
+        active_step = &current->steps[current->step_count++];
+        strncpy(active_step->name, _name.c_str(), sizeof(active_step->name) - 1);
+        active_step->heap_internal_min_free = UINT32_MAX;
+        active_step->heap_spiram_min_free = UINT32_MAX;
+    }
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    heap_caps_monitor_local_minimum_free_size_start();
+#else
+    step_internal_free_start = heap_caps_get_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    step_spiram_free_start = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+#endif
+
+    step_start_us = esp_timer_get_time();
+}
+
+
+void step_end(bool _success)
+{
+    if (active_step == NULL) {
+        return;
+    }
+
+    active_step->duration_us += esp_timer_get_time() - step_start_us;
+    active_step->runs++;
+    active_step->success = _success;
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    // Minimum since heap_caps_monitor_local_minimum_free_size_start()
+    uint32_t internal_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    uint32_t spiram_free = heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+    heap_caps_monitor_local_minimum_free_size_stop();
+#else
+    // No local high-water mark available, only the state before and after the step
+    uint32_t internal_free = std::min(step_internal_free_start, (uint32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL));
+    uint32_t spiram_free = std::min(step_spiram_free_start, (uint32_t)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+#endif
+
+    active_step->heap_internal_min_free = std::min(active_step->heap_internal_min_free, internal_free);
+    active_step->heap_spiram_min_free = std::min(active_step->heap_spiram_min_free, spiram_free);
+    active_step = NULL;
+}
+
+
+bool get_last_round(Round &_round)
+{
+    if ((rounds == NULL) || (xSemaphoreTake(mutex_handle, pdMS_TO_TICKS(100)) != pdTRUE)) {
+        return false;
+    }
+
+    bool result = (round_count > 0);
+
+    if (result) {
+        _round = rounds[(next_index + FLOW_STATS_ROUNDS - 1) % FLOW_STATS_ROUNDS];
+    }
+
+    xSemaphoreGive(mutex_handle);
+
+    return result;
+}
+
+
+std::string get_json()
+{
+    std::string json = "{\"rounds\": [";
+
+    if ((rounds == NULL) || (xSemaphoreTake(mutex_handle, pdMS_TO_TICKS(100)) != pdTRUE)) {
+        return json + "]}";
+    }
+
+    for (int r = 0; r < round_count; ++r) {
+        const Round &round = rounds[(next_index + FLOW_STATS_ROUNDS - round_count + r) % FLOW_STATS_ROUNDS];
+
+        json += std::string(r ? "," : "") + "\n  {\"round\": " + std::to_string(round.round) +
+                ", \"start_time\": " + std::to_string((long long)round.start_time) +
+                ", \"duration_us\": " + std::to_string((long long)round.duration_us) + ", \"steps\": [";
+
+        for (int i = 0; i < round.step_count; ++i) {
+            const Step &step = round.steps[i];
+
+            json += std::string(i ? "," : "") + "\n    {\"name\": \"" + step.name + "\"" +
+                    ", \"duration_us\": " + std::to_string((long long)step.duration_us) +
+                    ", \"runs\": " + std::to_string(step.runs) +
+                    ", \"success\": " + (step.success ? "true" : "false") +
+                    ", \"heap_internal_min_free\": " + std::to_string(step.heap_internal_min_free) +
+                    ", \"heap_spiram_min_free\": " + std::to_string(step.heap_spiram_min_free) + "}";
+        }
+
+        json += "]}";
+    }
+
+    xSemaphoreGive(mutex_handle);
+
+    return json + "\n]}";
+}
+
+} // namespace flow_stats
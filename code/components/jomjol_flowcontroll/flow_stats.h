@@ -0,0 +1,43 @@
+#pragma once
+
+#ifndef FLOW_STATS_H
+#define FLOW_STATS_H
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+
+#include "../../include/defines.h"
+
+// Duration and heap usage of the flow steps (ClassFlow::doFlow) of the last FLOW_STATS_ROUNDS rounds.
+// Gets filled by ClassFlowControll::doFlow(), read by the /metrics and /flow_stats handlers.
+namespace flow_stats {
+
+struct Step {
+    char name[32];                      // ClassFlow::name(), with the section for the CNN steps (":Digits", ":Analog")
+    int64_t duration_us;                // incl. repetitions after a failed run
+    uint16_t runs;
+    bool success;                       // result of the last run
+    uint32_t heap_internal_min_free;    // lowest free internal heap while the step was running
+    uint32_t heap_spiram_min_free;      // lowest free PSRAM while the step was running
+};
+
+struct Round {
+    uint32_t round;                     // see getCountFlowRounds()
+    time_t start_time;
+    int64_t duration_us;
+    int step_count;
+    Step steps[FLOW_STATS_MAX_STEPS];
+};
+
+void round_start(uint32_t _round);
+void round_end();
+void step_start(const std::string &_name);
+void step_end(bool _success);
+
+bool get_last_round(Round &_round);     // last completed round, false if there is none yet
+std::string get_json();                 // all rounds in the ring buffer, oldest first
+
+} // namespace flow_stats
+
+#endif // FLOW_STATS_H
@@ -0,0 +1,123 @@
+#include "image_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "esp_log.h"
+#include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "psram.h"
+#include "ClassLogFile.h"
+
+static const char* TAG = "IMAGE_CACHE";
+
+namespace image_cache {
+
+struct Entry {
+    std::string name;
+    JpegRef jpeg;
+};
+
+static SemaphoreHandle_t mutex_handle = NULL;
+static std::vector<Entry> entries;      // Only images of the current generation
+static uint32_t boot_id = 0;            // Keeps the ETags of different boots apart
+static uint32_t round_number = 0;
+static uint32_t generation = 0;
+
+
+Jpeg::~Jpeg()
+{
+    free_psram_heap(std::string(TAG) + "->jpeg", data);
+}
+
+
+static bool init()
+{
+    if (mutex_handle != NULL) {
+        return true;
+    }
+
+    mutex_handle = xSemaphoreCreateMutex();
+    boot_id = esp_random();
+
+    return (mutex_handle != NULL);
+}
+
+
+JpegRef get(const std::string &_name, const Encoder &_encode)
+{
+    if (!init()) {
+        return NULL;
+    }
+
+    // Held while encoding, so parallel requests for the same image wait for it instead of encoding it again
+    xSemaphoreTake(mutex_handle, portMAX_DELAY);
+
+    for (const Entry &entry : entries) {
+        if (entry.name == _name) {
+            JpegRef jpeg = entry.jpeg;
+            xSemaphoreGive(mutex_handle);
+            return jpeg;
+        }
+    }
+
+    size_t size = 0;
+    uint8_t *data = _encode(&size);
+    if (data == NULL) {
+        xSemaphoreGive(mutex_handle);
+        LogFile.WriteToFile(ESP_LOG_WARN, TAG, "Failed to encode " + _name);
+        return NULL;
+    }
+
+    Jpeg *jpeg = new Jpeg;
+    jpeg->data = data;
+    jpeg->size = size;
+    snprintf(jpeg->etag, sizeof(jpeg->etag), "\"%08lx-%lu-%lu\"", (unsigned long)boot_id, (unsigned long)round_number, (unsigned long)generation);
+
+    Entry entry = {_name, JpegRef(jpeg)};
+    entries.push_back(entry);
+
+    xSemaphoreGive(mutex_handle);
+
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Encoded %s (%d bytes, generation %lu)", _name.c_str(), (int)size, (unsigned long)generation);
+
+    return entry.jpeg;
+}
+
+
+void invalidate(uint32_t _round)
+{
+    if (!init()) {
+        return;
+    }
+
+    xSemaphoreTake(mutex_handle, portMAX_DELAY);
+
+    round_number = _round;
+    generation++;
+    entries.clear();                    // Images still being sent get freed by the last reference
+
+    xSemaphoreGive(mutex_handle);
+}
+
+
+esp_err_t send(httpd_req_t *req, const JpegRef &_jpeg)
+{
+    httpd_resp_set_type(req, "image/jpeg");
+    httpd_resp_set_hdr(req, "ETag", _jpeg->etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    char if_none_match[64];
+    if ((httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK) &&
+        (strstr(if_none_match, _jpeg->etag) != NULL)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    return httpd_resp_send(req, (const char *)_jpeg->data, _jpeg->size);
+}
+
+} // namespace image_cache
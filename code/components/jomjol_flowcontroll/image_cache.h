@@ -0,0 +1,43 @@
+#pragma once
+
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+// Encoded JPEGs of the images of the last round (alg.jpg, alg_roi.jpg, ROI thumbnails).
+// Every image gets encoded at most once per generation (lazily, on the first request) and is then shared by all
+// requests. A new generation starts with invalidate(), after every round and after single steps in the setup.
+namespace image_cache {
+
+struct Jpeg {
+    uint8_t *data;                      // PSRAM, see CImageBasis::EncodeJPG()
+    size_t size;
+    char etag[40];                      // Boot id, round and generation
+    ~Jpeg();
+};
+
+typedef std::shared_ptr<const Jpeg> JpegRef;    // Stays valid after the next invalidate() as long as it is referenced
+
+// Called on a cache miss, returns the encoded image (allocated with malloc_psram_heap) or NULL
+typedef std::function<uint8_t*(size_t *_size)> Encoder;
+
+// Returns the JPEG _name of the current generation, calls _encode if it is not cached yet. NULL if encoding failed.
+JpegRef get(const std::string &_name, const Encoder &_encode);
+
+// Images changed, _round is the last completed round (see getCountFlowRounds())
+void invalidate(uint32_t _round);
+
+// Sends _jpeg with its ETag, answers with 304 Not Modified if the client has it already
+esp_err_t send(httpd_req_t *req, const JpegRef &_jpeg);
+
+} // namespace image_cache
+
+#endif // IMAGE_CACHE_H
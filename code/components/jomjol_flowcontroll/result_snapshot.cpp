@@ -0,0 +1,45 @@
+#include "result_snapshot.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+namespace result_snapshot {
+
+// Only held while copying the pointer (reference count), never while building or freeing a snapshot
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static SnapshotRef current;
+
+
+void publish(SnapshotRef _snapshot)
+{
+    taskENTER_CRITICAL(&lock);
+    current.swap(_snapshot);
+    taskEXIT_CRITICAL(&lock);
+
+    // _snapshot now holds the previous one, released outside of the critical section
+}
+
+
+SnapshotRef get()
+{
+    taskENTER_CRITICAL(&lock);
+    SnapshotRef snapshot = current;
+    taskEXIT_CRITICAL(&lock);
+
+    return snapshot;
+}
+
+
+bool replace(const SnapshotRef &_expected, SnapshotRef _snapshot)
+{
+    taskENTER_CRITICAL(&lock);
+    bool replaced = (current == _expected);
+    if (replaced) {
+        current.swap(_snapshot);
+    }
+    taskEXIT_CRITICAL(&lock);
+
+    return replaced;
+}
+
+} // namespace result_snapshot
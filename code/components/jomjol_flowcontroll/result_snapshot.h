@@ -0,0 +1,58 @@
+#pragma once
+
+#ifndef RESULT_SNAPSHOT_H
+#define RESULT_SNAPSHOT_H
+
+#include <stdint.h>
+#include <time.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Results of the last completed round, published by ClassFlowPostProcessing::doFlow().
+// A snapshot never changes after it got published, the next round replaces it by a new one. Readers (HTTP handlers,
+// publishers) keep a reference as long as they need it, so they never see a half updated round and never wait for the flow.
+namespace result_snapshot {
+
+struct Number {
+    std::string name;
+    std::string value;                  // NumberPost::ReturnValue
+    std::string raw;                    // NumberPost::ReturnRawValue
+    std::string pre;                    // NumberPost::ReturnPreValue
+    bool pre_okay;                      // NumberPost::PreValueOkay
+    bool error_flag;                    // NumberPost::ErrorMessage
+    std::string error;                  // NumberPost::ErrorMessageText
+    std::string rate;                   // NumberPost::ReturnRateValue (per minute)
+    double flow_rate_act;               // NumberPost::FlowRateAct
+    std::string change_absolute;        // NumberPost::ReturnChangeAbsolute (per round)
+    std::string timestamp;
+    time_t time_last_value;
+    time_t time_last_pre_value;
+    time_t time_utc;                    // NumberPost::timeStampTimeUTC
+    std::string domoticz_idx;
+    std::string json;                   // ClassFlowPostProcessing::getJsonFromNumber()
+};
+
+struct Snapshot {
+    uint32_t round;                     // see getCountFlowRounds()
+    bool pre_value_use;
+    std::vector<Number> numbers;
+    std::string json;                   // ClassFlowPostProcessing::GetJSON(), served by /json
+    std::string metrics;                // createSequenceMetrics(), served by /metrics
+};
+
+typedef std::shared_ptr<const Snapshot> SnapshotRef;
+
+// Replaces the current snapshot, the old one gets freed by its last reader
+void publish(SnapshotRef _snapshot);
+
+// Current snapshot, NULL before the first round got completed
+SnapshotRef get();
+
+// Replaces the current snapshot only if it is still _expected (e.g. a patched copy of it), returns false if a newer
+// one got published in between
+bool replace(const SnapshotRef &_expected, SnapshotRef _snapshot);
+
+} // namespace result_snapshot
+
+#endif // RESULT_SNAPSHOT_H
@@ -40,7 +40,7 @@ bool psram_init_shared_memory_for_take_image_step(void) {
         return false;
     }
 
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Init shared memory for step 'Take Image' (STBI buffers)");
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Init shared memory for step 'Take Image' (STBI buffers)");
     allocatedBytesForSTBI = 0;
     sharedMemoryInUseFor = "TakeImage";
 
@@ -49,7 +49,7 @@ bool psram_init_shared_memory_for_take_image_step(void) {
 
 
 void psram_deinit_shared_memory_for_take_image_step(void) {
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Deinit shared memory for step 'Take Image' (STBI buffers)");
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Deinit shared memory for step 'Take Image' (STBI buffers)");
     allocatedBytesForSTBI = 0;
     sharedMemoryInUseFor = "";
 }
@@ -66,7 +66,7 @@ void *psram_reserve_shared_stbi_memory(size_t size) {
             return NULL;
         }
         
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Allocating memory (" + std::to_string(size) + " bytes) for STBI (use shared memory in PSRAM)...");
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Allocating memory (%d bytes) for STBI (use shared memory in PSRAM)...", (int)size);
         allocatedBytesForSTBI += size;
         return (uint8_t *)shared_region + allocatedBytesForSTBI - size;
     }
@@ -86,7 +86,7 @@ void *psram_reallocate_shared_stbi_memory(void *ptr, size_t newsize) {
 
 void psram_free_shared_stbi_memory(void *p) {
     if ((p >= shared_region) && (p <= ((uint8_t *)shared_region + allocatedBytesForSTBI))) { // was allocated inside the shared memory
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Part of shared memory used for STBI (PSRAM, part of shared memory) is free again");
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Part of shared memory used for STBI (PSRAM, part of shared memory) is free again");
     }
     else { // Normal PSRAM
         free_psram_heap("STBI", p);
@@ -106,14 +106,14 @@ void *psram_reserve_shared_tmp_image_memory(void) {
         return NULL;
     }
 
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Allocating tmpImage (" + std::to_string(IMAGE_SIZE) + " bytes, use shared memory in PSRAM)...");
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Allocating tmpImage (%d bytes, use shared memory in PSRAM)...", (int)IMAGE_SIZE);
     sharedMemoryInUseFor = "Aligning";
     return shared_region; // Use 1th part of the shared memory for the tmpImage (only user)
 }
 
 
 void psram_free_shared_temp_image_memory(void) {
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Shared memory used for tmpImage (PSRAM, part of shared memory) is free again");
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Shared memory used for tmpImage (PSRAM, part of shared memory) is free again");
     sharedMemoryInUseFor = "";
 }
 
@@ -129,7 +129,7 @@ void psram_free_shared_temp_image_memory(void) {
 void *psram_get_shared_tensor_arena_memory(void) {
     if ((sharedMemoryInUseFor == "") || (sharedMemoryInUseFor == "Digitization_Model")) {
         sharedMemoryInUseFor = "Digitization_Tensor";
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Allocating Tensor Arena (" + std::to_string(TENSOR_ARENA_SIZE) + " bytes, use shared memory in PSRAM)...");
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Allocating Tensor Arena (%d bytes, use shared memory in PSRAM)...", (int)TENSOR_ARENA_SIZE);
         return shared_region; // Use 1th part of the shared memory for Tensor
     }
     else {
@@ -142,7 +142,7 @@ void *psram_get_shared_tensor_arena_memory(void) {
 void *psram_get_shared_model_memory(void) {
     if ((sharedMemoryInUseFor == "") || (sharedMemoryInUseFor == "Digitization_Tensor")) {
         sharedMemoryInUseFor = "Digitization_Model";
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Allocating Model memory (" + std::to_string(MAX_MODEL_SIZE) + " bytes, use shared memory in PSRAM)...");
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Allocating Model memory (%d bytes, use shared memory in PSRAM)...", (int)MAX_MODEL_SIZE);
         return (uint8_t *)shared_region + TENSOR_ARENA_SIZE; // Use 2nd part of the shared memory (after Tensor Arena) for the model
     }
     else {
@@ -154,7 +154,7 @@ void *psram_get_shared_model_memory(void) {
 
 void psram_free_shared_tensor_arena_and_model_memory(void) {
     sharedMemoryInUseFor = "";
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Shared memory used for Tensor Arena and model (PSRAM, part of shared memory) is free again");
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Shared memory used for Tensor Arena and model (PSRAM, part of shared memory) is free again");
 }
 
 
@@ -167,7 +167,7 @@ void *malloc_psram_heap(std::string name, size_t size, uint32_t caps) {
 
 	ptr = heap_caps_malloc(size, caps);
     if (ptr != NULL) {
-	    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Allocated " + to_string(size) + " bytes in PSRAM for '" + name + "'");
+	    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Allocated %d bytes in PSRAM for '%s'", (int)size, name.c_str());
 	}
     else {
         LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to allocate " + to_string(size) + " bytes in PSRAM for '" + name + "'!");
@@ -180,7 +180,7 @@ void *malloc_psram_heap(std::string name, size_t size, uint32_t caps) {
 void *realloc_psram_heap(std::string name, void *ptr, size_t size, uint32_t caps) {
 	ptr = heap_caps_realloc(ptr, size, caps);
     if (ptr != NULL) {
-	    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Reallocated " + to_string(size) + " bytes in PSRAM for '" + name + "'");
+	    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Reallocated %d bytes in PSRAM for '%s'", (int)size, name.c_str());
 	}
     else {
         LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to reallocate " + to_string(size) + " bytes in PSRAM for '" + name + "'!");
@@ -206,6 +206,12 @@ void *calloc_psram_heap(std::string name, size_t n, size_t size, uint32_t caps)
 
 
 void free_psram_heap(std::string name, void *ptr) {
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Freeing memory in PSRAM used for '" + name + "'...");
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Freeing memory in PSRAM used for '%s'...", name.c_str());
     heap_caps_free(ptr);
 }
+
+
+/* True if ptr points into the shared PSRAM region (such memory is never freed) */
+bool psram_is_shared_memory(const void *ptr) {
+    return ((shared_region != NULL) && (ptr >= shared_region) && (ptr < ((uint8_t *)shared_region + TENSOR_ARENA_SIZE + MAX_MODEL_SIZE)));
+}
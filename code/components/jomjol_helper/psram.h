@@ -31,5 +31,6 @@ void *realloc_psram_heap(std::string name, void *ptr, size_t size, uint32_t caps
 void *calloc_psram_heap(std::string name, size_t n, size_t size, uint32_t caps);
 
 void free_psram_heap(std::string name, void *ptr);
+bool psram_is_shared_memory(const void *ptr);
 
 #endif // PSRAM_h
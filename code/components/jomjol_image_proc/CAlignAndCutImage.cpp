@@ -1,9 +1,9 @@
 #include "CAlignAndCutImage.h"
-#include "CRotateImage.h"
 #include "ClassLogFile.h"
 
 #include <math.h>
 #include <algorithm>
+#include <string.h>
 #include <esp_log.h>
 #include "psram.h"
 #include "../../include/defines.h"
@@ -34,12 +34,28 @@ void CAlignAndCutImage::GetRefSize(int *ref_dx, int *ref_dy)
 }
 
 bool CAlignAndCutImage::Align(RefInfo *_temp1, RefInfo *_temp2)
+{
+    affine_warp::Transform align;
+
+    RGBImageLock();
+    bool isSimilar = FindAlignment(_temp1, _temp2, rgb_image, align);
+    RGBImageRelease();
+
+    Warp(align, width, height, false);
+
+    return isSimilar;
+}
+
+
+/* Searches both references in _search_image (same size as this image) and returns the transform
+ * (translation + rotation around the 1st reference) which moves them onto their target positions. */
+bool CAlignAndCutImage::FindAlignment(RefInfo *_temp1, RefInfo *_temp2, uint8_t *_search_image, affine_warp::Transform &_align)
 {
     int dx, dy;
     int r0_x, r0_y, r1_x, r1_y;
     bool isSimilar1, isSimilar2;
 
-    CFindTemplate* ft = new CFindTemplate("align", rgb_image, channels, width, height, bpp);
+    CFindTemplate* ft = new CFindTemplate("align", _search_image, channels, width, height, bpp);
 
     r0_x = _temp1->target_x;
     r0_y = _temp1->target_y;
@@ -83,15 +99,70 @@ bool CAlignAndCutImage::Align(RefInfo *_temp1, RefInfo *_temp2)
     LogFile.WriteToDedicatedFile("/spiffs/alignment.txt", zw);
 #endif*/
 
-    CRotateImage rt("Align", this, ImageTMP);
-    rt.Translate(dx, dy);
-    rt.Rotate(d_winkel, _temp1->target_x, _temp1->target_y);
+    // Same as a Translate(dx, dy) followed by a Rotate(d_winkel) around the 1st reference, but in one step
+    _align = affine_warp::compose(affine_warp::translation(dx, dy), affine_warp::rotation(d_winkel, _temp1->target_x, _temp1->target_y));
     ESP_LOGD(TAG, "Alignment: dx %d - dy %d - rot %f", dx, dy, d_winkel);
 
     return (isSimilar1 && isSimilar2);
 }
 
 
+/* Writes the image with the initial rotation applied into ImageTMP, which is used for the reference search.
+ * Unless _full is set, only the search fields of the references get calculated. */
+void CAlignAndCutImage::PrepareSearchImage(RefInfo *_temp1, RefInfo *_temp2, const affine_warp::Transform &_initial, int _src_width, int _src_height, bool _antialiasing, bool _full)
+{
+    RefInfo *refs[2] = {_temp1, _temp2};
+
+    // The search fields are only known if the reference images are already loaded, "Fast" also checks outside of them
+    for (int i = 0; i < 2; ++i) {
+        if ((refs[i]->tpl == NULL) || (refs[i]->tpl->rgb_image == NULL) || (refs[i]->alignment_algo == 2)) {
+            _full = true;
+        }
+    }
+
+    uint8_t* odata = ImageTMP->RGBImageLock();
+    RGBImageLock();
+
+    if (_full) {
+        affine_warp::warp(rgb_image, _src_width, _src_height, odata, width, height, channels, _initial, _antialiasing);
+    }
+    else {
+        for (int i = 0; i < 2; ++i) {
+            int x0 = 0, x1 = width, y0 = 0, y1 = height;
+
+            if (refs[i]->search_x > 0) {
+                x0 = refs[i]->target_x - refs[i]->search_x;
+                x1 = refs[i]->target_x + refs[i]->search_x + refs[i]->tpl->width + 1;
+            }
+            if (refs[i]->search_y > 0) {
+                y0 = refs[i]->target_y - refs[i]->search_y;
+                y1 = refs[i]->target_y + refs[i]->search_y + refs[i]->tpl->height + 1;
+            }
+
+            affine_warp::warp(rgb_image, _src_width, _src_height, odata, width, height, channels, _initial, _antialiasing, 
+                              x0, y0, std::min(x1, width), std::min(y1, height));
+        }
+    }
+
+    RGBImageRelease();
+    ImageTMP->RGBImageRelease();
+}
+
+
+/* Warps this image (with the size _src_width x _src_height) into ImageTMP and copies the result back */
+void CAlignAndCutImage::Warp(const affine_warp::Transform &_t, int _src_width, int _src_height, bool _antialiasing)
+{
+    uint8_t* odata = ImageTMP->RGBImageLock();
+    RGBImageLock();
+
+    affine_warp::warp(rgb_image, _src_width, _src_height, odata, width, height, channels, _t, _antialiasing);
+    memCopy(odata, rgb_image, width * height * channels);
+
+    RGBImageRelease();
+    ImageTMP->RGBImageRelease();
+}
+
+
 
 
 
@@ -125,14 +196,13 @@ void CAlignAndCutImage::CutAndSave(std::string _template1, int x1, int y1, int d
 
     RGBImageLock();
 
-    for (int x = x1; x < x2; ++x)
-        for (int y = y1; y < y2; ++y)
-        {
-            p_target = odata + (channels * ((y - y1) * dx + (x - x1)));
-            p_source = rgb_image + (channels * (y * width + x));
-            for (int _channels = 0; _channels < channels; ++_channels)
-                p_target[_channels] = p_source[_channels];
-        }
+    // Row-major: every line of the cut-out is one contiguous span in source and target
+    for (int y = y1; y < y2; ++y)
+    {
+        p_target = odata + (channels * (y - y1) * dx);
+        p_source = rgb_image + (channels * (y * width + x1));
+        memcpy(p_target, p_source, channels * dx);
+    }
 
 #ifdef STBI_ONLY_JPEG
     stbi_write_jpg(_template1.c_str(), dx, dy, channels, odata, 100);
@@ -171,14 +241,13 @@ void CAlignAndCutImage::CutAndSave(int x1, int y1, int dx, int dy, CImageBasis *
     stbi_uc* p_target;
     stbi_uc* p_source;
 
-    for (int x = x1; x < x2; ++x)
-        for (int y = y1; y < y2; ++y)
-        {
-            p_target = odata + (channels * ((y - y1) * dx + (x - x1)));
-            p_source = rgb_image + (channels * (y * width + x));
-            for (int _channels = 0; _channels < channels; ++_channels)
-                p_target[_channels] = p_source[_channels];
-        }
+    // Row-major: every line of the cut-out is one contiguous span in source and target
+    for (int y = y1; y < y2; ++y)
+    {
+        p_target = odata + (channels * (y - y1) * dx);
+        p_source = rgb_image + (channels * (y * width + x1));
+        memcpy(p_target, p_source, channels * dx);
+    }
 
     RGBImageRelease();
     _target->RGBImageRelease();
@@ -205,14 +274,13 @@ CImageBasis* CAlignAndCutImage::CutAndSave(int x1, int y1, int dx, int dy)
 
     RGBImageLock();
 
-    for (int x = x1; x < x2; ++x)
-        for (int y = y1; y < y2; ++y)
-        {
-            p_target = odata + (channels * ((y - y1) * dx + (x - x1)));
-            p_source = rgb_image + (channels * (y * width + x));
-            for (int _channels = 0; _channels < channels; ++_channels)
-                p_target[_channels] = p_source[_channels];
-        }
+    // Row-major: every line of the cut-out is one contiguous span in source and target
+    for (int y = y1; y < y2; ++y)
+    {
+        p_target = odata + (channels * (y - y1) * dx);
+        p_source = rgb_image + (channels * (y * width + x1));
+        memcpy(p_target, p_source, channels * dx);
+    }
 
     CImageBasis* rs = new CImageBasis("CutAndSave", odata, channels, dx, dy, bpp);
     RGBImageRelease();
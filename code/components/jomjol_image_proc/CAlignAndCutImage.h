@@ -5,6 +5,7 @@
 
 #include "CImageBasis.h"
 #include "CFindTemplate.h"
+#include "affine_warp.h"
 
 
 class CAlignAndCutImage : public CImageBasis
@@ -17,6 +18,9 @@ class CAlignAndCutImage : public CImageBasis
         CAlignAndCutImage(std::string name, CImageBasis *_org, CImageBasis *_temp);
 
         bool Align(RefInfo *_temp1, RefInfo *_temp2);
+        bool FindAlignment(RefInfo *_temp1, RefInfo *_temp2, uint8_t *_search_image, affine_warp::Transform &_align);
+        void PrepareSearchImage(RefInfo *_temp1, RefInfo *_temp2, const affine_warp::Transform &_initial, int _src_width, int _src_height, bool _antialiasing, bool _full);
+        void Warp(const affine_warp::Transform &_t, int _src_width, int _src_height, bool _antialiasing);
 //        void Align(std::string _template1, int x1, int y1, std::string _template2, int x2, int y2, int deltax = 40, int deltay = 40, std::string imageROI = "");
         void CutAndSave(std::string _template1, int x1, int y1, int dx, int dy);
         CImageBasis* CutAndSave(int x1, int y1, int dx, int dy);
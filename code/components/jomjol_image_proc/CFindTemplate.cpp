@@ -2,31 +2,126 @@
 
 #include "ClassLogFile.h"
 #include "Helper.h"
+#include "psram.h"
 #include "../../include/defines.h"
 
 #include <esp_log.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <vector>
 
 static const char* TAG = "C FIND TEMPL";
 
 // #define DEBUG_DETAIL_ON  
 
 
-bool CFindTemplate::FindTemplate(RefInfo *_ref)
+/* (Re)loads the reference image if it is not loaded yet or the file got changed (name, size or modification time) */
+bool RefTemplateUpdate(RefTemplate* _tpl, std::string _image_file, int _channels)
 {
-    uint8_t* rgb_template;
+    struct stat file_stat;
 
-    if (file_size(_ref->image_file.c_str()) == 0) {
-        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, _ref->image_file + " is empty!");
+    if (stat(_image_file.c_str(), &file_stat) != 0) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Reference image " + _image_file + " not found!");
+        RefTemplateFree(_tpl);
         return false;
     }
-   
-    rgb_template = stbi_load(_ref->image_file.c_str(), &tpl_width, &tpl_height, &tpl_bpp, channels);
 
-    if (rgb_template == NULL) {
-        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to load " + _ref->image_file + "! Is it corrupted?");
+    if ((_tpl->rgb_image != NULL) && (_tpl->image_file == _image_file) && (_tpl->channels == _channels) && 
+        (_tpl->file_size == (long)file_stat.st_size) && (_tpl->file_mtime == file_stat.st_mtime)) {
+        return true;
+    }
+
+    RefTemplateFree(_tpl);
+
+    if (file_stat.st_size == 0) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, _image_file + " is empty!");
         return false;
     }
 
+    int width, height, bpp;
+    uint8_t* decoded = stbi_load(_image_file.c_str(), &width, &height, &bpp, _channels);
+
+    if (decoded == NULL) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to load " + _image_file + "! Is it corrupted?");
+        return false;
+    }
+
+    // Copy into an own buffer, large STBI buffers can be placed in the shared PSRAM region which gets reused every round
+    size_t size = (size_t)width * height * _channels;
+    _tpl->rgb_image = (uint8_t*)malloc_psram_heap(std::string(TAG) + "->RefTemplate", size, MALLOC_CAP_SPIRAM);
+
+    if (_tpl->rgb_image == NULL) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Can't allocate cache for reference image " + _image_file);
+        stbi_image_free(decoded);
+        return false;
+    }
+
+    memcpy(_tpl->rgb_image, decoded, size);
+    stbi_image_free(decoded);
+
+    _tpl->image_file = _image_file;
+    _tpl->file_size = (long)file_stat.st_size;
+    _tpl->file_mtime = file_stat.st_mtime;
+    _tpl->width = width;
+    _tpl->height = height;
+    _tpl->channels = _channels;
+    _tpl->sum = 0;
+    _tpl->sum_sq = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+        _tpl->sum += _tpl->rgb_image[i];
+        _tpl->sum_sq += (uint32_t)_tpl->rgb_image[i] * _tpl->rgb_image[i];
+    }
+
+    // A reference image without contrast matches everywhere
+    double mean = (double)_tpl->sum / size;
+    double variance = (double)_tpl->sum_sq / size - mean * mean;
+    if (variance < 4.0) {
+        LogFile.WriteToFile(ESP_LOG_WARN, TAG, "Reference image " + _image_file + " has almost no contrast, alignment will be unreliable!");
+    }
+
+    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Reference image " + _image_file + " cached (" + std::to_string(width) + "x" + std::to_string(height) + ")");
+    return true;
+}
+
+
+void RefTemplateFree(RefTemplate* _tpl)
+{
+    if (_tpl->rgb_image != NULL) {
+        free_psram_heap(std::string(TAG) + "->RefTemplate", _tpl->rgb_image);
+    }
+
+    *_tpl = RefTemplate();
+}
+
+
+bool CFindTemplate::FindTemplate(RefInfo *_ref)
+{
+    uint8_t* rgb_template;
+    bool cached = (_ref->tpl != NULL) && (_ref->tpl->rgb_image != NULL) && 
+                  (_ref->tpl->image_file == _ref->image_file) && (_ref->tpl->channels == channels);
+
+    if (cached) {
+        rgb_template = _ref->tpl->rgb_image;
+        tpl_width = _ref->tpl->width;
+        tpl_height = _ref->tpl->height;
+        tpl_bpp = _ref->tpl->channels;
+    }
+    else {
+        if (file_size(_ref->image_file.c_str()) == 0) {
+            LogFile.WriteToFile(ESP_LOG_ERROR, TAG, _ref->image_file + " is empty!");
+            return false;
+        }
+    
+        rgb_template = stbi_load(_ref->image_file.c_str(), &tpl_width, &tpl_height, &tpl_bpp, channels);
+
+        if (rgb_template == NULL) {
+            LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to load " + _ref->image_file + "! Is it corrupted?");
+            return false;
+        }
+    }
+
 //    ESP_LOGD(TAG, "FindTemplate 01");
 
     int ow, ow_start, ow_stop;
@@ -86,7 +181,8 @@ bool CFindTemplate::FindTemplate(RefInfo *_ref)
         _ref->found_x = _ref->fastalg_x;
         _ref->found_y = _ref->fastalg_y;
 
-        stbi_image_free(rgb_template);
+        if (!cached)
+            stbi_image_free(rgb_template);
         
         return true;
     }
@@ -94,9 +190,8 @@ bool CFindTemplate::FindTemplate(RefInfo *_ref)
 //    ESP_LOGD(TAG, "FindTemplate 04");
 
 
-    double aktSAD;
-    const double max_sad = (double)tpl_width * (double)tpl_height * 255.0;
-    double minSAD = max_sad * max_sad;
+    uint64_t aktSAD;
+    uint64_t minSAD = UINT64_MAX;
 
     RGBImageLock();
 
@@ -106,28 +201,36 @@ bool CFindTemplate::FindTemplate(RefInfo *_ref)
     if (_ref->alignment_algo == 0)  // 0 = "Default" (nur R-Kanal)
         _anzchannels = 1;
 
-    for (xouter = ow_start; xouter <= ow_stop; xouter++)
-        for (youter = oh_start; youter <= oh_stop; ++youter)
-        {
-            aktSAD = 0;
-            for (tpl_x = 0; tpl_x < tpl_width; tpl_x++)
-                for (tpl_y = 0; tpl_y < tpl_height; tpl_y++)
+    if ((_ref->alignment_algo == 4) && FindTemplatePyramid(rgb_template, ow_start, ow_stop, oh_start, oh_stop, _ref->found_x, _ref->found_y)) {
+        // 4 = "Pyramid": found_x/found_y already set
+    }
+    else {
+        for (xouter = ow_start; xouter <= ow_stop; xouter++)
+            for (youter = oh_start; youter <= oh_stop; ++youter)
+            {
+                aktSAD = 0;
+                // Row by row, so image and template are read sequentially. Stop as soon as the best match can not be beaten anymore.
+                for (tpl_y = 0; (tpl_y < tpl_height) && (aktSAD < minSAD); tpl_y++)
                 {
-                    stbi_uc* p_org = rgb_image + (channels * ((youter + tpl_y) * width + (xouter + tpl_x)));
-                    stbi_uc* p_tpl = rgb_template + (channels * (tpl_y * tpl_width + tpl_x));
-                    for (_ch = 0; _ch < _anzchannels; ++_ch)
-                    {
-                        const int diff = (int)p_tpl[_ch] - (int)p_org[_ch];
-                        aktSAD += (double)(diff * diff);
-                    }
+                    stbi_uc* p_org = rgb_image + (channels * ((youter + tpl_y) * width + xouter));
+                    stbi_uc* p_tpl = rgb_template + (channels * (tpl_y * tpl_width));
+                    uint32_t lineSAD = 0;
+                    for (tpl_x = 0; tpl_x < tpl_width; tpl_x++, p_org += channels, p_tpl += channels)
+                        for (_ch = 0; _ch < _anzchannels; ++_ch)
+                        {
+                            const int diff = (int)p_tpl[_ch] - (int)p_org[_ch];
+                            lineSAD += diff * diff;
+                        }
+                    aktSAD += lineSAD;
+                }
+                if (aktSAD < minSAD)
+                {
+                    minSAD = aktSAD;
+                    _ref->found_x = xouter;
+                    _ref->found_y = youter;
                 }
-            if (aktSAD < minSAD)
-            {
-                minSAD = aktSAD;
-                _ref->found_x = xouter;
-                _ref->found_y = youter;
             }
-        }
+    }
 
 //    ESP_LOGD(TAG, "FindTemplate 06");
 
@@ -153,7 +256,8 @@ bool CFindTemplate::FindTemplate(RefInfo *_ref)
 #endif*/
 
     RGBImageRelease();
-    stbi_image_free(rgb_template);
+    if (!cached)
+        stbi_image_free(rgb_template);
     
 //    ESP_LOGD(TAG, "FindTemplate 08");
 
@@ -162,6 +266,179 @@ bool CFindTemplate::FindTemplate(RefInfo *_ref)
 
 
 
+/* One level of the image pyramid: gray image, one byte per pixel */
+struct PyramidLevel {
+    uint8_t* data = NULL;
+    int width = 0;
+    int height = 0;
+};
+
+
+static bool AllocPyramidLevel(PyramidLevel &_level, int _width, int _height)
+{
+    _level.width = _width;
+    _level.height = _height;
+    _level.data = (uint8_t*)malloc_psram_heap(std::string(TAG) + "->pyramid", _width * _height, MALLOC_CAP_SPIRAM);
+    return _level.data != NULL;
+}
+
+
+static void FreePyramid(std::vector<PyramidLevel> &_levels)
+{
+    for (int i = 0; i < _levels.size(); ++i) {
+        if (_levels[i].data) {
+            free_psram_heap(std::string(TAG) + "->pyramid", _levels[i].data);
+            _levels[i].data = NULL;
+        }
+    }
+}
+
+
+/* Gray value (R + 2G + B) / 4 of a region of an image with _channels bytes per pixel */
+static void GrayFromImage(PyramidLevel &_level, const uint8_t* _image, int _image_width, int _channels, int _x, int _y)
+{
+    for (int y = 0; y < _level.height; ++y) {
+        const uint8_t* p_src = _image + _channels * ((_y + y) * _image_width + _x);
+        uint8_t* p_dst = _level.data + y * _level.width;
+
+        if (_channels >= 3) {
+            for (int x = 0; x < _level.width; ++x, p_src += _channels)
+                p_dst[x] = (uint8_t)((p_src[0] + 2 * p_src[1] + p_src[2]) >> 2);
+        }
+        else {
+            for (int x = 0; x < _level.width; ++x, p_src += _channels)
+                p_dst[x] = p_src[0];
+        }
+    }
+}
+
+
+/* Next coarser level: average of 2x2 pixels */
+static void DownsampleLevel(const PyramidLevel &_src, PyramidLevel &_dst)
+{
+    for (int y = 0; y < _dst.height; ++y) {
+        const uint8_t* p_row0 = _src.data + (2 * y) * _src.width;
+        const uint8_t* p_row1 = p_row0 + _src.width;
+        uint8_t* p_dst = _dst.data + y * _dst.width;
+
+        for (int x = 0; x < _dst.width; ++x)
+            p_dst[x] = (uint8_t)((p_row0[2 * x] + p_row0[2 * x + 1] + p_row1[2 * x] + p_row1[2 * x + 1] + 2) >> 2);
+    }
+}
+
+
+/* Row-major integer SSD, aborts as soon as the sum reaches _best */
+static uint64_t LevelSSD(const PyramidLevel &_img, const PyramidLevel &_tpl, int _x, int _y, uint64_t _best)
+{
+    uint64_t sum = 0;
+
+    for (int y = 0; (y < _tpl.height) && (sum < _best); ++y) {
+        const uint8_t* p_org = _img.data + (_y + y) * _img.width + _x;
+        const uint8_t* p_tpl = _tpl.data + y * _tpl.width;
+        uint32_t lineSum = 0;
+
+        for (int x = 0; x < _tpl.width; ++x) {
+            const int diff = (int)p_tpl[x] - (int)p_org[x];
+            lineSum += diff * diff;
+        }
+        sum += lineSum;
+    }
+
+    return sum;
+}
+
+
+/* Exhaustive search of the template within [_x_start.._x_stop] x [_y_start.._y_stop] (clipped to the level) */
+static void SearchLevel(const PyramidLevel &_img, const PyramidLevel &_tpl, int _x_start, int _x_stop, int _y_start, int _y_stop, int &_found_x, int &_found_y)
+{
+    _x_start = std::max(_x_start, 0);
+    _y_start = std::max(_y_start, 0);
+    _x_stop = std::min(_x_stop, _img.width - _tpl.width);
+    _y_stop = std::min(_y_stop, _img.height - _tpl.height);
+
+    uint64_t best = UINT64_MAX;
+
+    for (int y = _y_start; y <= _y_stop; ++y) {
+        for (int x = _x_start; x <= _x_stop; ++x) {
+            uint64_t sum = LevelSSD(_img, _tpl, x, y, best);
+            if (sum < best) {
+                best = sum;
+                _found_x = x;
+                _found_y = y;
+            }
+        }
+    }
+}
+
+
+/* Coarse-to-fine search: full search on the coarsest level of a gray image pyramid of the search area,
+ * then only a small window around the upscaled position on each finer level.
+ * Returns false if the pyramid could not be built (caller falls back to the brute force search). */
+bool CFindTemplate::FindTemplatePyramid(uint8_t* _rgb_template, int _ow_start, int _ow_stop, int _oh_start, int _oh_stop, int &_found_x, int &_found_y)
+{
+    if ((_ow_stop < _ow_start) || (_oh_stop < _oh_start)) {
+        return false;
+    }
+
+    int levels = 1;
+    while ((levels < ALIGNMENT_PYRAMID_LEVELS) && 
+           ((tpl_width >> levels) >= ALIGNMENT_PYRAMID_MIN_TEMPLATE_SIZE) && ((tpl_height >> levels) >= ALIGNMENT_PYRAMID_MIN_TEMPLATE_SIZE)) {
+        levels++;
+    }
+
+    // Only the part of the image which can be covered by the template is needed
+    int region_width = _ow_stop - _ow_start + tpl_width;
+    int region_height = _oh_stop - _oh_start + tpl_height;
+
+    std::vector<PyramidLevel> img(levels);
+    std::vector<PyramidLevel> tpl(levels);
+    bool ok = AllocPyramidLevel(img[0], region_width, region_height) && AllocPyramidLevel(tpl[0], tpl_width, tpl_height);
+
+    for (int l = 1; ok && (l < levels); ++l) {
+        ok = AllocPyramidLevel(img[l], img[l - 1].width / 2, img[l - 1].height / 2) &&
+             AllocPyramidLevel(tpl[l], tpl[l - 1].width / 2, tpl[l - 1].height / 2);
+    }
+
+    if (!ok) {
+        LogFile.WriteToFile(ESP_LOG_WARN, TAG, "Not enough memory for the alignment pyramid, using full search");
+        FreePyramid(img);
+        FreePyramid(tpl);
+        return false;
+    }
+
+    GrayFromImage(img[0], rgb_image, width, channels, _ow_start, _oh_start);
+    GrayFromImage(tpl[0], _rgb_template, tpl_width, channels, 0, 0);
+
+    for (int l = 1; l < levels; ++l) {
+        DownsampleLevel(img[l - 1], img[l]);
+        DownsampleLevel(tpl[l - 1], tpl[l]);
+    }
+
+    int x = 0;
+    int y = 0;
+    SearchLevel(img[levels - 1], tpl[levels - 1], 0, img[levels - 1].width, 0, img[levels - 1].height, x, y);
+
+    for (int l = levels - 2; l >= 0; --l) {
+        x *= 2;
+        y *= 2;
+        SearchLevel(img[l], tpl[l], x - ALIGNMENT_PYRAMID_REFINE_RADIUS, x + ALIGNMENT_PYRAMID_REFINE_RADIUS, 
+                    y - ALIGNMENT_PYRAMID_REFINE_RADIUS, y + ALIGNMENT_PYRAMID_REFINE_RADIUS, x, y);
+    }
+
+    _found_x = _ow_start + x;
+    _found_y = _oh_start + y;
+
+    #ifdef DEBUG_DETAIL_ON
+        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Pyramid alignment (" + std::to_string(levels) + " levels): " + 
+                                                std::to_string(_found_x) + ", " + std::to_string(_found_y));
+    #endif
+
+    FreePyramid(img);
+    FreePyramid(tpl);
+    return true;
+}
+
+
 bool CFindTemplate::CalculateSimularities(uint8_t* _rgb_tmpl, int _startx, int _starty, int _sizex, int _sizey, int &min, float &avg, int &max, float &SAD, float _SADold, float _SADcrit)
 {
     int dif;
@@ -5,6 +5,24 @@
 
 #include "CImageBasis.h"
 
+#include <sys/types.h>
+
+/* Decoded reference image, kept between the rounds (owned by ClassFlowAlignment) */
+struct RefTemplate {
+    std::string image_file;
+    long file_size = -1;                // stat() fingerprint, used to detect a changed reference image
+    time_t file_mtime = 0;
+    uint8_t* rgb_image = NULL;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    uint64_t sum = 0;                   // sum of all pixel values (all channels)
+    uint64_t sum_sq = 0;                // sum of all squared pixel values
+};
+
+bool RefTemplateUpdate(RefTemplate* _tpl, std::string _image_file, int _channels);
+void RefTemplateFree(RefTemplate* _tpl);
+
 struct RefInfo {
     std::string image_file; 
     int target_x = 0;
@@ -22,7 +40,8 @@ struct RefInfo {
     int fastalg_max = -1;
     float fastalg_SAD = -1;
     float fastalg_SAD_criteria = -1;
-    int alignment_algo = 0;             // 0 = "Default" (nur R-Kanal), 1 = "HighAccuracy" (RGB-Kanal), 2 = "Fast" (1.x RGB, dann isSimilar)
+    RefTemplate* tpl = NULL;            // cached decoded image, if NULL the image gets loaded on every call
+    int alignment_algo = 0;             // 0 = "Default" (nur R-Kanal), 1 = "HighAccuracy" (RGB-Kanal), 2 = "Fast" (1.x RGB, dann isSimilar), 3 = "Off", 4 = "Pyramid" (coarse-to-fine, grau)
 };
 
 
@@ -36,6 +55,7 @@ class CFindTemplate : public CImageBasis
 
         bool FindTemplate(RefInfo *_ref);
 
+        bool FindTemplatePyramid(uint8_t* _rgb_template, int _ow_start, int _ow_stop, int _oh_start, int _oh_stop, int &_found_x, int &_found_y);
         bool CalculateSimularities(uint8_t* _rgb_tmpl, int _startx, int _starty, int _sizex, int _sizey, int &min, float &avg, int &max, float &SAD, float _SADold, float _SADcrit);
 };
 
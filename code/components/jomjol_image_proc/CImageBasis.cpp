@@ -128,6 +128,67 @@ void CImageBasis::writeToMemoryAsJPG(ImageData* i, const int quality)
 }
 
 
+struct EncodeJPGBuffer
+{
+    uint8_t *data = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+    bool failed = false;
+};
+
+
+inline void writejpgtobufferhelp(void *context, void *data, int size)
+{
+    EncodeJPGBuffer *_buf = (EncodeJPGBuffer*) context;
+    if (_buf->failed) {
+        return;
+    }
+
+    if (_buf->size + size > _buf->capacity) {
+        size_t capacity = std::max(std::max(_buf->capacity * 2, _buf->size + size), (size_t)(16 * 1024));
+        uint8_t *data_new = (uint8_t*) realloc_psram_heap(std::string(TAG) + "->EncodeJPG", _buf->data, capacity, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+        if (data_new == NULL) {
+            _buf->failed = true;
+            return;
+        }
+        _buf->data = data_new;
+        _buf->capacity = capacity;
+    }
+
+    std::memcpy(_buf->data + _buf->size, data, size);
+    _buf->size += size;
+}
+
+
+uint8_t* CImageBasis::EncodeJPG(size_t *_size, const int quality)
+{
+#if !JOMJOL_ENABLE_STBI_WRITE
+    (void)_size;
+    (void)quality;
+    LogFile.WriteToFile(ESP_LOG_WARN, TAG, "EncodeJPG disabled by build flag (JOMJOL_ENABLE_STBI_WRITE=0)");
+    return NULL;
+#else
+    EncodeJPGBuffer ii;
+
+    RGBImageLock();
+    stbi_write_jpg_to_func(writejpgtobufferhelp, &ii, width, height, channels, rgb_image, quality);
+    RGBImageRelease();
+
+    if (ii.failed || (ii.size == 0)) {
+        if (ii.data) {
+            free_psram_heap(std::string(TAG) + "->EncodeJPG", ii.data);
+        }
+        return NULL;
+    }
+
+    // Give back the unused part of the buffer
+    uint8_t *data_shrunk = (uint8_t*) heap_caps_realloc(ii.data, ii.size, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+    *_size = ii.size;
+    return data_shrunk ? data_shrunk : ii.data;
+#endif
+}
+
+
 struct SendJPGHTTP
 {
     httpd_req_t *req;
@@ -464,6 +525,8 @@ void CImageBasis::LoadFromMemory(stbi_uc *_buffer, int len)
 
     rgb_image = stbi_load_from_memory(_buffer, len, &width, &height, &channels, STBI_rgb);
     bpp = channels;
+    // Large STBI buffers are placed in the shared PSRAM region, they must not be freed or handed over
+    memsize = ((rgb_image == NULL) || psram_is_shared_memory(rgb_image)) ? 0 : width * height * channels;
     ESP_LOGD(TAG, "Image loaded from memory: %d, %d, %d", width, height, channels);
     
     if ((width * height * channels) == 0)
@@ -537,6 +600,7 @@ CImageBasis::CImageBasis(string _name, CImageBasis *_copyfrom)
 
     if (name == "tmpImage") {
         rgb_image = (unsigned char*)psram_reserve_shared_tmp_image_memory();
+        sharedImage = true;
     }
     else {
         rgb_image = (unsigned char*)malloc_psram_heap(std::string(TAG) + "->CImageBasis (" + name + ")", memsize, MALLOC_CAP_SPIRAM);
@@ -691,13 +755,59 @@ void CImageBasis::Contrast(float _contrast)  //input range [-100..100]
 }
 
 
-CImageBasis::~CImageBasis()
+CImageBasis::CImageBasis(CImageBasis &&_other)
+{
+    name = _other.name;
+    islocked = false;
+    externalImage = true; // Nothing to free yet
+    *this = std::move(_other);
+}
+
+
+CImageBasis& CImageBasis::operator=(CImageBasis &&_other)
 {
+    if (this == &_other) {
+        return *this;
+    }
+
     RGBImageLock();
+    FreeImage();
+
+    // The name stays, it belongs to the object and not to the buffer
+    filename = _other.filename;
+    rgb_image = _other.rgb_image;
+    memsize = _other.memsize;
+    externalImage = _other.externalImage;
+    sharedImage = _other.sharedImage;
+    channels = _other.channels;
+    width = _other.width;
+    height = _other.height;
+    bpp = _other.bpp;
+
+    _other.rgb_image = NULL;
+    _other.memsize = 0;
+    _other.externalImage = true;
+    _other.sharedImage = false;
+    _other.width = 0;
+    _other.height = 0;
 
+    RGBImageRelease();
+
+    return *this;
+}
 
+
+/* True if the image buffer is a normal PSRAM heap allocation owned by this image, i.e. it can be handed over to another image */
+bool CImageBasis::OwnsHeapImage()
+{
+    return (!externalImage && !sharedImage && (rgb_image != NULL) && (memsize > 0));
+}
+
+
+void CImageBasis::FreeImage()
+{
     if (!externalImage) {
-        if (name == "tmpImage") { // This image should be placed in the shared part of PSRAM
+        if (sharedImage) { // This image is placed in the shared part of PSRAM
             psram_free_shared_temp_image_memory();
         }
         else { // All other images are much smaller and can go into the normal PSRAM region
@@ -711,6 +821,16 @@ CImageBasis::~CImageBasis()
         }
     }
 
+    rgb_image = NULL;
+    memsize = 0;
+    sharedImage = false;
+}
+
+
+CImageBasis::~CImageBasis()
+{
+    RGBImageLock();
+    FreeImage();
     RGBImageRelease();
 }
 
@@ -29,12 +29,14 @@ class CImageBasis
 {
     protected:
         bool externalImage;
+        bool sharedImage = false; // Buffer is the tmpImage part of the shared PSRAM region
         std::string filename;
         std::string name; // Just used for diagnostics
         int memsize = 0;
 
         void memCopy(uint8_t* _source, uint8_t* _target, int _size);
         bool isInImage(int x, int y);
+        void FreeImage();
 
         bool islocked;
 
@@ -62,6 +64,7 @@ class CImageBasis
         bool CopyFromMemory(uint8_t* _source, int _size);
 
         void SetIndepended(){externalImage = false;};
+        bool OwnsHeapImage();
 
         void CreateEmptyImage(int _width, int _height, int _channels);
         void EmptyImage();
@@ -73,6 +76,12 @@ class CImageBasis
         CImageBasis(std::string name, int _width, int _height, int _channels);
         CImageBasis(std::string name, CImageBasis *_copyfrom);
 
+        // The image buffer has exactly one owner: moving hands it over, copying is only possible via CImageBasis(name, CImageBasis*)
+        CImageBasis(CImageBasis &&_other);
+        CImageBasis& operator=(CImageBasis &&_other);
+        CImageBasis(const CImageBasis&) = delete;
+        CImageBasis& operator=(const CImageBasis&) = delete;
+
         void Resize(int _new_dx, int _new_dy);        
         void Resize(int _new_dx, int _new_dy, CImageBasis *_target);        
         void crop_image(unsigned short cropLeft, unsigned short cropRight, unsigned short cropTop, unsigned short cropBottom);
@@ -83,6 +92,7 @@ class CImageBasis
         void writeToMemoryAsJPG(ImageData* ii, const int quality = 90);
 
         esp_err_t SendJPGtoHTTP(httpd_req_t *req, const int quality = 90);   
+        uint8_t* EncodeJPG(size_t *_size, const int quality = 90);    // Encoded image in PSRAM (free with free_psram_heap), NULL on error
 
         uint8_t GetPixelColor(int x, int y, int ch);
 
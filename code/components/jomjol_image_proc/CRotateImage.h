@@ -4,6 +4,7 @@
 #define CROTATEIMAGE_H
 
 #include "CImageBasis.h"
+#include "affine_warp.h"
 
 
 class CRotateImage: public CImageBasis
@@ -23,6 +24,10 @@ class CRotateImage: public CImageBasis
         void RotateAntiAliasing(float _angle, int _centerx, int _centery);
 
         void Translate(int _dx, int _dy);
+
+    protected:
+        affine_warp::Transform RotationTransform(float _angle, int _centerx, int _centery);
+        void Warp(const affine_warp::Transform &_t, int _org_width, int _org_height, bool _antialiasing);
 };
 
 #endif //CROTATEIMAGE_H
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "affine_warp.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace affine_warp {
+
+Transform identity()
+{
+    Transform t = {{{1, 0, 0}, {0, 1, 0}}};
+    return t;
+}
+
+Transform rotation(float _angle, float _centerx, float _centery)
+{
+    Transform t;
+    _angle = _angle / 180 * M_PI;
+
+    t.m[0][0] = cos(_angle);
+    t.m[0][1] = sin(_angle);
+    t.m[0][2] = (1 - t.m[0][0]) * _centerx - t.m[0][1] * _centery;
+
+    t.m[1][0] = -t.m[0][1];
+    t.m[1][1] = t.m[0][0];
+    t.m[1][2] = t.m[0][1] * _centerx + (1 - t.m[0][0]) * _centery;
+    return t;
+}
+
+Transform translation(float _dx, float _dy)
+{
+    Transform t = {{{1, 0, -_dx}, {0, 1, -_dy}}};
+    return t;
+}
+
+Transform initial_rotation(float _angle, bool _flip, int _width, int _height)
+{
+    if (!_flip) {
+        return rotation(_angle, _width / 2, _height / 2);
+    }
+
+    // Destination has width and height swapped, rotate around its center and move the center onto the one of the source
+    Transform t = rotation(_angle, _height / 2, _width / 2);
+    t.m[0][2] += (_width / 2) - (_height / 2);
+    t.m[1][2] += -(_width / 2) + (_height / 2);
+    return t;
+}
+
+Transform compose(const Transform& _outer, const Transform& _inner)
+{
+    Transform t;
+    for (int r = 0; r < 2; ++r) {
+        t.m[r][0] = _outer.m[r][0] * _inner.m[0][0] + _outer.m[r][1] * _inner.m[1][0];
+        t.m[r][1] = _outer.m[r][0] * _inner.m[0][1] + _outer.m[r][1] * _inner.m[1][1];
+        t.m[r][2] = _outer.m[r][0] * _inner.m[0][2] + _outer.m[r][1] * _inner.m[1][2] + _outer.m[r][2];
+    }
+    return t;
+}
+
+// Source coordinates are stepped along a row in 16.16 fixed point
+#define WARP_FRAC_BITS 16
+#define WARP_ONE (1 << WARP_FRAC_BITS)
+
+static inline int32_t to_fixed(float _v)
+{
+    return (int32_t)lroundf(_v * WARP_ONE);
+}
+
+
+/* Clips the span [_x0, _x1) to the pixels k for which _lo <= _start + k * _step < _hi (all fixed point).
+ * The condition is linear in k, so the valid pixels form one interval. */
+static void clip_span(int32_t _start, int32_t _step, int32_t _lo, int32_t _hi, int &_x0, int &_x1)
+{
+    int first = _x0;
+    int last = _x1;     // exclusive
+
+    if (_step == 0) {
+        if ((_start < _lo) || (_start >= _hi)) {
+            _x1 = _x0;
+        }
+        return;
+    }
+
+    // Estimate with floating point, then correct it with the exact integer condition
+    float k_lo = ((float)_lo - _start) / _step;
+    float k_hi = ((float)_hi - _start) / _step;
+    if (_step < 0) {
+        float zw = k_lo;
+        k_lo = k_hi;
+        k_hi = zw;
+    }
+    first = std::max(first, (int)std::min(std::max(ceilf(k_lo), (float)_x0), (float)_x1));
+    last = std::min(last, (int)std::max(std::min(ceilf(k_hi), (float)_x1), (float)_x0));
+
+    #define WARP_INSIDE(k) ((_start + (int64_t)(k) * _step >= _lo) && (_start + (int64_t)(k) * _step < _hi))
+    while ((first > _x0) && WARP_INSIDE(first - 1))
+        first--;
+    while ((first < last) && !WARP_INSIDE(first))
+        first++;
+    while ((last < _x1) && WARP_INSIDE(last))
+        last++;
+    while ((last > first) && !WARP_INSIDE(last - 1))
+        last--;
+    #undef WARP_INSIDE
+
+    _x0 = first;
+    _x1 = std::max(first, last);
+}
+
+
+void warp(const uint8_t* _src, int _src_width, int _src_height, uint8_t* _dst, int _dst_width, int _dst_height, int _channels,
+          const Transform& _t, bool _bilinear, int _x0, int _y0, int _x1, int _y1)
+{
+    if ((_x1 < 0) || (_x1 > _dst_width))
+        _x1 = _dst_width;
+    if ((_y1 < 0) || (_y1 > _dst_height))
+        _y1 = _dst_height;
+    if (_x0 < 0)
+        _x0 = 0;
+    if (_y0 < 0)
+        _y0 = 0;
+    if (_x0 >= _x1)
+        return;
+
+    const int32_t dx_step = to_fixed(_t.m[0][0]);
+    const int32_t dy_step = to_fixed(_t.m[1][0]);
+
+    // Bilinear needs the right and lower neighbour as well
+    const int32_t x_hi = (int32_t)(_bilinear ? _src_width - 1 : _src_width) * WARP_ONE;
+    const int32_t y_hi = (int32_t)(_bilinear ? _src_height - 1 : _src_height) * WARP_ONE;
+    const int src_stride = _channels * _src_width;
+
+    for (int y = _y0; y < _y1; ++y) {
+        uint8_t* p_row = _dst + _channels * y * _dst_width;
+
+        // Source position of the pixel x = 0 of this row
+        int32_t sx_row = to_fixed(_t.m[0][1] * y + _t.m[0][2]);
+        int32_t sy_row = to_fixed(_t.m[1][1] * y + _t.m[1][2]);
+
+        int span_x0 = _x0;
+        int span_x1 = _x1;
+        clip_span(sx_row, dx_step, 0, x_hi, span_x0, span_x1);
+        clip_span(sy_row, dy_step, 0, y_hi, span_x0, span_x1);
+
+        // Outside of the source image: white
+        if (span_x0 > _x0)
+            memset(p_row + _channels * _x0, 255, _channels * (span_x0 - _x0));
+        if (_x1 > span_x1)
+            memset(p_row + _channels * span_x1, 255, _channels * (_x1 - span_x1));
+
+        int32_t sx = sx_row + span_x0 * dx_step;
+        int32_t sy = sy_row + span_x0 * dy_step;
+        uint8_t* p_target = p_row + _channels * span_x0;
+
+        if (!_bilinear) {
+            if (_channels == 3) {
+                for (int x = span_x0; x < span_x1; ++x, sx += dx_step, sy += dy_step, p_target += 3) {
+                    const uint8_t* p_source = _src + (sy >> WARP_FRAC_BITS) * src_stride + 3 * (sx >> WARP_FRAC_BITS);
+                    p_target[0] = p_source[0];
+                    p_target[1] = p_source[1];
+                    p_target[2] = p_source[2];
+                }
+            }
+            else {
+                for (int x = span_x0; x < span_x1; ++x, sx += dx_step, sy += dy_step, p_target += _channels) {
+                    memcpy(p_target, _src + (sy >> WARP_FRAC_BITS) * src_stride + _channels * (sx >> WARP_FRAC_BITS), _channels);
+                }
+            }
+            continue;
+        }
+
+        // Bilinear with 8 bit weights: (ul * (256 - fx) + ur * fx) * (256 - fy) + (ll * (256 - fx) + lr * fx) * fy
+        for (int x = span_x0; x < span_x1; ++x, sx += dx_step, sy += dy_step, p_target += _channels) {
+            const uint32_t fx = (sx >> (WARP_FRAC_BITS - 8)) & 0xFF;
+            const uint32_t fy = (sy >> (WARP_FRAC_BITS - 8)) & 0xFF;
+            const uint8_t* p_ul = _src + (sy >> WARP_FRAC_BITS) * src_stride + _channels * (sx >> WARP_FRAC_BITS);
+            const uint8_t* p_ll = p_ul + src_stride;
+
+            for (int ch = 0; ch < _channels; ++ch) {
+                uint32_t upper = p_ul[ch] * (256 - fx) + p_ul[ch + _channels] * fx;
+                uint32_t lower = p_ll[ch] * (256 - fx) + p_ll[ch + _channels] * fx;
+                p_target[ch] = (uint8_t)((upper * (256 - fy) + lower * fy) >> 16);
+            }
+        }
+    }
+}
+
+} // namespace affine_warp
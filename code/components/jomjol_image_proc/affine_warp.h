@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+// Affine image warp used by the alignment step.
+// Kept free of any ESP-IDF dependency, so it can be benchmarked on the host (see test/benchmark).
+namespace affine_warp {
+
+// Maps a pixel of the destination image to the source image (inverse mapping, same as CRotateImage):
+//   x_src = m[0][0] * x + m[0][1] * y + m[0][2]
+//   y_src = m[1][0] * x + m[1][1] * y + m[1][2]
+struct Transform {
+    float m[2][3];
+};
+
+Transform identity();
+
+// Rotation by _angle (degree) around (_centerx, _centery), same matrix as CRotateImage::Rotate()
+Transform rotation(float _angle, float _centerx, float _centery);
+
+// Content gets moved by (_dx, _dy), same as CRotateImage::Translate()
+Transform translation(float _dx, float _dy);
+
+// Initial rotation of the raw image incl. the optional flip (width and height swapped), same as
+// CRotateImage::Rotate(_angle) with doflip. _width/_height are the dimensions of the raw image.
+Transform initial_rotation(float _angle, bool _flip, int _width, int _height);
+
+// Returns _outer(_inner(p)): first _inner, then _outer gets applied to a destination pixel.
+Transform compose(const Transform& _outer, const Transform& _inner);
+
+// Warps the rectangle [_x0, _x1) x [_y0, _y1) of the destination image (_x1/_y1 = -1: up to the border).
+// Pixels mapped outside of the source image get white (255).
+void warp(const uint8_t* _src, int _src_width, int _src_height, uint8_t* _dst, int _dst_width, int _dst_height, int _channels,
+          const Transform& _t, bool _bilinear, int _x0 = 0, int _y0 = 0, int _x1 = -1, int _y1 = -1);
+
+} // namespace affine_warp
@@ -6,8 +6,11 @@
 #include "ClassLogFile.h"
 #include "esp_http_client.h"
 #include "time_sntp.h"
+#include "Helper.h"
 #include "../../include/defines.h"
 
+#include <unistd.h>
+
 static const char *TAG = "INFLUXDB";
 
 /**
@@ -83,7 +86,9 @@ static esp_err_t http_event_handler(esp_http_client_event_t *evt)
  * @param _password The password for authentication.
  */
 void InfluxDB::InfluxDBInitV1(std::string _influxDBURI, std::string _database, std::string _user, std::string _password) {
+    InfluxDBdestroy(); // the parameters might have changed
     version = INFLUXDB_V1;
+    backlogFile = INFLUXDB_BACKLOG_FILE_V1;
     influxDBURI = _influxDBURI;
     database = _database;
     user = _user;
@@ -102,7 +107,9 @@ void InfluxDB::InfluxDBInitV1(std::string _influxDBURI, std::string _database, s
  * @param _token The authentication token for accessing the InfluxDB server.
  */
 void InfluxDB::InfluxDBInitV2(std::string _influxDBURI, std::string _bucket, std::string _org, std::string _token) {
+    InfluxDBdestroy(); // the parameters might have changed
     version = INFLUXDB_V2;
+    backlogFile = INFLUXDB_BACKLOG_FILE_V2;
     influxDBURI = _influxDBURI;
     bucket = _bucket;
     org = _org;
@@ -113,22 +120,37 @@ void InfluxDB::InfluxDBInitV2(std::string _influxDBURI, std::string _bucket, std
  * @brief Establishes an HTTP connection to the InfluxDB server.
  *
  * This function configures and initializes an HTTP client to connect to the InfluxDB server.
- * It sets up the necessary parameters such as the URL, event handler, buffer size, and user data.
+ * It sets up the necessary parameters such as the write API URL, event handler, buffer size, and user data.
  * Depending on the InfluxDB version, it also configures the authentication type and credentials.
  *
- * @note This function destroys any existing HTTP client before initializing a new one.
+ * @note The client is kept (keep-alive) and reused for the following requests, it only gets
+ *       re-created after a failed request (see InfluxDBdestroy()).
  *
  * @param None
- * @return None
+ * @return true if the HTTP client is ready
  */
-void InfluxDB::connectHTTP() {
+bool InfluxDB::connectHTTP() {
+    if (httpClient) {
+        return true;
+    }
+
     esp_http_client_config_t config = {};
 
-    config.url = influxDBURI.c_str();
+    switch (version) {
+        case INFLUXDB_V1:
+            apiURI = influxDBURI + "/write?db=" + database;
+            break;
+        case INFLUXDB_V2:
+            apiURI = influxDBURI + "/api/v2/write?org=" + org + "&bucket=" + bucket;
+            break;
+    }
+
+    config.url = apiURI.c_str();
     config.event_handler = http_event_handler;
     config.buffer_size = MAX_HTTP_OUTPUT_BUFFER;
     config.user_data = response_buffer;
-
+    config.keep_alive_enable = true;
+    config.method = HTTP_METHOD_POST;
 
     switch (version) {
         case INFLUXDB_V1:
@@ -140,13 +162,20 @@ void InfluxDB::connectHTTP() {
             break;
     }
 
-    InfluxDBdestroy();
     httpClient = esp_http_client_init(&config);
     if (!httpClient) {
         LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to initialize HTTP client");
-    } else {
-        LogFile.WriteToFile(ESP_LOG_INFO, TAG, "HTTP client initialized successfully");
+        return false;
+    }
+
+    esp_http_client_set_header(httpClient, "Content-Type", "text/plain");
+    if (version == INFLUXDB_V2) {
+        std::string _zw = "Token " + token;
+        esp_http_client_set_header(httpClient, "Authorization", _zw.c_str());
     }
+
+    LogFile.WriteToFile(ESP_LOG_INFO, TAG, "HTTP client initialized successfully");
+    return true;
 }
 
 
@@ -165,84 +194,243 @@ void InfluxDB::InfluxDBdestroy() {
 }
 
 /**
- * @brief Publishes data to an InfluxDB instance.
+ * @brief Adds a data point to the batch of the current round.
  *
- * This function sends a measurement, key, and content to an InfluxDB server.
- * It supports both InfluxDB v1 and v2 APIs.
+ * The point gets sent with the next InfluxDBEndRound() which sends the batch.
  *
- * @param _measurement The measurement name to publish.
+ * @param _measurement The measurement name.
  * @param _key The key associated with the measurement.
  * @param _content The content or value to publish.
- * @param _timeUTC The timestamp in UTC. If greater than 0, it will be included in the payload.
- *
- * The function logs the process and handles HTTP communication with the InfluxDB server.
- * It constructs the appropriate API URI based on the InfluxDB version and sends the data
- * using an HTTP POST request.
+ * @param _timeUTC The timestamp in UTC. If not given (<= 0), the current time is used if it is set.
+ *                 Points without timestamp are not kept in the backlog.
  */
-void InfluxDB::InfluxDBPublish(std::string _measurement, std::string _key, std::string _content, long int _timeUTC) {
-    std::string apiURI;        
-    std::string payload;
-    char nowTimestamp[21];
+void InfluxDB::InfluxDBAddPoint(std::string _measurement, std::string _key, std::string _content, long int _timeUTC) {
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "InfluxDBAddPoint - Key: %s, Content: %s, timeUTC: %ld", _key.c_str(), _content.c_str(), _timeUTC);
 
-    connectHTTP();
-
-
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "InfluxDBPublish - Key: " + _key + ", Content: " + _content + ", timeUTC: " + std::to_string(_timeUTC));
+    if ((_timeUTC <= 0) && getTimeIsSet()) {
+        _timeUTC = (long int)time(NULL);
+    }
 
     if (_timeUTC > 0)
     {
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Timestamp (UTC): " + std::to_string(_timeUTC));
-        sprintf(nowTimestamp,"%ld000000000", _timeUTC);           // UTC
-        payload = _measurement + " " + _key + "=" + _content + " " + nowTimestamp;
+        char nowTimestamp[21];
+        snprintf(nowTimestamp, sizeof(nowTimestamp), "%ld000000000", _timeUTC);           // UTC
+        pendingLines += _measurement + " " + _key + "=" + _content + " " + nowTimestamp + "\n";
     }
     else
     {
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "no timestamp given");
-        payload = _measurement + " " + _key + "=" + _content;
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "no timestamp given");
+        pendingUntimedLines += _measurement + " " + _key + "=" + _content + "\n";
+    }
+}
+
+/**
+ * @brief Sends points in one request over the kept connection.
+ *
+ * @param _lines The points (line protocol).
+ * @param _status The HTTP status code, 0 if the request failed.
+ * @return ESP_OK if the server answered
+ */
+esp_err_t InfluxDB::post(const std::string &_lines, int &_status) {
+    esp_err_t err = ESP_FAIL;
+    _status = 0;
+
+    if (connectHTTP()) {
+        esp_http_client_set_post_field(httpClient, _lines.c_str(), _lines.length());
+        err = esp_http_client_perform(httpClient);
+        if (err == ESP_OK) {
+            _status = esp_http_client_get_status_code(httpClient);
+        }
     }
 
-    payload.shrink_to_fit();
-    LogFile.WriteToFile(ESP_LOG_INFO, TAG, "sending line to influxdb:" + payload);
+    return err;
+}
 
-    esp_err_t err;
 
-    switch (version) {
-        case INFLUXDB_V1: 
-            apiURI = influxDBURI + "/write?db=" + database;
-            apiURI.shrink_to_fit();
-
-            esp_http_client_set_url(httpClient, apiURI.c_str());
-            esp_http_client_set_method(httpClient, HTTP_METHOD_POST);
-            esp_http_client_set_header(httpClient, "Content-Type", "text/plain");
-            esp_http_client_set_post_field(httpClient, payload.c_str(), payload.length());
-
-            err = esp_http_client_perform(httpClient);
-            if (err == ESP_OK) {
-                LogFile.WriteToFile(ESP_LOG_INFO, TAG, "Data published successfully: " + payload);
-            } else {
-                LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to publish data: " + std::string(esp_err_to_name(err)));
+static bool isRejected(int _status) {
+    return (_status == 400) || (_status == 413) || (_status == 422);     // malformed, too large, unprocessable
+}
+
+
+/**
+ * @brief Ends a round: sends all points added since the last send (every INFLUXDB_BATCH_ROUNDS rounds).
+ *
+ * All points and the backlog of points which could not be sent before are sent in one request
+ * over the kept connection. If the server can't be reached (or reports a server error), the points
+ * are added to the backlog on flash, which is limited to INFLUXDB_BACKLOG_MAX_SIZE (the oldest points
+ * get dropped).
+ *
+ * If the server rejects the request (400, 413, 422), e.g. because the backlog after an outage makes it
+ * too large or a single point is malformed, the points get sent again in requests of at most
+ * INFLUXDB_CHUNK_SIZE bytes (see sendChunked()). Only the requests the server rejects again get dropped.
+ * The server does not tell which line it rejected, so a malformed point takes the other points of its
+ * request with it.
+ *
+ * @return true if all points were sent (or there was nothing to send)
+ */
+bool InfluxDB::InfluxDBEndRound() {
+    if (++roundsSinceSend < INFLUXDB_BATCH_ROUNDS) {
+        return true;
+    }
+    roundsSinceSend = 0;
+
+    std::string payload = readBacklog();
+    size_t backlogLength = payload.length();
+    payload += pendingLines;
+    size_t timedLength = payload.length();          // Points without timestamp are not kept in the backlog
+    payload += pendingUntimedLines;
+
+    pendingLines.clear();
+    pendingUntimedLines.clear();
+
+    if (payload.empty()) {
+        return true;
+    }
+
+    LOGFILE_WRITE(ESP_LOG_INFO, TAG, "sending %d bytes to influxdb", (int)payload.length());
+
+    int status;
+    esp_err_t err = post(payload, status);
+
+    if ((err == ESP_OK) && (status >= 200) && (status < 300)) {
+        LOGFILE_WRITE(ESP_LOG_INFO, TAG, "Data published successfully (%d bytes)", (int)payload.length());
+        clearBacklog();
+        return true;
+    }
+
+    if ((err == ESP_OK) && isRejected(status)) {
+        LogFile.WriteToFile(ESP_LOG_WARN, TAG, "Data rejected by the server (HTTP status " + std::to_string(status) + "), sending it in parts");
+        return sendChunked(payload, timedLength);
+    }
+
+    if (err != ESP_OK) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to publish data: " + std::string(esp_err_to_name(err)) + ", points kept for the next round");
+    }
+    else {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to publish data (HTTP status " + std::to_string(status) + "), points kept for the next round");
+    }
+    InfluxDBdestroy(); // re-connect next time
+    appendToBacklog(payload.substr(backlogLength, timedLength - backlogLength));
+
+    return false;
+}
+
+
+/**
+ * @brief Sends points in requests of at most INFLUXDB_CHUNK_SIZE bytes, cut at line ends.
+ *
+ * Requests the server rejects (400, 413, 422) get dropped. If the server can't be reached anymore, the
+ * points which were not sent yet are kept in the backlog.
+ *
+ * @param _payload The points (line protocol), oldest first.
+ * @param _timedLength Length of the points with timestamp at the beginning of _payload, only those are kept.
+ * @return true if all points were sent
+ */
+bool InfluxDB::sendChunked(const std::string &_payload, size_t _timedLength) {
+    size_t pos = 0;
+    int droppedBytes = 0;
+
+    while (pos < _payload.length()) {
+        size_t end = pos + INFLUXDB_CHUNK_SIZE;
+
+        if (end >= _payload.length()) {
+            end = _payload.length();
+        }
+        else {
+            size_t cut = _payload.rfind('\n', end - 1);
+            if ((cut == std::string::npos) || (cut < pos)) {
+                cut = _payload.find('\n', end);        // Line longer than a chunk, send it as is
             }
-            break;
+            end = (cut == std::string::npos) ? _payload.length() : cut + 1;
+        }
 
-        case INFLUXDB_V2:        
-            apiURI = influxDBURI + "/api/v2/write?org=" + org + "&bucket=" + bucket;
-            apiURI.shrink_to_fit();
-            LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "apiURI: " + apiURI);
-
-            esp_http_client_set_url(httpClient, apiURI.c_str());
-            esp_http_client_set_method(httpClient, HTTP_METHOD_POST);
-            esp_http_client_set_header(httpClient, "Content-Type", "text/plain");
-            std::string _zw = "Token " + token;
-            esp_http_client_set_header(httpClient, "Authorization", _zw.c_str());
-            esp_http_client_set_post_field(httpClient, payload.c_str(), payload.length());
-            err = ESP_ERROR_CHECK_WITHOUT_ABORT(esp_http_client_perform(httpClient));
-            if (err == ESP_OK) {
-                LogFile.WriteToFile(ESP_LOG_INFO, TAG, "Data published successfully: " + payload);
-            } else {
-                LogFile.WriteToFile(ESP_LOG_INFO, TAG, "Failed to publish data: " + std::string(esp_err_to_name(err)));
+        int status;
+        esp_err_t err = post(_payload.substr(pos, end - pos), status);
+
+        if ((err == ESP_OK) && isRejected(status)) {
+            LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Data rejected by the server (HTTP status " + std::to_string(status) + "), " +
+                                std::to_string(end - pos) + " bytes of points dropped");
+            droppedBytes += end - pos;
+        }
+        else if ((err != ESP_OK) || (status < 200) || (status >= 300)) {
+            LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to publish data, remaining points kept for the next round");
+            InfluxDBdestroy(); // re-connect next time
+            clearBacklog();
+            if (pos < _timedLength) {
+                appendToBacklog(_payload.substr(pos, _timedLength - pos));
             }
-        break;
+            return false;
+        }
+
+        pos = end;
+    }
+
+    clearBacklog();
+    LOGFILE_WRITE(ESP_LOG_INFO, TAG, "Data published in parts (%d bytes, %d bytes dropped)", (int)_payload.length(), droppedBytes);
+
+    return droppedBytes == 0;
+}
+
+
+/**
+ * @brief Reads the points which could not be sent before.
+ */
+std::string InfluxDB::readBacklog() {
+    std::string lines;
+
+    FILE* pFile = fopen(backlogFile.c_str(), "r");
+    if (pFile == NULL) {
+        return lines;
+    }
+
+    char buf[256];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), pFile)) > 0) {
+        lines.append(buf, len);
+    }
+    fclose(pFile);
+
+    return lines;
+}
+
+
+void InfluxDB::clearBacklog() {
+    if (FileExists(backlogFile)) {
+        unlink(backlogFile.c_str());
+    }
+}
+
+
+/**
+ * @brief Adds points to the backlog on flash, which is limited to INFLUXDB_BACKLOG_MAX_SIZE.
+ *
+ * If the limit gets exceeded, the oldest points get dropped.
+ */
+void InfluxDB::appendToBacklog(const std::string &_lines) {
+    if (_lines.empty()) {
+        return;
+    }
+
+    size_t backlogSize = FileExists(backlogFile) ? file_size(backlogFile) : 0;
+    const char *mode = "a";
+    std::string lines = _lines;
+
+    if (backlogSize + lines.length() > INFLUXDB_BACKLOG_MAX_SIZE) {
+        // Keep the newest points only, cut at a line end
+        lines = readBacklog() + lines;
+        size_t cut = lines.find('\n', lines.length() - INFLUXDB_BACKLOG_MAX_SIZE);
+        lines = (cut == std::string::npos) ? "" : lines.substr(cut + 1);
+        mode = "w";
+        LogFile.WriteToFile(ESP_LOG_WARN, TAG, "Backlog full, dropped the oldest points");
+    }
+
+    FILE* pFile = fopen(backlogFile.c_str(), mode);
+    if (pFile == NULL) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Can't open backlog file " + backlogFile);
+        return;
     }
+    fwrite(lines.c_str(), 1, lines.length(), pFile);
+    fclose(pFile);
 }
 
 #endif //ENABLE_INFLUXDB
@@ -52,10 +52,22 @@ enum InfluxDBVersion {
  * Version of the InfluxDB server (v1.x or v2.x).
  * 
  * @var esp_http_client_handle_t httpClient
- * HTTP client handle for making requests to the InfluxDB server.
+ * HTTP client handle for making requests to the InfluxDB server (kept between the requests).
  * 
- * @var void connectHTTP()
- * Establishes an HTTP connection to the InfluxDB server.
+ * @var std::string pendingLines
+ * Points (line protocol) which get sent with the next InfluxDBEndRound().
+ * 
+ * @var std::string backlogFile
+ * Points which could not be sent yet (on flash).
+ * 
+ * @var bool connectHTTP()
+ * Establishes an HTTP connection to the InfluxDB server, if not yet done.
+ * 
+ * @var esp_err_t post(const std::string &_lines, int &_status)
+ * Sends points in one request, _status is the HTTP status code.
+ * 
+ * @var bool sendChunked(const std::string &_payload, size_t _timedLength)
+ * Sends points in requests of at most INFLUXDB_CHUNK_SIZE bytes, drops only the requests the server rejects.
  * 
  * @public
  * @fn void InfluxDBInitV1(std::string _influxDBURI, std::string _database, std::string _user, std::string _password)
@@ -67,13 +79,16 @@ enum InfluxDBVersion {
  * @fn void InfluxDBdestroy()
  * Destroys the InfluxDB connection.
  * 
- * @fn void InfluxDBPublish(std::string _measurement, std::string _key, std::string _content, long int _timeUTC)
- * Publishes data to the InfluxDB server.
+ * @fn void InfluxDBAddPoint(std::string _measurement, std::string _key, std::string _content, long int _timeUTC)
+ * Adds a data point to the batch of the current round.
  * 
  * @param _measurement The measurement name.
  * @param _key The key for the data point.
  * @param _content The content or value of the data point.
  * @param _timeUTC The timestamp in UTC for the data point.
+ * 
+ * @fn bool InfluxDBEndRound()
+ * Publishes the batch (and the backlog) to the InfluxDB server in one request.
  */
 
 class InfluxDB {
@@ -93,8 +108,19 @@ private:
     InfluxDBVersion version;
 
     esp_http_client_handle_t httpClient = NULL;
+    std::string apiURI = "";
+
+    std::string pendingLines = "";
+    std::string pendingUntimedLines = "";   // not kept in the backlog
+    int roundsSinceSend = 0;
+    std::string backlogFile = "";
 
-    void connectHTTP();
+    bool connectHTTP();
+    esp_err_t post(const std::string &_lines, int &_status);
+    bool sendChunked(const std::string &_payload, size_t _timedLength);
+    std::string readBacklog();
+    void clearBacklog();
+    void appendToBacklog(const std::string &_lines);
 
 public:
     // Initialize the InfluxDB connection parameters
@@ -103,8 +129,9 @@ public:
 
     // Destroy the InfluxDB connection
     void InfluxDBdestroy();
-    // Publish data to the InfluxDB server
-    void InfluxDBPublish(std::string _measurement, std::string _key, std::string _content, long int _timeUTC);
+    // Collect the data of a round and publish it to the InfluxDB server
+    void InfluxDBAddPoint(std::string _measurement, std::string _key, std::string _content, long int _timeUTC);
+    bool InfluxDBEndRound();
 };
 
 
@@ -5,6 +5,13 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <algorithm>
+#include <atomic>
+#include <stdarg.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/ringbuf.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -16,6 +23,7 @@ extern "C" {
 
 #include "Helper.h"
 #include "time_sntp.h"
+#include "psram.h"
 #include "../../include/defines.h"
 
 static const char *TAG = "LOGFILE";
@@ -139,46 +147,90 @@ bool ClassLogFile::GetDataLogToSD(){
 static FILE* logFileAppendHandle = NULL;
 std::string fileNameDate;
 
-void ClassLogFile::WriteToFile(esp_log_level_t level, std::string tag, std::string message, bool _time)
+// Log writer task (see StartWriterTask), the logfile is only accessed with logFileMutex taken once it is running
+static RingbufHandle_t logRingBuffer = NULL;
+static StaticRingbuffer_t logRingBufferStruct;
+static SemaphoreHandle_t logFileMutex = NULL;
+static std::atomic<uint32_t> droppedLogLines(0);
+
+
+static void lockLogFile()
 {
-    time_t rawtime;
-    struct tm* timeinfo;
-    std::string fileNameDateNew;
+    if (logFileMutex != NULL) {
+        xSemaphoreTake(logFileMutex, portMAX_DELAY);
+    }
+}
 
-    std::string zwtime;
-    std::string ntpTime = "";
 
+static void unlockLogFile()
+{
+    if (logFileMutex != NULL) {
+        xSemaphoreGive(logFileMutex);
+    }
+}
 
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
-    char buf[30];
-    strftime(buf, sizeof(buf), logfile.c_str(), timeinfo);
-    fileNameDateNew = std::string(buf);
 
-    std::replace(message.begin(), message.end(), '\n', ' '); // Replace all newline characters
+static void closeLogFile()
+{
+    if (logFileAppendHandle != NULL) {
+        fclose(logFileAppendHandle);
+        logFileAppendHandle = NULL;
+        fileNameDate = "";
+    }
+}
 
-    if (tag != "") {
-        ESP_LOG_LEVEL(level, tag.c_str(), "%s", message.c_str());
-        message = "[" + tag + "] " + message;
+
+/* Makes sure logFileAppendHandle is open, on a new day a new logfile gets started */
+bool ClassLogFile::OpenLogFileForAppending()
+{
+    std::string logpath = GetCurrentFileName();
+
+    if ((logFileAppendHandle != NULL) && (logpath == fileNameDate)) {
+        return true;
+    }
+
+    closeLogFile();
+
+    logFileAppendHandle = fopen(logpath.c_str(), "a+");
+    if (logFileAppendHandle == NULL) {
+        ESP_LOGE(TAG, "Can't open log file %s", logpath.c_str());
+        return false;
     }
-    else {
-        ESP_LOG_LEVEL(level, "", "%s", message.c_str());
+
+    fileNameDate = logpath;
+    return true;
+}
+
+
+/* Writes a log line to the console and (depending on the log level) to the logfile. Normal lines do not need
+ * any heap memory, only lines longer than LOGFILE_MAX_LINE_LENGTH get formatted in a temporary heap buffer.
+ * The message gets modified (newlines get replaced) */
+void ClassLogFile::WriteLogLine(esp_log_level_t level, const char *tag, char *message, bool _time)
+{
+    for (char *c = message; *c != '\0'; ++c) {
+        if (*c == '\n') {
+            *c = ' '; // Replace all newline characters
+        }
     }
-    
+
+    ESP_LOG_LEVEL(level, tag, "%s", message);
 
     if (level > loglevel) {// Only write to file if loglevel is below threshold
         return;
     }
 
-
+    char ntpTime[30] = "";
     if (_time)
     {
-        char logLineDate[30];
-        strftime(logLineDate, sizeof(logLineDate), "%Y-%m-%dT%H:%M:%S", timeinfo);
-        ntpTime = std::string(logLineDate);
+        time_t rawtime;
+        struct tm timeinfo;
+
+        time(&rawtime);
+        localtime_r(&rawtime, &timeinfo);
+        strftime(ntpTime, sizeof(ntpTime), "%Y-%m-%dT%H:%M:%S", &timeinfo);
     }
 
-    std::string loglevelString; 
+    const char *loglevelString;
     switch(level) {
         case  ESP_LOG_ERROR:
             loglevelString = "ERR";
@@ -201,55 +253,173 @@ void ClassLogFile::WriteToFile(esp_log_level_t level, std::string tag, std::stri
             break;
     }
 
-    std::string formatedUptime = getFormatedUptime(true);
-
-    std::string fullmessage = "[" + formatedUptime + "] "  + ntpTime + "\t<" + loglevelString + ">\t" + message + "\n";
+    std::string formatedUptime = getFormatedUptime(true); // fits into the small string buffer, no heap allocation
+    bool withTag = (tag[0] != '\0');
 
+    char line[LOGFILE_MAX_LINE_LENGTH];
+    char *fullmessage = line;
+    int len = snprintf(line, sizeof(line), "[%s] %s\t<%s>\t%s%s%s%s\n", formatedUptime.c_str(), ntpTime, loglevelString,
+                       withTag ? "[" : "", tag, withTag ? "] " : "", message);
+    if (len < 0) {
+        return;
+    }
 
-#ifdef KEEP_LOGFILE_OPEN_FOR_APPENDING
-    if (fileNameDateNew != fileNameDate) { // Filename changed
-        // Make sure each day gets its own logfile
-        // Also we need to re-open it in case it needed to get closed for reading
-        std::string logpath = logroot + "/" + fileNameDateNew; 
-
-        ESP_LOGI(TAG, "Opening logfile %s for appending", logpath.c_str());
-        logFileAppendHandle = fopen(logpath.c_str(), "a+");
-        if (logFileAppendHandle==NULL) {
-            ESP_LOGE(TAG, "Can't open log file %s", logpath.c_str());
+    if (len >= (int)sizeof(line)) {
+        fullmessage = (char *)malloc(len + 1);
+        if (fullmessage == NULL) {
             return;
         }
+        snprintf(fullmessage, len + 1, "[%s] %s\t<%s>\t%s%s%s%s\n", formatedUptime.c_str(), ntpTime, loglevelString,
+                 withTag ? "[" : "", tag, withTag ? "] " : "", message);
+    }
 
-        fileNameDate = fileNameDateNew;
+    WriteLogData(fullmessage, len);
+
+    if (fullmessage != line) {
+        free(fullmessage);
     }
-#else
-    std::string logpath = logroot + "/" + fileNameDateNew; 
-    logFileAppendHandle = fopen(logpath.c_str(), "a+");
-    if (logFileAppendHandle==NULL) {
-        ESP_LOGE(TAG, "Can't open log file %s", logpath.c_str());
+}
+
+
+void ClassLogFile::WriteLogData(const char *data, size_t len)
+{
+    if (logRingBuffer != NULL) {
+        // Never wait for the writer task, if the buffer is full the line is lost
+        if (xRingbufferSend(logRingBuffer, data, len, 0) != pdTRUE) {
+            droppedLogLines++;
+        }
+        return;
+    }
+
+    // No writer task (yet): write directly
+    if (!OpenLogFileForAppending()) {
         return;
     }
-  #endif
 
-    fputs(fullmessage.c_str(), logFileAppendHandle);
+    fwrite(data, 1, len, logFileAppendHandle);
     
 #ifdef KEEP_LOGFILE_OPEN_FOR_APPENDING
     fflush(logFileAppendHandle);
     fsync(fileno(logFileAppendHandle));
 #else
-    CloseLogFileAppendHandle();
+    closeLogFile();
 #endif
 }
 
 
+void ClassLogFile::WriteToFile(esp_log_level_t level, std::string tag, std::string message, bool _time)
+{
+    WriteLogLine(level, tag.c_str(), &message[0], _time);
+}
+
+
+void ClassLogFile::WriteToFileF(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    char message[LOGFILE_MAX_LINE_LENGTH];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args); // longer messages get truncated
+    va_end(args);
+
+    WriteLogLine(level, tag, message, true);
+}
+
+
 void ClassLogFile::CloseLogFileAppendHandle() {
+    Flush(); // Whoever reads the logfile expects all lines logged so far to be in it
+
+    lockLogFile();
+    closeLogFile();
+    unlockLogFile();
+}
+
+
+void ClassLogFile::WriteBufferedLines()
+{
+    size_t size;
+    char *data;
+
+    if (logRingBuffer == NULL) {
+        return;
+    }
+
+    lockLogFile();
+
+    // A wrap-around of the ring buffer results in two chunks
+    while ((data = (char *)xRingbufferReceiveUpTo(logRingBuffer, &size, 0, LOG_WRITER_BUFFER_SIZE)) != NULL) {
+        if (OpenLogFileForAppending()) {
+            fwrite(data, 1, size, logFileAppendHandle);
+        }
+        vRingbufferReturnItem(logRingBuffer, data);
+    }
+
     if (logFileAppendHandle != NULL) {
-        fclose(logFileAppendHandle);
-        logFileAppendHandle = NULL;
-        fileNameDate = "";
+#ifdef KEEP_LOGFILE_OPEN_FOR_APPENDING
+        fflush(logFileAppendHandle);
+        fsync(fileno(logFileAppendHandle));
+#else
+        closeLogFile();
+#endif
+    }
+
+    unlockLogFile();
+
+    uint32_t dropped = droppedLogLines.exchange(0);
+    if (dropped > 0) {
+        WriteToFile(ESP_LOG_WARN, TAG, "Log buffer was full, " + std::to_string(dropped) + " log lines got dropped");
+    }
+}
+
+
+void ClassLogFile::Flush()
+{
+    if (logRingBuffer != NULL) {
+        WriteBufferedLines();
     }
 }
 
 
+static void task_LogWriter(void *pvParameter)
+{
+    while (true) {
+        vTaskDelay(LOG_WRITER_INTERVAL_MS / portTICK_PERIOD_MS);
+        LogFile.WriteBufferedLines();
+    }
+}
+
+
+bool ClassLogFile::StartWriterTask()
+{
+    if (logRingBuffer != NULL) {
+        return true;
+    }
+
+    uint8_t *storage = (uint8_t *)malloc_psram_heap(std::string(TAG) + "->logRingBuffer", LOG_WRITER_BUFFER_SIZE, MALLOC_CAP_SPIRAM);
+    if (storage == NULL) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to allocate the log buffer, log lines get written directly");
+        return false;
+    }
+
+    logFileMutex = xSemaphoreCreateMutex();
+    BaseType_t xReturned = xTaskCreate(&task_LogWriter, "task_LogWriter", 3 * 1024, NULL, tskIDLE_PRIORITY + 1, NULL);
+
+    if ((logFileMutex == NULL) || (xReturned != pdPASS)) {
+        free_psram_heap(std::string(TAG) + "->logRingBuffer", storage);
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to create the log writer task, log lines get written directly");
+        return false;
+    }
+
+    lockLogFile();
+    closeLogFile(); // From now on only used by the writer task (and Flush)
+    logRingBuffer = xRingbufferCreateStatic(LOG_WRITER_BUFFER_SIZE, RINGBUF_TYPE_BYTEBUF, storage, &logRingBufferStruct);
+    unlockLogFile();
+
+    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Log writer task started");
+    return true;
+}
+
+
 void ClassLogFile::WriteToFile(esp_log_level_t level, std::string tag, std::string message) {
     LogFile.WriteToFile(level, tag, message, true);
 }
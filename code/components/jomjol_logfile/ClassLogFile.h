@@ -8,6 +8,25 @@
 #include "esp_log.h"
 
 
+// Max. length of a log line formatted without heap allocation (longer lines of WriteToFileF() get truncated)
+#define LOGFILE_MAX_LINE_LENGTH 256
+
+/* Compile-time minimum level of LOGFILE_WRITE, per component (e.g. target_compile_definitions(${COMPONENT_LIB} PRIVATE
+ * LOGFILE_LOCAL_LEVEL=ESP_LOG_INFO) in its CMakeLists.txt) or per file (#define before the #include) */
+#ifndef LOGFILE_LOCAL_LEVEL
+    #define LOGFILE_LOCAL_LEVEL ESP_LOG_DEBUG
+#endif
+
+/* printf-style logging to the logfile and the console. Unlike LogFile.WriteToFile(), the arguments only get evaluated
+ * and formatted if the level is enabled (compile-time and for the logfile or console), and without heap allocations:
+ *   LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "getReadout prev=%d", prev); */
+#define LOGFILE_WRITE(level, tag, format, ...) do {                                                             \
+        if (((level) <= LOGFILE_LOCAL_LEVEL) && (((level) <= LOG_LOCAL_LEVEL) || LogFile.IsLevelEnabled(level))) { \
+            LogFile.WriteToFileF(level, tag, format, ##__VA_ARGS__);                                            \
+        }                                                                                                       \
+    } while (0)
+
+
 class ClassLogFile
 {
 private:
@@ -19,6 +38,10 @@ private:
     unsigned short dataLogRetentionInDays;
     bool doDataLogToSD;
     esp_log_level_t loglevel;
+
+    bool OpenLogFileForAppending();
+    void WriteLogLine(esp_log_level_t level, const char *tag, char *message, bool _time);
+    void WriteLogData(const char *data, size_t len);
 public:
     ClassLogFile(std::string _logpath, std::string _logfile, std::string _logdatapath, std::string _datafile);
 
@@ -32,9 +55,15 @@ public:
 
     void WriteToFile(esp_log_level_t level, std::string tag, std::string message, bool _time);
     void WriteToFile(esp_log_level_t level, std::string tag, std::string message);
+    void WriteToFileF(esp_log_level_t level, const char *tag, const char *format, ...) __attribute__((format(printf, 4, 5)));
+    bool IsLevelEnabled(esp_log_level_t level) { return level <= loglevel; } // for the logfile
 
     void CloseLogFileAppendHandle();
 
+    bool StartWriterTask();     // from now on, log lines get buffered and written by a separate task
+    void WriteBufferedLines();  // writes the buffered log lines to the logfile (called by the writer task)
+    void Flush();               // same, but only if the writer task is running (e.g. before reading the logfile or a reboot)
+
     bool CreateLogDirectories();
     void RemoveOldLogFile();
     void RemoveOldDataLog();
@@ -1,5 +1,6 @@
 #ifdef ENABLE_MQTT
 #include "interface_mqtt.h"
+#include "mqtt_backlog.h"
 
 #include "esp_log.h"
 #if DEBUG_DETAIL_ON
@@ -53,7 +54,7 @@ bool MQTTPublish(std::string _key, std::string _content, int qos, bool retained_
     }
 
     if (failedOnRound == getCountFlowRounds()) {    // we already failed in this round, do not retry until the next round
-        return true; // Fail quietly
+        return false; // Fail quietly (no log), the caller may queue the message
     }
 
     #ifdef DEBUG_DETAIL_ON  
@@ -86,20 +87,35 @@ bool MQTTPublish(std::string _key, std::string _content, int qos, bool retained_
             }
         }
 
-        if (_content.length() > 80) { // Truncate message if too long
-            _content.resize(80);
-            _content.append("..");
-        }
-
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Published topic: " + _key + ", content: " + _content);
+        // Truncate message if too long
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Published topic: %s, content: %.80s%s", _key.c_str(), _content.c_str(), (_content.length() > 80) ? ".." : "");
         return true;
     }
     else {
-        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Publish skipped. Client not initalized or not connected. (topic: " + _key + ")");
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Publish skipped. Client not initalized or not connected. (topic: %s)", _key.c_str());
         return false;
     }
 }
 
+/* Hands the message over to the MQTT client task without waiting for the broker (used to publish the backlog).
+ * Returns the msg_id (MQTT_EVENT_PUBLISHED once the broker acknowledged it, QoS >= 1 only) or -1 */
+int MQTTEnqueue(std::string _key, std::string _content, int qos, bool retained_flag)
+{
+    if (!mqtt_initialized || !mqtt_connected) {
+        return -1;
+    }
+
+    int msg_id = esp_mqtt_client_enqueue(client, _key.c_str(), _content.c_str(), _content.length(), qos, retained_flag, true);
+    if (msg_id < 0) {
+        LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Failed to enqueue topic %s", _key.c_str());
+        return -1;
+    }
+
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Enqueued topic: %s, msg_id: %d, content: %.80s%s", _key.c_str(), msg_id, _content.c_str(), (_content.length() > 80) ? ".." : "");
+    return msg_id;
+}
+
+
 static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event) {
     std::string topic = "";
     switch (event->event_id) {
@@ -135,6 +151,7 @@ static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event) {
         
         case MQTT_EVENT_PUBLISHED:
             ESP_LOGD(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+            mqtt_backlog::published(event->msg_id);
             break;
         
         case MQTT_EVENT_DATA:
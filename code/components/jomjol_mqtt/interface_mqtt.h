@@ -17,6 +17,7 @@ int MQTT_Init();
 void MQTTdestroy_client(bool _disable);
 
 bool MQTTPublish(std::string _key, std::string _content, int qos, bool retained_flag = 1);            // retained Flag as Standart
+int MQTTEnqueue(std::string _key, std::string _content, int qos, bool retained_flag = 1);
 
 bool getMQTTisEnabled();
 bool getMQTTisConnected();
@@ -0,0 +1,577 @@
+#ifdef ENABLE_MQTT
+#include "mqtt_backlog.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "interface_mqtt.h"
+#include "ClassLogFile.h"
+#include "psram.h"
+#include "../../include/defines.h"
+
+static const char *TAG = "MQTT BACKLOG";
+
+namespace mqtt_backlog {
+
+/* A message in the ring buffer and in the spill file: header, topic, payload */
+struct Header {
+    uint32_t size;                  // Size of the whole record
+    uint32_t seq;
+    int64_t time;                   // Time of the reading
+    uint32_t payload_len;
+    uint16_t topic_len;
+    uint8_t qos;
+    uint8_t retain;
+};
+
+struct Message {
+    std::string topic;
+    std::string payload;
+    int qos;
+    bool retain;
+    time_t time;
+    uint32_t seq;
+};
+
+static SemaphoreHandle_t mutex_handle = NULL;
+static QueueHandle_t ack_queue = NULL;  // msg_id of the acknowledged messages (MQTT_EVENT_PUBLISHED)
+static uint8_t *ring = NULL;            // MQTT_BACKLOG_SIZE bytes in PSRAM
+static size_t ring_head = 0;            // Oldest record
+static size_t ring_used = 0;
+static int ring_count = 0;
+
+static long spill_offset = 0;           // Oldest not yet published record in the spill file
+static long spill_size = 0;
+static int spill_count = 0;
+
+static uint32_t dropped = 0;
+static uint32_t next_seq = 0;
+
+
+static void ring_write(size_t _pos, const void *_data, size_t _len)
+{
+    size_t first = std::min(_len, (size_t)MQTT_BACKLOG_SIZE - _pos);
+    memcpy(ring + _pos, _data, first);
+    memcpy(ring, (const uint8_t *)_data + first, _len - first);
+}
+
+
+static void ring_read(size_t _pos, void *_data, size_t _len)
+{
+    size_t first = std::min(_len, (size_t)MQTT_BACKLOG_SIZE - _pos);
+    memcpy(_data, ring + _pos, first);
+    memcpy((uint8_t *)_data + first, ring, _len - first);
+}
+
+
+static void ring_read_message(Message &_msg)
+{
+    Header header;
+    ring_read(ring_head, &header, sizeof(header));
+
+    size_t pos = (ring_head + sizeof(header)) % MQTT_BACKLOG_SIZE;
+    _msg.topic.resize(header.topic_len);
+    ring_read(pos, &_msg.topic[0], header.topic_len);
+
+    pos = (pos + header.topic_len) % MQTT_BACKLOG_SIZE;
+    _msg.payload.resize(header.payload_len);
+    ring_read(pos, &_msg.payload[0], header.payload_len);
+
+    _msg.qos = header.qos;
+    _msg.retain = header.retain;
+    _msg.time = (time_t)header.time;
+    _msg.seq = header.seq;
+}
+
+
+static void ring_pop()
+{
+    Header header;
+    ring_read(ring_head, &header, sizeof(header));
+
+    ring_head = (ring_head + header.size) % MQTT_BACKLOG_SIZE;
+    ring_used -= header.size;
+    ring_count--;
+}
+
+
+static void ring_push(const Message &_msg)
+{
+    Header header;
+    header.topic_len = _msg.topic.length();
+    header.payload_len = _msg.payload.length();
+    header.size = sizeof(header) + header.topic_len + header.payload_len;
+    header.time = _msg.time;
+    header.qos = _msg.qos;
+    header.retain = _msg.retain;
+    header.seq = _msg.seq;
+
+    size_t pos = (ring_head + ring_used) % MQTT_BACKLOG_SIZE;
+    ring_write(pos, &header, sizeof(header));
+    pos = (pos + sizeof(header)) % MQTT_BACKLOG_SIZE;
+    ring_write(pos, _msg.topic.data(), header.topic_len);
+    pos = (pos + header.topic_len) % MQTT_BACKLOG_SIZE;
+    ring_write(pos, _msg.payload.data(), header.payload_len);
+
+    ring_used += header.size;
+    ring_count++;
+}
+
+
+static bool spill_read_message(Message &_msg, uint32_t &_size)
+{
+    FILE *pFile = fopen(MQTT_BACKLOG_SPILL_FILE, "rb");
+    if (pFile == NULL) {
+        return false;
+    }
+
+    Header header;
+    bool ok = (fseek(pFile, spill_offset, SEEK_SET) == 0) && (fread(&header, sizeof(header), 1, pFile) == 1) &&
+              (header.size == sizeof(header) + header.topic_len + header.payload_len);
+
+    if (ok) {
+        _msg.topic.resize(header.topic_len);
+        _msg.payload.resize(header.payload_len);
+        ok = (fread(&_msg.topic[0], 1, header.topic_len, pFile) == header.topic_len) &&
+             (fread(&_msg.payload[0], 1, header.payload_len, pFile) == header.payload_len);
+        _msg.qos = header.qos;
+        _msg.retain = header.retain;
+        _msg.time = (time_t)header.time;
+        _msg.seq = header.seq;
+        _size = header.size;
+    }
+    fclose(pFile);
+
+    return ok;
+}
+
+
+static void spill_clear()
+{
+    unlink(MQTT_BACKLOG_SPILL_FILE);
+    spill_offset = 0;
+    spill_size = 0;
+    spill_count = 0;
+}
+
+
+/* Drops the oldest message of the spill file */
+static void spill_drop_front()
+{
+    Message oldest;
+    uint32_t size;
+
+    if (!spill_read_message(oldest, size)) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to read " MQTT_BACKLOG_SPILL_FILE ", dropping " + std::to_string(spill_count) + " messages");
+        dropped += spill_count;
+        spill_clear();
+        return;
+    }
+
+    spill_offset += size;
+    spill_count--;
+    dropped++;
+
+    if (spill_count == 0) {
+        spill_clear();
+    }
+}
+
+
+/* Copies the messages not published yet to the beginning of the file, so the published ones don't take up space */
+static void spill_compact()
+{
+    const char *tmpFile = MQTT_BACKLOG_SPILL_FILE ".tmp";
+
+    FILE *pIn = fopen(MQTT_BACKLOG_SPILL_FILE, "rb");
+    FILE *pOut = fopen(tmpFile, "wb");
+    bool ok = (pIn != NULL) && (pOut != NULL) && (fseek(pIn, spill_offset, SEEK_SET) == 0);
+
+    char buf[512];
+    size_t len;
+    while (ok && ((len = fread(buf, 1, sizeof(buf), pIn)) > 0)) {
+        ok = (fwrite(buf, 1, len, pOut) == len);
+    }
+
+    if (pIn != NULL) {
+        fclose(pIn);
+    }
+    if (pOut != NULL) {
+        fclose(pOut);
+    }
+
+    if (!ok) {
+        unlink(tmpFile);        // Keep using the old file
+        return;
+    }
+
+    unlink(MQTT_BACKLOG_SPILL_FILE);
+    if (rename(tmpFile, MQTT_BACKLOG_SPILL_FILE) != 0) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to compact " MQTT_BACKLOG_SPILL_FILE ", dropping " + std::to_string(spill_count) + " messages");
+        unlink(tmpFile);
+        dropped += spill_count;
+        spill_clear();
+        return;
+    }
+
+    spill_size -= spill_offset;
+    spill_offset = 0;
+}
+
+
+/* Appends a message to the spill file. If it is full, the oldest messages in it get dropped */
+static bool spill_append(const Message &_msg)
+{
+#if MQTT_BACKLOG_SPILL_MAX_SIZE > 0
+    Header header;
+    header.topic_len = _msg.topic.length();
+    header.payload_len = _msg.payload.length();
+    header.size = sizeof(header) + header.topic_len + header.payload_len;
+    header.time = _msg.time;
+    header.qos = _msg.qos;
+    header.retain = _msg.retain;
+    header.seq = _msg.seq;
+
+    if (header.size <= MQTT_BACKLOG_SPILL_MAX_SIZE) {
+        // Only the messages not published yet count (spill_offset .. spill_size)
+        while ((spill_count > 0) && (spill_size - spill_offset + header.size > MQTT_BACKLOG_SPILL_MAX_SIZE)) {
+            spill_drop_front();
+        }
+
+        if ((spill_offset > 0) && (spill_size + header.size > MQTT_BACKLOG_SPILL_MAX_SIZE)) {
+            spill_compact();
+        }
+
+        FILE *pFile = fopen(MQTT_BACKLOG_SPILL_FILE, "ab");
+        if (pFile != NULL) {
+            bool ok = (fwrite(&header, sizeof(header), 1, pFile) == 1) &&
+                      (fwrite(_msg.topic.data(), 1, header.topic_len, pFile) == header.topic_len) &&
+                      (fwrite(_msg.payload.data(), 1, header.payload_len, pFile) == header.payload_len);
+            fclose(pFile);
+
+            if (ok) {
+                spill_size += header.size;
+                spill_count++;
+                return true;
+            }
+        }
+    }
+#endif
+
+    dropped++;
+    return false;
+}
+
+
+/* Moves all messages of the ring buffer to the spill file (oldest first), returns the number of dropped ones */
+static uint32_t ring_spill_all()
+{
+    uint32_t droppedBefore = dropped;
+
+    while (ring_count > 0) {
+        Message oldest;
+        ring_read_message(oldest);
+        ring_pop();
+        spill_append(oldest);
+    }
+
+    return dropped - droppedBefore;
+}
+
+
+/* Counts the messages left in the spill file by a previous run */
+static void spill_load()
+{
+    struct stat st;
+    if (stat(MQTT_BACKLOG_SPILL_FILE, &st) != 0) {
+        // Power loss during spill_compact() after the old file got removed
+        if (rename(MQTT_BACKLOG_SPILL_FILE ".tmp", MQTT_BACKLOG_SPILL_FILE) != 0) {
+            return;
+        }
+        if (stat(MQTT_BACKLOG_SPILL_FILE, &st) != 0) {
+            return;
+        }
+    }
+
+    FILE *pFile = fopen(MQTT_BACKLOG_SPILL_FILE, "rb");
+    if (pFile == NULL) {
+        return;
+    }
+
+    Header header;
+    long offset = 0;
+    while ((fseek(pFile, offset, SEEK_SET) == 0) && (fread(&header, sizeof(header), 1, pFile) == 1) &&
+           (header.size == sizeof(header) + header.topic_len + header.payload_len) && (offset + (long)header.size <= st.st_size)) {
+        offset += header.size;
+        spill_count++;
+    }
+    fclose(pFile);
+
+    spill_size = offset;        // A truncated record at the end (power loss while writing) gets overwritten
+
+    if (offset < st.st_size) {
+        truncate(MQTT_BACKLOG_SPILL_FILE, offset);
+    }
+
+    if (spill_count > 0) {
+        LogFile.WriteToFile(ESP_LOG_INFO, TAG, "Found " + std::to_string(spill_count) + " queued messages from before the reboot");
+    }
+    else {
+        spill_clear();
+    }
+}
+
+
+/* Oldest message, the spill file holds the older ones */
+static bool front(Message &_msg, uint32_t &_spill_size)
+{
+    _spill_size = 0;
+
+    if (spill_count > 0) {
+        if (spill_read_message(_msg, _spill_size)) {
+            return true;
+        }
+
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to read " MQTT_BACKLOG_SPILL_FILE ", dropping " + std::to_string(spill_count) + " messages");
+        dropped += spill_count;
+        spill_clear();
+    }
+
+    if (ring_count > 0) {
+        ring_read_message(_msg);
+        return true;
+    }
+
+    return false;
+}
+
+
+static void pop_front(uint32_t _spill_size)
+{
+    if (spill_count > 0) {
+        spill_offset += _spill_size;
+        spill_count--;
+
+        if (spill_count == 0) {
+            spill_clear();
+        }
+        else if (spill_offset > spill_size / 2) {
+            spill_compact();
+        }
+    }
+    else if (ring_count > 0) {
+        ring_pop();
+    }
+}
+
+
+/* Waits until the broker acknowledged _msg_id */
+static bool wait_for_ack(int _msg_id)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = MQTT_BACKLOG_ACK_TIMEOUT_MS / portTICK_PERIOD_MS;
+    int msg_id;
+
+    while (xTaskGetTickCount() - start < timeout) {
+        if (xQueueReceive(ack_queue, &msg_id, timeout - (xTaskGetTickCount() - start)) != pdTRUE) {
+            break;
+        }
+        if (msg_id == _msg_id) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static void task_MQTTBacklog(void *pvParameter)
+{
+    bool replaying = false;
+
+    while (true) {
+        vTaskDelay(MQTT_BACKLOG_DRAIN_INTERVAL_MS / portTICK_PERIOD_MS);
+
+        if (!getMQTTisConnected()) {
+            replaying = false;
+            continue;
+        }
+
+        for (int i = 0; i < MQTT_BACKLOG_DRAIN_BATCH; ++i) {
+            Message msg;
+            uint32_t msgSpillSize;
+
+            xSemaphoreTake(mutex_handle, portMAX_DELAY);
+            bool available = front(msg, msgSpillSize);
+            int queued = ring_count + spill_count;
+            xSemaphoreGive(mutex_handle);
+
+            if (!available) {
+                if (replaying) {
+                    LogFile.WriteToFile(ESP_LOG_INFO, TAG, "All queued messages published");
+                    replaying = false;
+                }
+                break;
+            }
+
+            if (!replaying) {
+                LogFile.WriteToFile(ESP_LOG_INFO, TAG, "Publishing " + std::to_string(queued) + " queued messages, the oldest is " +
+                                    std::to_string((long long)(time(NULL) - msg.time)) + " s old");
+                replaying = true;
+            }
+
+            // QoS 0 messages could get lost in the MQTT client outbox, so only the acknowledged ones get removed
+            xQueueReset(ack_queue);
+            int msg_id = MQTTEnqueue(msg.topic, msg.payload, std::max(msg.qos, 1), msg.retain);
+            if ((msg_id < 0) || !wait_for_ack(msg_id)) {
+                break;      // Retry in the next interval
+            }
+
+            // A push in between may have moved the message into the spill file or dropped it
+            xSemaphoreTake(mutex_handle, portMAX_DELAY);
+            Message current;
+            if (front(current, msgSpillSize) && (current.seq == msg.seq)) {
+                pop_front(msgSpillSize);
+            }
+            xSemaphoreGive(mutex_handle);
+        }
+    }
+}
+
+
+static bool init()
+{
+    if (ring != NULL) {
+        return true;
+    }
+
+    if (mutex_handle == NULL) {
+        mutex_handle = xSemaphoreCreateMutex();
+    }
+    if (ack_queue == NULL) {
+        ack_queue = xQueueCreate(MQTT_BACKLOG_DRAIN_BATCH, sizeof(int));
+    }
+
+    uint8_t *buffer = (uint8_t *)malloc_psram_heap(std::string(TAG) + "->ring", MQTT_BACKLOG_SIZE, MALLOC_CAP_SPIRAM);
+
+    if ((mutex_handle == NULL) || (ack_queue == NULL) || (buffer == NULL)) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Can't allocate the MQTT backlog");
+        free_psram_heap(std::string(TAG) + "->ring", buffer);
+        return false;
+    }
+
+    xSemaphoreTake(mutex_handle, portMAX_DELAY);
+    ring = buffer;
+    spill_load();
+    xSemaphoreGive(mutex_handle);
+
+    BaseType_t xReturned = xTaskCreate(&task_MQTTBacklog, "task_MQTTBacklog", 3 * 1024, NULL, tskIDLE_PRIORITY + 1, NULL);
+    if (xReturned != pdPASS) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to create the MQTT backlog task, queued messages do not get published");
+    }
+
+    return true;
+}
+
+
+bool publish(const std::string &_topic, const std::string &_payload, int _qos, bool _retain, time_t _time)
+{
+    if (!init()) {
+        return MQTTPublish(_topic, _payload, _qos, _retain);
+    }
+
+    if (getMQTTisConnected() && (count() == 0) && MQTTPublish(_topic, _payload, _qos, _retain)) {
+        return true;
+    }
+
+    Message msg = {_topic, _payload, _qos, _retain, _time, 0};
+    uint32_t size = sizeof(Header) + _topic.length() + _payload.length();
+    bool queued = true;
+
+    xSemaphoreTake(mutex_handle, portMAX_DELAY);
+
+    msg.seq = next_seq++;
+
+    if (size > MQTT_BACKLOG_SIZE) {
+        // Does not fit into the ring buffer, the older messages there have to go into the spill file first to keep the order
+        ring_spill_all();
+        queued = spill_append(msg);
+    }
+    else {
+        // Make room by moving the oldest messages into the spill file (or dropping them)
+        while (ring_used + size > MQTT_BACKLOG_SIZE) {
+            Message oldest;
+            ring_read_message(oldest);
+            ring_pop();
+            spill_append(oldest);
+        }
+        ring_push(msg);
+    }
+
+    uint32_t droppedNow = dropped;
+    dropped = 0;
+    int queuedCount = ring_count + spill_count;
+
+    xSemaphoreGive(mutex_handle);
+
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Queued topic %s (%d messages queued)", _topic.c_str(), queuedCount);
+
+    if (droppedNow > 0) {
+        LogFile.WriteToFile(ESP_LOG_WARN, TAG, "Backlog full, dropped " + std::to_string(droppedNow) + " messages");
+    }
+
+    return queued;
+}
+
+
+void published(int _msg_id)
+{
+    if (ack_queue != NULL) {
+        xQueueSend(ack_queue, &_msg_id, 0);
+    }
+}
+
+
+int count()
+{
+    if (mutex_handle == NULL) {
+        return 0;
+    }
+
+    xSemaphoreTake(mutex_handle, portMAX_DELAY);
+    int queued = ring_count + spill_count;
+    xSemaphoreGive(mutex_handle);
+
+    return queued;
+}
+
+
+void persist()
+{
+    if (ring == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(mutex_handle, portMAX_DELAY);
+    int queued = ring_count;
+    uint32_t droppedNow = (queued > 0) ? ring_spill_all() : 0;
+    xSemaphoreGive(mutex_handle);
+
+    if (queued == 0) {
+        return;
+    }
+
+    LogFile.WriteToFile(ESP_LOG_INFO, TAG, "Stored " + std::to_string(queued - (int)droppedNow) + " queued messages in " MQTT_BACKLOG_SPILL_FILE);
+}
+
+}
+#endif //ENABLE_MQTT
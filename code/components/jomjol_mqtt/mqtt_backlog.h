@@ -0,0 +1,35 @@
+#ifdef ENABLE_MQTT
+
+#pragma once
+
+#ifndef MQTT_BACKLOG_H
+#define MQTT_BACKLOG_H
+
+#include <string>
+#include <time.h>
+
+/* Store-and-forward queue for the readings (value/json topics) which could not be published.
+ * Messages are kept in a ring buffer in PSRAM, the oldest ones get moved to a file on the SD card if it is full
+ * (MQTT_BACKLOG_SPILL_FILE). If the file is full as well, the oldest messages in it get dropped.
+ * A background task re-publishes them in their original order once the broker is reachable again, at most
+ * MQTT_BACKLOG_DRAIN_BATCH messages every MQTT_BACKLOG_DRAIN_INTERVAL_MS. They get sent with QoS 1 (at least)
+ * and stay queued until the broker acknowledged them. */
+namespace mqtt_backlog {
+
+/* Publishes the message if connected and nothing is queued (keeps the order), otherwise queues it.
+ * _time is the time the reading was taken. Returns false only if the message had to be dropped. */
+bool publish(const std::string &_topic, const std::string &_payload, int _qos, bool _retain, time_t _time);
+
+/* Number of queued messages (PSRAM + file) */
+int count();
+
+/* Called by the MQTT event handler for MQTT_EVENT_PUBLISHED */
+void published(int _msg_id);
+
+/* Moves the messages in PSRAM to the file, so they survive a reboot */
+void persist();
+
+}
+
+#endif //MQTT_BACKLOG_H
+#endif //ENABLE_MQTT
@@ -33,6 +33,7 @@ std::string rateUnit = "Unit/Minute";
 float roundInterval; // Minutes
 int keepAlive = 0; // Seconds
 bool retainFlag;
+bool publishCombined = false;
 static std::string maintopic, domoticzintopic;
 bool sendingOf_DiscoveryAndStaticTopics_scheduled = true; // Set it to true to make sure it gets sent at least once after startup
 
@@ -127,9 +128,11 @@ static bool sendHomeAssistantDiscoveryUpdateEntity(int qos)
     return MQTTPublish(topicFull, payload, qos, true);
 }
 
+/* _numberName is only set for the fields of a number in the "combined" publish mode,
+ * Homeassistant then takes the field from the per-round message with a value template */
 bool sendHomeAssistantDiscoveryTopic(std::string group, std::string field,
     std::string name, std::string icon, std::string unit, std::string deviceClass, std::string stateClass, std::string entityCategory,
-    int qos) {
+    int qos, std::string _numberName = "") {
     std::string version = std::string(libfive_git_version());
 
     if (version == "") {
@@ -180,7 +183,21 @@ bool sendHomeAssistantDiscoveryTopic(std::string group, std::string field,
         "\"name\": \"" + name + "\","  +
         "\"icon\": \"mdi:" + icon + "\",";        
 
-    if (group != "") {
+    if (_numberName != "") {
+        std::string number = "value_json['" + _numberName + "']";
+        payload += "\"state_topic\": \"~/" MQTT_COMBINED_TOPIC "\",";
+
+        if (field == "problem") { // Special case: Binary sensor which is based on the error field
+            payload += "\"value_template\": \"{{ 'OFF' if 'no error' in " + number + ".error else 'ON'}}\",";
+        }
+        else if (field == "json") {
+            payload += "\"value_template\": \"{{ " + number + " | tojson }}\",";
+        }
+        else {
+            payload += "\"value_template\": \"{{ " + number + "." + field + " }}\",";
+        }
+    }
+    else if (group != "") {
         if (field == "problem") { // Special case: Binary sensor which is based on error topic
             payload += "\"state_topic\": \"~/" + group + "/error\",";
             payload += "\"value_template\": \"{{ 'OFF' if 'no error' in value else 'ON'}}\",";
@@ -289,27 +306,28 @@ bool MQTThomeassistantDiscovery(int qos) {
             rate_device_class = "power";
         }
 
-    //                                                       Group   | Field                       | User Friendly Name                    | Icon                       | Unit                 | Device Class     | State Class       | Entity Category | QoS
-        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "value",                      "Value",                                "gauge",                     valueUnit,             meterType,         value_state_class,  "",               qos); // State Class = "total_increasing" if <NUMBERS>.AllowNegativeRates = false, "measurement" in case of a thermometer, else use "total".
-        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "raw",                        "Raw Value",                            "raw",                       valueUnit,             meterType,         value_state_class,  "diagnostic",     qos);
-        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "error",                      "Error",                                "alert-circle-outline",      "",                    "",                "",                 "diagnostic",     qos);
+        std::string n = publishCombined ? (*NUMBERS)[i]->name : ""; // Key of the number in the combined message, else every field has its own topic
+
+    //                                                       Group   | Field                       | User Friendly Name                    | Icon                       | Unit                 | Device Class     | State Class       | Entity Category | QoS | Combined
+        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "value",                      "Value",                                "gauge",                     valueUnit,             meterType,         value_state_class,  "",               qos, n); // State Class = "total_increasing" if <NUMBERS>.AllowNegativeRates = false, "measurement" in case of a thermometer, else use "total".
+        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "raw",                        "Raw Value",                            "raw",                       valueUnit,             meterType,         value_state_class,  "diagnostic",     qos, n);
+        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "error",                      "Error",                                "alert-circle-outline",      "",                    "",                "",                 "diagnostic",     qos, n);
         /* Not announcing "rate" as it is better to use rate_per_time_unit resp. rate_per_digitization_round */
-     // allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "rate",                       "Rate (Unit/Minute)",                   "swap-vertical",             "",                    "",                "",                 "",               qos); // Legacy, always Unit per Minute
-        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "rate_per_time_unit",         "Rate (" + rateUnit + ")",              "swap-vertical",             rateUnit,              rate_device_class, "measurement",      "",               qos);
-        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "rate_per_digitization_round","Change since last Digitization round", "arrow-expand-vertical",     valueUnit,             "",                "measurement",      "",               qos); // correctly the Unit is Unit/Interval!
-        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "timestamp",                  "Timestamp",                            "clock-time-eight-outline",  "",                    "timestamp",       "",                 "diagnostic",     qos);
-        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "json",                       "JSON",                                 "code-json",                 "",                    "",                "",                 "diagnostic",     qos);
-        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "problem",                    "Problem",                              "alert-outline",             "",                    "problem",         "",                 "",               qos); // Special binary sensor which is based on error topic
+     // allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "rate",                       "Rate (Unit/Minute)",                   "swap-vertical",             "",                    "",                "",                 "",               qos, n); // Legacy, always Unit per Minute
+        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "rate_per_time_unit",         "Rate (" + rateUnit + ")",              "swap-vertical",             rateUnit,              rate_device_class, "measurement",      "",               qos, n);
+        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "rate_per_digitization_round","Change since last Digitization round", "arrow-expand-vertical",     valueUnit,             "",                "measurement",      "",               qos, n); // correctly the Unit is Unit/Interval!
+        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "timestamp",                  "Timestamp",                            "clock-time-eight-outline",  "",                    "timestamp",       "",                 "diagnostic",     qos, n);
+        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "json",                       "JSON",                                 "code-json",                 "",                    "",                "",                 "diagnostic",     qos, n);
+        allSendsSuccessed |= sendHomeAssistantDiscoveryTopic(group,   "problem",                    "Problem",                              "alert-outline",             "",                    "problem",         "",                 "",               qos, n); // Special binary sensor which is based on error topic
     }
 
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Successfully published all Homeassistant Discovery MQTT topics");
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Successfully published all Homeassistant Discovery MQTT topics");
 
     int aFreeInternalHeapSizeAfter = heap_caps_get_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
     int aMinFreeInternalHeapSize =  heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
 
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Int. Heap Usage before Publishing Homeassistand Discovery Topics: " + 
-            to_string(aFreeInternalHeapSizeBefore) + ", after: " + to_string(aFreeInternalHeapSizeAfter) + ", delta: " + 
-            to_string(aFreeInternalHeapSizeBefore - aFreeInternalHeapSizeAfter) + ", lowest free: " + to_string(aMinFreeInternalHeapSize));
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Int. Heap Usage before Publishing Homeassistand Discovery Topics: %d, after: %d, delta: %d, lowest free: %d",
+                  aFreeInternalHeapSizeBefore, aFreeInternalHeapSizeAfter, aFreeInternalHeapSizeBefore - aFreeInternalHeapSizeAfter, aMinFreeInternalHeapSize);
 
     return allSendsSuccessed;
 }
@@ -324,7 +342,7 @@ bool publishSystemData(int qos) {
 
     char tmp_char[50];
 
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Publishing System MQTT topics...");
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Publishing System MQTT topics...");
 
 	int aFreeInternalHeapSizeBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
 
@@ -342,14 +360,13 @@ bool publishSystemData(int qos) {
     sprintf(tmp_char, "%d", (int)temperatureRead());
     allSendsSuccessed |= MQTTPublish(maintopic + "/" + "CPUtemp", std::string(tmp_char), qos, retainFlag);
 
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Successfully published all System MQTT topics");
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Successfully published all System MQTT topics");
 
 	int aFreeInternalHeapSizeAfter = heap_caps_get_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
 	int aMinFreeInternalHeapSize =  heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
 
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Int. Heap Usage before publishing System Topics: " + 
-            to_string(aFreeInternalHeapSizeBefore) + ", after: " + to_string(aFreeInternalHeapSizeAfter) + ", delta: " + 
-            to_string(aFreeInternalHeapSizeBefore - aFreeInternalHeapSizeAfter) + ", lowest free: " + to_string(aMinFreeInternalHeapSize));
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Int. Heap Usage before publishing System Topics: %d, after: %d, delta: %d, lowest free: %d",
+                  aFreeInternalHeapSizeBefore, aFreeInternalHeapSizeAfter, aFreeInternalHeapSizeBefore - aFreeInternalHeapSizeAfter, aMinFreeInternalHeapSize);
 
     return allSendsSuccessed;
 }
@@ -363,7 +380,7 @@ bool publishStaticData(int qos) {
         return false;
     }
 
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Publishing static MQTT topics...");
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Publishing static MQTT topics...");
 
 	int aFreeInternalHeapSizeBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
 
@@ -376,14 +393,13 @@ bool publishStaticData(int qos) {
     snprintf(interval_buf, sizeof(interval_buf), "%.1f", (double)roundInterval); // minutes
     allSendsSuccessed |= MQTTPublish(maintopic + "/" + "interval", interval_buf, qos, retainFlag);
 
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Successfully published all Static MQTT topics");
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Successfully published all Static MQTT topics");
 
 	int aFreeInternalHeapSizeAfter = heap_caps_get_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
 	int aMinFreeInternalHeapSize =  heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
 
-    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Int. Heap Usage before Publishing Static Topics: " + 
-            to_string(aFreeInternalHeapSizeBefore) + ", after: " + to_string(aFreeInternalHeapSizeAfter) + ", delta: " + 
-            to_string(aFreeInternalHeapSizeBefore - aFreeInternalHeapSizeAfter) + ", lowest free: " + to_string(aMinFreeInternalHeapSize));
+    LOGFILE_WRITE(ESP_LOG_DEBUG, TAG, "Int. Heap Usage before Publishing Static Topics: %d, after: %d, delta: %d, lowest free: %d",
+                  aFreeInternalHeapSizeBefore, aFreeInternalHeapSizeAfter, aFreeInternalHeapSizeBefore - aFreeInternalHeapSizeAfter, aMinFreeInternalHeapSize);
 
     return allSendsSuccessed;
 }
@@ -452,6 +468,10 @@ void setMqtt_Server_Retain(bool _retainFlag) {
     retainFlag = _retainFlag;
 }
 
+void mqttServer_setPublishCombined(bool _publishCombined) {
+    publishCombined = _publishCombined;
+}
+
 void mqttServer_setMainTopic( std::string _maintopic) {
     maintopic = _maintopic;
 }
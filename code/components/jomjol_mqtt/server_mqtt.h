@@ -11,6 +11,7 @@ void SetHomeassistantDiscoveryEnabled(bool enabled);
 void mqttServer_setParameter(std::vector<NumberPost*>* _NUMBERS, int interval, float roundInterval);
 void mqttServer_setMeterType(std::string meterType, std::string valueUnit, std::string timeUnit,std::string rateUnit);
 void setMqtt_Server_Retain(bool SetRetainFlag);
+void mqttServer_setPublishCombined(bool _publishCombined);
 void mqttServer_setMainTopic( std::string maintopic);
 void mqttServer_setDmoticzInTopic( std::string domoticzintopic);
 
@@ -1,7 +1,10 @@
 #include "CTfLiteClass.h"
+#include "tensor_fill.h"
 #include "ClassLogFile.h"
 #include "Helper.h"
 #include "psram.h"
+#include "model_store.h"
+#include "roi_workers.h"
 #include "esp_log.h"
 #include "../../include/defines.h"
 
@@ -9,6 +12,10 @@
 #include <miniz.h>
 #include <stdint.h>
 #include <string.h>
+#include <vector>
+#include <atomic>
+
+#include "mbedtls/sha256.h"
 
 // #define DEBUG_DETAIL_ON
 
@@ -89,18 +96,159 @@ static bool gzip_get_isize(FILE *f, long file_size, uint32_t &out_isize)
 }
 
 
+static void AddStaticResolverOps(tflite::MicroMutableOpResolver<10> &_resolver)
+{
+  _resolver.AddFullyConnected();
+  _resolver.AddReshape();
+  _resolver.AddSoftmax();
+  _resolver.AddConv2D();
+  _resolver.AddMaxPool2D();
+  _resolver.AddQuantize();
+  _resolver.AddMul();
+  _resolver.AddAdd();
+  _resolver.AddLeakyRelu();
+  _resolver.AddDequantize();
+}
+
+
 void CTfLiteClass::MakeStaticResolver()
 {
-  resolver.AddFullyConnected();
-  resolver.AddReshape();
-  resolver.AddSoftmax();
-  resolver.AddConv2D();
-  resolver.AddMaxPool2D();
-  resolver.AddQuantize();
-  resolver.AddMul();
-  resolver.AddAdd();
-  resolver.AddLeakyRelu();
-  resolver.AddDequantize();
+  AddStaticResolverOps(resolver);
+}
+
+
+
+/*******************************************************************
+ * Model cache
+ * Keeps model flatbuffer, tensor arena and interpreter of the used
+ * models in dedicated PSRAM buffers, so a flow round does not need
+ * to re-read (and inflate) the model and re-allocate the tensors.
+ * Only used if there is enough PSRAM left, otherwise the model gets
+ * loaded into the shared PSRAM region on every round (old behaviour).
+ * Models mapped from the model store (model_store.h) stay in flash,
+ * only their tensor arena gets a PSRAM buffer.
+ *******************************************************************/
+static std::vector<TfLiteModelCacheEntry*> modelCache;
+static uint32_t modelCacheUseCounter = 0;
+
+
+static TfLiteModelCacheEntry* FindCacheEntry(const std::string &_fn)
+{
+    for (int i = 0; i < modelCache.size(); ++i) {
+        if (modelCache[i]->filename == _fn) {
+            return modelCache[i];
+        }
+    }
+    return NULL;
+}
+
+
+static void ReleaseWorkerInterpreter(TfLiteModelCacheEntry *_entry)
+{
+    delete _entry->worker_interpreter;
+    _entry->worker_interpreter = NULL;
+
+    if (_entry->worker_arena) {
+        free_psram_heap(std::string(TAG) + "->worker tensor arena", _entry->worker_arena);
+        _entry->worker_arena = NULL;
+    }
+}
+
+
+static void ReleaseCacheEntry(TfLiteModelCacheEntry *_entry)
+{
+    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Release resident model " + _entry->filename);
+
+    for (int i = 0; i < modelCache.size(); ++i) {
+        if (modelCache[i] == _entry) {
+            modelCache.erase(modelCache.begin() + i);
+            break;
+        }
+    }
+
+    ReleaseWorkerInterpreter(_entry);
+    delete _entry->interpreter;
+    delete _entry->resolver;
+    if (_entry->tensor_arena) {
+        free_psram_heap(std::string(TAG) + "->resident tensor arena", _entry->tensor_arena);
+    }
+    if (_entry->model_mapped) {
+        model_store::release(_entry->modelfile);
+    }
+    else if (_entry->modelfile) {
+        free_psram_heap(std::string(TAG) + "->resident model", _entry->modelfile);
+    }
+    delete _entry;
+}
+
+
+/* Drop the least recently used entry which is currently not in use, returns false if there is none */
+static bool EvictCacheEntry(void)
+{
+    TfLiteModelCacheEntry *lru = NULL;
+
+    for (int i = 0; i < modelCache.size(); ++i) {
+        if (!modelCache[i]->in_use && ((lru == NULL) || (modelCache[i]->last_used < lru->last_used))) {
+            lru = modelCache[i];
+        }
+    }
+
+    if (lru == NULL) {
+        return false;
+    }
+
+    ReleaseCacheEntry(lru);
+    return true;
+}
+
+
+static bool PsramAvailableForCache(size_t _model_size, size_t _arena_size)
+{
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    size_t total = heap_caps_get_free_size(MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+
+    return (largest >= std::max(_model_size, _arena_size)) && 
+           (total >= _model_size + _arena_size + TFLITE_MODEL_CACHE_PSRAM_RESERVE);
+}
+
+
+/* Output value as stored in the tensor. For quantized models this is the raw (not dequantized) value,
+ * which is sufficient to compare the outputs, as the scale is always positive. */
+static float OutputRawValue(const TfLiteTensor *_output, int _nr)
+{
+    switch (_output->type) {
+        case kTfLiteInt8:
+            return (float)_output->data.int8[_nr];
+        case kTfLiteUInt8:
+            return (float)_output->data.uint8[_nr];
+        default:
+            return _output->data.f[_nr];
+    }
+}
+
+
+static float OutputValue(const TfLiteTensor *_output, int _nr)
+{
+    if ((_output->type == kTfLiteInt8) || (_output->type == kTfLiteUInt8)) {
+        return (OutputRawValue(_output, _nr) - _output->params.zero_point) * _output->params.scale;
+    }
+
+    return _output->data.f[_nr];
+}
+
+
+static std::string TensorTypeName(const TfLiteTensor *_tensor)
+{
+    switch (_tensor->type) {
+        case kTfLiteFloat32:
+            return "float32";
+        case kTfLiteInt8:
+            return "int8";
+        case kTfLiteUInt8:
+            return "uint8";
+        default:
+            return "type " + std::to_string((int)_tensor->type);
+    }
 }
 
 
@@ -112,7 +260,7 @@ float CTfLiteClass::GetOutputValue(int nr)
     if ((nr+1) > numeroutput)
       return -1000;
 
-    return output2->data.f[nr];
+    return OutputValue(output2, nr);
 }
 
 
@@ -153,11 +301,11 @@ int CTfLiteClass::GetOutClassification(int _von, int _bis)
     return -1;
   }
 
-  zw_max = output2->data.f[_von];
+  zw_max = OutputRawValue(output2, _von);
   zw_class = _von;
   for (int i = _von + 1; i <= _bis; ++i)
   {
-    zw = output2->data.f[i];
+    zw = OutputRawValue(output2, i);
     if (zw > zw_max)
     {
         zw_max = zw;
@@ -221,7 +369,7 @@ int CTfLiteClass::GetAnzOutPut(bool silent)
   int numeroutput = output2->dims->data[1];
   for (int i = 0; i < numeroutput; ++i)
   {
-   fo = output2->data.f[i];
+   fo = OutputValue(output2, i);
     if (!silent) ESP_LOGD(TAG, "Result %d: %f", i, fo);
   }
   return numeroutput;
@@ -235,33 +383,57 @@ void CTfLiteClass::Invoke()
 }
 
 
+void CTfLiteClass::UpdateQuantLut(TfLiteTensor *_input)
+{
+    if ((_input->params.scale != quant_lut_scale) || (_input->params.zero_point != quant_lut_zero_point)) {
+        tensor_fill::build_quant_lut(quant_lut, _input->params.scale, _input->params.zero_point, _input->type == kTfLiteInt8);
+        quant_lut_scale = _input->params.scale;
+        quant_lut_zero_point = _input->params.zero_point;
+    }
+}
+
+
+bool CTfLiteClass::FillInputTensor(TfLiteTensor *_input, int _offset, CImageBasis *rs)
+{
+    if ((rs->rgb_image == NULL) || (rs->channels != 3)) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "FillInputTensor: Image is not an RGB image");
+        return false;
+    }
+
+    // The image buffer is stored row-major RGB without padding, same layout as the input tensor (HWC)
+    size_t count = (size_t)rs->width * rs->height * rs->channels;
+
+    switch (_input->type) {
+        case kTfLiteFloat32:
+            tensor_fill::to_float(_input->data.f + _offset, rs->rgb_image, count);
+            break;
+
+        case kTfLiteInt8:
+        case kTfLiteUInt8:
+            // Quantize the pixels directly, so a fully quantized model runs without a float Quantize op in front
+            UpdateQuantLut(_input);
+            tensor_fill::to_quantized(_input->data.uint8 + _offset, rs->rgb_image, count, quant_lut);
+            break;
+
+        default:
+            LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "FillInputTensor: Unsupported input tensor type (" + TensorTypeName(_input) + ")");
+            return false;
+    }
+
+    return true;
+}
+
+
 bool CTfLiteClass::LoadInputImageBasis(CImageBasis *rs)
 {
     #ifdef DEBUG_DETAIL_ON 
         LogFile.WriteHeapInfo("CTfLiteClass::LoadInputImageBasis - Start");
     #endif
 
-    unsigned int w = rs->width;
-    unsigned int h = rs->height;
-    unsigned char red, green, blue;
-//    ESP_LOGD(TAG, "Image: %s size: %d x %d\n", _fn.c_str(), w, h);
-
     input_i = 0;
-    float* input_data_ptr = (interpreter->input(0))->data.f;
-
-    for (int y = 0; y < h; ++y)
-        for (int x = 0; x < w; ++x)
-            {
-                red = rs->GetPixelColor(x, y, 0);
-                green = rs->GetPixelColor(x, y, 1);
-                blue = rs->GetPixelColor(x, y, 2);
-                *(input_data_ptr) = (float) red;
-                input_data_ptr++;
-                *(input_data_ptr) = (float) green;
-                input_data_ptr++;
-                *(input_data_ptr) = (float) blue;
-                input_data_ptr++;
-            }
+    if (!FillInputTensor(interpreter->input(0), 0, rs)) {
+        return false;
+    }
 
     #ifdef DEBUG_DETAIL_ON 
         LogFile.WriteHeapInfo("CTfLiteClass::LoadInputImageBasis - done");
@@ -271,9 +443,152 @@ bool CTfLiteClass::LoadInputImageBasis(CImageBasis *rs)
 }
 
 
+/* Runs _count images starting at _start through _interpreter (one Invoke() per batch) and stores their
+ * outputs at the same index in _outputs */
+bool CTfLiteClass::InvokeChunk(tflite::MicroInterpreter *_interpreter, std::vector<CImageBasis*> &_images, int _start, int _count,
+                               std::vector<std::vector<float>> &_outputs)
+{
+    TfLiteTensor* input_tensor = _interpreter->input(0);
+    TfLiteTensor* output_tensor = _interpreter->output(0);
+
+    int input_size = input_tensor->dims->data[1] * input_tensor->dims->data[2] * input_tensor->dims->data[3];
+    int numeroutput = output_tensor->dims->data[1];
+
+    for (int i = 0; i < _count; ++i) {
+        CImageBasis *rs = _images[_start + i];
+        if ((rs->width * rs->height * 3) != input_size) {
+            LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "InvokeBatch: Image size does not fit the model input");
+            return false;
+        }
+        if (!FillInputTensor(input_tensor, i * input_size, rs)) {
+            return false;
+        }
+    }
+
+    if (_interpreter->Invoke() != kTfLiteOk) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "InvokeBatch: Invoke() failed");
+        return false;
+    }
+
+    for (int i = 0; i < _count; ++i) {
+        std::vector<float> &out = _outputs[_start + i];
+
+        if (output_tensor->type == kTfLiteFloat32) {
+            const float *data = output_tensor->data.f + i * numeroutput;
+            out.assign(data, data + numeroutput);
+        }
+        else {
+            out.resize(numeroutput);
+            for (int j = 0; j < numeroutput; ++j) {
+                out[j] = OutputValue(output_tensor, i * numeroutput + j);
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/* Runs all images through the model and returns the output vector of each image.
+ * Input and output tensor get resolved only once. If the model has a batch dimension > 1,
+ * several images are processed with one Invoke().
+ * With _parallel the batches get shared with the ROI worker task (see roi_workers.h), which uses a second
+ * interpreter of the resident model. Without one (not resident, not enough PSRAM) everything runs here. */
+bool CTfLiteClass::InvokeBatch(std::vector<CImageBasis*> &_images, std::vector<std::vector<float>> &_outputs, bool _parallel)
+{
+    _outputs.clear();
+
+    if (interpreter == nullptr) {
+        return false;
+    }
+
+    TfLiteTensor* input_tensor = interpreter->input(0);
+    TfLiteTensor* output_tensor = interpreter->output(0);
+
+    if ((input_tensor == NULL) || (output_tensor == NULL) || (input_tensor->dims->size < 4)) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "InvokeBatch: Unexpected input/output tensor");
+        return false;
+    }
+
+    int batchsize = std::max(1, input_tensor->dims->data[0]);
+    int batches = (_images.size() + batchsize - 1) / batchsize;
+
+    _outputs.resize(_images.size());
+
+    tflite::MicroInterpreter *interpreters[2] = {interpreter, NULL};
+    if (_parallel && (batches > 1)) {
+        interpreters[1] = GetWorkerInterpreter();
+    }
+
+    if (interpreters[1] == NULL) {
+        for (int start = 0; start < _images.size(); start += batchsize) {
+            if (!InvokeChunk(interpreter, _images, start, std::min(batchsize, (int)_images.size() - start), _outputs)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Both interpreters have the same input quantization, the LUT gets only read from here on
+    if ((input_tensor->type == kTfLiteInt8) || (input_tensor->type == kTfLiteUInt8)) {
+        UpdateQuantLut(input_tensor);
+    }
+
+    std::atomic<bool> success(true);
+
+    roi_workers::run(batches, [&](int _batch, int _worker) {
+        int start = _batch * batchsize;
+        if (!InvokeChunk(interpreters[_worker], _images, start, std::min(batchsize, (int)_images.size() - start), _outputs)) {
+            success = false;
+        }
+    });
+
+    return success;
+}
+
+
+int CTfLiteClass::GetClassification(const std::vector<float> &_output, int _von, int _bis)
+{
+  int numeroutput = _output.size();
+
+  if (_bis == -1)
+    _bis = numeroutput -1;
+
+  if (_von == -1)
+    _von = 0;
+
+  if ((_bis >= numeroutput) || (numeroutput == 0))
+  {
+    ESP_LOGD(TAG, "NUMBER OF OUTPUT NEURONS does not match required classification!");
+    return -1;
+  }
+
+  float zw_max = _output[_von];
+  int zw_class = _von;
+  for (int i = _von + 1; i <= _bis; ++i)
+  {
+    if (_output[i] > zw_max)
+    {
+        zw_max = _output[i];
+        zw_class = i;
+    }
+  }
+  return (zw_class - _von);
+}
+
+
 
 bool CTfLiteClass::MakeAllocate()
 {
+    if (this->tensor_arena == NULL) {
+        this->tensor_arena = (uint8_t*)psram_get_shared_tensor_arena_memory();
+        if (this->tensor_arena == NULL) {
+            LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "CTfLiteClass::MakeAllocate: Tensor arena not available");
+            return false;
+        }
+        uses_shared_memory = true;
+    }
+
     MakeStaticResolver();
 
     #ifdef DEBUG_DETAIL_ON 
@@ -293,6 +608,10 @@ bool CTfLiteClass::MakeAllocate()
             this->GetInputDimension();   
             return false;
         }
+
+        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Model input: " + TensorTypeName(this->interpreter->input(0)) + 
+                                                ", output: " + TensorTypeName(this->interpreter->output(0)) + 
+                                                ", tensor arena used: " + std::to_string(this->interpreter->arena_used_bytes()) + " bytes");
     }
     else 
     {
@@ -382,6 +701,9 @@ bool CTfLiteClass::ReadFileToModel(std::string _fn)
   
     if (modelfile != NULL)
     {
+        uses_shared_memory = true;
+        modelfile_size = expected_size;
+
         FILE *pFile = fopen(_fn.c_str(), "rb"); // previously only "rb
     
         if (pFile != NULL)
@@ -509,8 +831,22 @@ bool CTfLiteClass::LoadModel(std::string _fn)
 {
     LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "CTfLiteClass::LoadModel");
 
-    if (!ReadFileToModel(_fn.c_str())) {
-      return false;
+    // Map the model directly from flash if it is in the model store
+    const uint8_t *stored = model_store::get(_fn, &modelfile_size);
+
+    if (stored == NULL) {
+        if (!ReadFileToModel(_fn.c_str())) {
+            return false;
+        }
+
+        // Store it once, the next loads map it from flash
+        stored = model_store::install(_fn, modelfile, modelfile_size);
+    }
+
+    if (stored != NULL) {
+        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Using model " + _fn + " mapped from flash");
+        modelfile = (unsigned char*)stored; // read-only
+        uses_model_store = true;
     }
 
     model = tflite::GetModel(modelfile);
@@ -522,6 +858,208 @@ bool CTfLiteClass::LoadModel(std::string _fn)
 }
 
 
+/* Loads the model and allocates the tensors, using the resident copy from the model cache if the
+ * model file did not change since it was loaded. After a cold load the model gets copied into the
+ * cache if there is enough PSRAM, so the next round can skip reading the model file. */
+bool CTfLiteClass::LoadModelCached(std::string _fn)
+{
+    struct stat stat_buf;
+
+    if (stat(_fn.c_str(), &stat_buf) != 0) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Model file doesn't exist: " + _fn + "!");
+        return false;
+    }
+
+    TfLiteModelCacheEntry *entry = FindCacheEntry(_fn);
+
+    if ((entry != NULL) && !entry->in_use && 
+        (entry->file_size == (long)stat_buf.st_size) && (entry->file_mtime == stat_buf.st_mtime)) 
+    {
+        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Using resident model " + _fn);
+
+        entry->in_use = true;
+        entry->last_used = ++modelCacheUseCounter;
+        cache_entry = entry;
+        modelfile = entry->modelfile;
+        modelfile_size = entry->model_size;
+        model = tflite::GetModel(modelfile);
+        interpreter = entry->interpreter;
+        return true;
+    }
+
+    if (!LoadModel(_fn) || !MakeAllocate()) {
+        return false;
+    }
+
+    if ((entry != NULL) && entry->in_use) { // Resident copy is busy (e.g. single step from web UI), use the loaded one
+        return true;
+    }
+
+    if (!MakeResident(_fn, (long)stat_buf.st_size, stat_buf.st_mtime)) {
+        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Model " + _fn + " not kept resident, it gets reloaded next round");
+    }
+
+    return true;
+}
+
+
+/* Move the model which is currently loaded in the shared PSRAM region into the model cache */
+bool CTfLiteClass::MakeResident(std::string _fn, long _file_size, time_t _file_mtime)
+{
+    uint8_t digest[32];
+
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    mbedtls_sha256_update(&sha, modelfile, (size_t)modelfile_size);
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
+
+    TfLiteModelCacheEntry *entry = FindCacheEntry(_fn);
+
+    if ((entry != NULL) && (entry->model_size == modelfile_size) && (memcmp(entry->sha256, digest, sizeof(digest)) == 0)) {
+        // File got rewritten, but the content is the same -> keep the resident copy
+        entry->file_size = _file_size;
+        entry->file_mtime = _file_mtime;
+    }
+    else {
+        if (entry != NULL) {
+            LogFile.WriteToFile(ESP_LOG_INFO, TAG, "Model file " + _fn + " changed, replacing resident copy");
+            ReleaseCacheEntry(entry);
+        }
+
+        size_t arena_size = interpreter->arena_used_bytes() + TFLITE_ARENA_HEADROOM;
+        long psram_model_size = uses_model_store ? 0 : modelfile_size; // A mapped model stays in flash
+
+        // The worker arenas are the first to go if PSRAM gets tight, the inference falls back to one core
+        for (int i = 0; (i < modelCache.size()) && !PsramAvailableForCache(psram_model_size, arena_size); ++i) {
+            if (!modelCache[i]->in_use && (modelCache[i]->worker_interpreter != NULL)) {
+                ReleaseWorkerInterpreter(modelCache[i]);
+                modelCache[i]->worker_failed = true;
+            }
+        }
+
+        while ((modelCache.size() >= TFLITE_MODEL_CACHE_ENTRIES) || 
+               (!PsramAvailableForCache(psram_model_size, arena_size) && (modelCache.size() > 0)))
+        {
+            if (!EvictCacheEntry()) {
+                break;
+            }
+        }
+
+        if ((modelCache.size() >= TFLITE_MODEL_CACHE_ENTRIES) || !PsramAvailableForCache(psram_model_size, arena_size)) {
+            return false;
+        }
+
+        entry = new TfLiteModelCacheEntry;
+        entry->filename = _fn;
+        entry->file_size = _file_size;
+        entry->file_mtime = _file_mtime;
+        memcpy(entry->sha256, digest, sizeof(digest));
+        entry->model_size = modelfile_size;
+        entry->arena_size = arena_size;
+
+        if (uses_model_store) { // The entry gets its own mapping
+            long mapped_size;
+            entry->modelfile = (unsigned char*)model_store::get(_fn, &mapped_size);
+            entry->model_mapped = (entry->modelfile != NULL);
+        }
+        else {
+            entry->modelfile = (unsigned char*)malloc_psram_heap(std::string(TAG) + "->resident model", modelfile_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        }
+        entry->tensor_arena = (uint8_t*)malloc_psram_heap(std::string(TAG) + "->resident tensor arena", arena_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        modelCache.push_back(entry);
+
+        if ((entry->modelfile == NULL) || (entry->tensor_arena == NULL)) {
+            ReleaseCacheEntry(entry);
+            return false;
+        }
+
+        if (!entry->model_mapped) {
+            memcpy(entry->modelfile, modelfile, modelfile_size);
+        }
+
+        entry->resolver = new tflite::MicroMutableOpResolver<10>;
+        AddStaticResolverOps(*entry->resolver);
+        entry->interpreter = new tflite::MicroInterpreter(tflite::GetModel(entry->modelfile), *entry->resolver, 
+                                                          entry->tensor_arena, entry->arena_size);
+
+        if (entry->interpreter->AllocateTensors() != kTfLiteOk) {
+            LogFile.WriteToFile(ESP_LOG_WARN, TAG, "AllocateTensors() failed for resident model " + _fn);
+            ReleaseCacheEntry(entry);
+            return false;
+        }
+
+        LogFile.WriteToFile(ESP_LOG_INFO, TAG, "Model " + _fn + " is resident now (model: " + std::to_string(modelfile_size) + 
+                                               (entry->model_mapped ? " bytes in flash" : " bytes") + ", tensor arena: " + std::to_string(arena_size) + " bytes)");
+    }
+
+    // Switch over to the resident copy and give the shared PSRAM region free again
+    delete interpreter;
+    if (uses_model_store) {
+        model_store::release(modelfile);
+        uses_model_store = false;
+    }
+    psram_free_shared_tensor_arena_and_model_memory();
+    uses_shared_memory = false;
+    tensor_arena = NULL;
+
+    entry->in_use = true;
+    entry->last_used = ++modelCacheUseCounter;
+    cache_entry = entry;
+    modelfile = entry->modelfile;
+    model = tflite::GetModel(modelfile);
+    interpreter = entry->interpreter;
+
+    return true;
+}
+
+
+/* Second interpreter of the resident model for the ROI worker task, it shares the model (and resolver) but has
+ * its own tensor arena. NULL if the model is not resident or there is not enough PSRAM for a second arena. */
+tflite::MicroInterpreter* CTfLiteClass::GetWorkerInterpreter()
+{
+#if defined(CONFIG_IDF_TARGET_ESP32S3)
+    return NULL;    // The optimized esp-nn kernels share one scratch buffer, two interpreters can't run at the same time
+#else
+    if ((cache_entry == NULL) || cache_entry->worker_failed || !roi_workers::available()) {
+        return NULL;
+    }
+
+    if (cache_entry->worker_interpreter != NULL) {
+        return cache_entry->worker_interpreter;
+    }
+
+    cache_entry->worker_failed = true; // Only one try per resident model
+
+    if (!PsramAvailableForCache(0, cache_entry->arena_size)) {
+        LogFile.WriteToFile(ESP_LOG_INFO, TAG, "Not enough PSRAM for a second tensor arena, " + cache_entry->filename + " runs on one core");
+        return NULL;
+    }
+
+    cache_entry->worker_arena = (uint8_t*)malloc_psram_heap(std::string(TAG) + "->worker tensor arena", cache_entry->arena_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (cache_entry->worker_arena == NULL) {
+        return NULL;
+    }
+
+    cache_entry->worker_interpreter = new tflite::MicroInterpreter(tflite::GetModel(cache_entry->modelfile), *cache_entry->resolver,
+                                                                   cache_entry->worker_arena, cache_entry->arena_size);
+
+    if (cache_entry->worker_interpreter->AllocateTensors() != kTfLiteOk) {
+        LogFile.WriteToFile(ESP_LOG_WARN, TAG, "AllocateTensors() failed for the worker interpreter of " + cache_entry->filename);
+        ReleaseWorkerInterpreter(cache_entry);
+        return NULL;
+    }
+
+    cache_entry->worker_failed = false;
+    LogFile.WriteToFile(ESP_LOG_INFO, TAG, "Inference of " + cache_entry->filename + " runs on both cores (worker tensor arena: " +
+                                           std::to_string(cache_entry->arena_size) + " bytes)");
+
+    return cache_entry->worker_interpreter;
+#endif
+}
+
+
 CTfLiteClass::CTfLiteClass()
 {
     this->model = nullptr;
@@ -530,13 +1068,24 @@ CTfLiteClass::CTfLiteClass()
     this->input = nullptr;
     this->output = nullptr;
     this->kTensorArenaSize = TENSOR_ARENA_SIZE;
-    this->tensor_arena = (uint8_t*)psram_get_shared_tensor_arena_memory();
+    this->tensor_arena = NULL; // Taken from the shared PSRAM region on demand, see MakeAllocate()
 }
 
 
 CTfLiteClass::~CTfLiteClass()
 {
+  if (cache_entry != NULL) { // Interpreter is owned by the model cache
+      cache_entry->in_use = false;
+      return;
+  }
+
   delete this->interpreter;
 
-  psram_free_shared_tensor_arena_and_model_memory();
+  if (uses_model_store) {
+      model_store::release(modelfile);
+  }
+
+  if (uses_shared_memory) {
+      psram_free_shared_tensor_arena_and_model_memory();
+  }
 }        
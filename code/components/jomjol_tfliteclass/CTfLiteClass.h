@@ -12,6 +12,36 @@
 
 #include "CImageBasis.h"
 
+#include <sys/types.h>
+#include <vector>
+
+
+/* Model + interpreter which stay resident in PSRAM between flow rounds.
+ * The entries are owned by the model cache in CTfLiteClass.cpp, a CTfLiteClass only borrows one. */
+struct TfLiteModelCacheEntry
+{
+    std::string filename;
+    long file_size = -1;                // stat() fingerprint, used to detect a changed model file
+    time_t file_mtime = 0;
+    uint8_t sha256[32];                 // hash of the (decompressed) flatbuffer
+
+    unsigned char *modelfile = NULL;
+    long model_size = 0;
+    bool model_mapped = false;          // modelfile is mapped from the model store (flash), not in PSRAM
+    uint8_t *tensor_arena = NULL;
+    int arena_size = 0;
+
+    tflite::MicroMutableOpResolver<10> *resolver = NULL;    // must outlive the interpreter
+    tflite::MicroInterpreter *interpreter = NULL;
+
+    tflite::MicroInterpreter *worker_interpreter = NULL;    // Same model with its own arena, for the ROI worker task
+    uint8_t *worker_arena = NULL;
+    bool worker_failed = false;         // Not enough PSRAM for the worker arena, don't try again
+
+    bool in_use = false;
+    uint32_t last_used = 0;
+};
+
 
 class CTfLiteClass
 {
@@ -25,21 +55,37 @@ class CTfLiteClass
         uint8_t *tensor_arena;
 
         unsigned char *modelfile = NULL;
+        long modelfile_size = 0;
 
+        bool uses_shared_memory = false;
+        bool uses_model_store = false;      // modelfile is mapped from the model store (flash)
+        TfLiteModelCacheEntry *cache_entry = NULL;
 
         float* input;
         int input_i;
         int im_height, im_width, im_channel;
 
+        uint8_t quant_lut[256];             // uint8 pixel -> quantized input value, for int8/uint8 models
+        float quant_lut_scale = 0;
+        int quant_lut_zero_point = 0;
+
+        void UpdateQuantLut(TfLiteTensor *_input);
+        bool FillInputTensor(TfLiteTensor *_input, int _offset, CImageBasis *rs);
+        bool InvokeChunk(tflite::MicroInterpreter *_interpreter, std::vector<CImageBasis*> &_images, int _start, int _count,
+                         std::vector<std::vector<float>> &_outputs);
+        tflite::MicroInterpreter* GetWorkerInterpreter();
         long GetFileSize(std::string filename);
         bool ReadFileToModel(std::string _fn);
         void MakeStaticResolver();
+        bool MakeResident(std::string _fn, long _file_size, time_t _file_mtime);
 
     public:
         CTfLiteClass();
         ~CTfLiteClass();        
         bool LoadModel(std::string _fn);
         bool MakeAllocate();
+        bool LoadModelCached(std::string _fn);
+        bool IsResident(){return cache_entry != NULL;};
         void GetInputTensorSize();
         bool LoadInputImageBasis(CImageBasis *rs);
         void Invoke();
@@ -47,6 +93,8 @@ class CTfLiteClass
         int GetOutClassification(int _von = -1, int _bis = -1);
 
         int GetClassFromImageBasis(CImageBasis *rs);
+        bool InvokeBatch(std::vector<CImageBasis*> &_images, std::vector<std::vector<float>> &_outputs, bool _parallel = false);
+        static int GetClassification(const std::vector<float> &_output, int _von = -1, int _bis = -1);
         std::string GetStatusFlow();
 
         float GetOutputValue(int nr);
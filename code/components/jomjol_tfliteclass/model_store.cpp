@@ -0,0 +1,397 @@
+#include "model_store.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "mbedtls/sha256.h"
+
+#include "ClassLogFile.h"
+#include "../../include/defines.h"
+
+static const char *TAG = "MODEL_STORE";
+
+namespace model_store {
+
+#define STORE_MAGIC 0x4c444d41          // "AMDL"
+#define STORE_SECTOR_SIZE 4096          // Erase size, the directory uses the 1st sector
+#define STORE_MAX_PATH 128
+
+struct Entry {
+    char filename[STORE_MAX_PATH];      // Empty = unused
+    uint32_t offset;
+    uint32_t size;
+    int64_t file_mtime;                 // Fingerprint of the model file the copy was made from
+    int32_t file_size;
+    uint32_t installed;                 // Install counter, the oldest copies get replaced first
+    uint8_t sha256[32];
+};
+
+struct Directory {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t install_counter;
+    Entry entries[MODEL_STORE_MAX_ENTRIES];
+};
+
+/* Runtime state of an entry, not stored */
+struct Mapping {
+    const uint8_t *ptr;
+    esp_partition_mmap_handle_t handle;
+    int refs;
+    bool verified;                      // Content checked against the SHA-256 since boot
+};
+
+static SemaphoreHandle_t mutex_handle = NULL;
+static const esp_partition_t *partition = NULL;
+static Directory *directory = NULL;
+static Mapping mappings[MODEL_STORE_MAX_ENTRIES];
+static bool initialized = false;
+
+
+static void sha256(const uint8_t *_data, size_t _size, uint8_t *_digest)
+{
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    mbedtls_sha256_update(&sha, _data, _size);
+    mbedtls_sha256_finish(&sha, _digest);
+    mbedtls_sha256_free(&sha);
+}
+
+
+static bool save_directory()
+{
+    esp_err_t err = esp_partition_erase_range(partition, 0, STORE_SECTOR_SIZE);
+    if (err == ESP_OK) {
+        err = esp_partition_write(partition, 0, directory, sizeof(Directory));
+    }
+
+    if (err != ESP_OK) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to write the model store directory (" + std::string(esp_err_to_name(err)) + ")");
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool init()
+{
+    if (initialized) {
+        return (partition != NULL);
+    }
+    initialized = true;
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, MODEL_STORE_PARTITION_LABEL);
+    if (partition == NULL) {
+        LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "No '" MODEL_STORE_PARTITION_LABEL "' partition, models get loaded into PSRAM");
+        return false;
+    }
+
+    mutex_handle = xSemaphoreCreateMutex();
+    directory = (Directory *)calloc(1, sizeof(Directory));
+
+    if ((mutex_handle == NULL) || (directory == NULL) ||
+        (esp_partition_read(partition, 0, directory, sizeof(Directory)) != ESP_OK)) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to initialize the model store");
+        partition = NULL;
+        return false;
+    }
+
+    if ((directory->magic != STORE_MAGIC) || (directory->count != MODEL_STORE_MAX_ENTRIES)) {
+        LogFile.WriteToFile(ESP_LOG_INFO, TAG, "Initializing the model store (" + std::to_string(partition->size / 1024) + " KB)");
+        memset(directory, 0, sizeof(Directory));
+        directory->magic = STORE_MAGIC;
+        directory->count = MODEL_STORE_MAX_ENTRIES;
+        save_directory();
+    }
+
+    memset(mappings, 0, sizeof(mappings));
+
+    return true;
+}
+
+
+static int find(const std::string &_fn)
+{
+    for (int i = 0; i < MODEL_STORE_MAX_ENTRIES; ++i) {
+        if (directory->entries[i].filename[0] && (_fn == directory->entries[i].filename)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+static bool map(int _index)
+{
+    Entry &entry = directory->entries[_index];
+    Mapping &mapping = mappings[_index];
+
+    if (mapping.refs > 0) {
+        mapping.refs++;
+        return true;
+    }
+
+    const void *ptr;
+    esp_err_t err = esp_partition_mmap(partition, entry.offset, entry.size, ESP_PARTITION_MMAP_DATA, &ptr, &mapping.handle);
+    if (err != ESP_OK) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to map " + std::string(entry.filename) + " (" + esp_err_to_name(err) + ")");
+        return false;
+    }
+    mapping.ptr = (const uint8_t *)ptr;
+
+    if (!mapping.verified) {
+        uint8_t digest[32];
+        sha256(mapping.ptr, entry.size, digest);
+
+        if (memcmp(digest, entry.sha256, sizeof(digest)) != 0) {
+            LogFile.WriteToFile(ESP_LOG_WARN, TAG, "Stored copy of " + std::string(entry.filename) + " is corrupted, dropping it");
+            esp_partition_munmap(mapping.handle);
+            mapping.ptr = NULL;
+            return false;
+        }
+        mapping.verified = true;
+    }
+
+    mapping.refs = 1;
+    return true;
+}
+
+
+/* Removes an entry which is not mapped, the space gets reused by the next install */
+static bool drop(int _index, bool _save)
+{
+    if (mappings[_index].refs > 0) {
+        return false;
+    }
+
+    memset(&directory->entries[_index], 0, sizeof(Entry));
+    memset(&mappings[_index], 0, sizeof(Mapping));
+
+    return _save ? save_directory() : true;
+}
+
+
+/* First gap between the stored models which fits _size bytes, -1 if there is none */
+static long find_space(uint32_t _size)
+{
+    std::vector<Entry*> used;
+    for (int i = 0; i < MODEL_STORE_MAX_ENTRIES; ++i) {
+        if (directory->entries[i].filename[0]) {
+            used.push_back(&directory->entries[i]);
+        }
+    }
+    std::sort(used.begin(), used.end(), [](const Entry *a, const Entry *b) { return a->offset < b->offset; });
+
+    uint32_t start = STORE_SECTOR_SIZE;
+    for (const Entry *e : used) {
+        if (e->offset >= start + _size) {
+            return start;
+        }
+        start = (e->offset + e->size + STORE_SECTOR_SIZE - 1) & ~(STORE_SECTOR_SIZE - 1);
+    }
+
+    return (start + _size <= partition->size) ? start : -1;
+}
+
+
+/* Oldest entry which is not mapped, -1 if there is none */
+static int oldest_unused()
+{
+    int oldest = -1;
+    for (int i = 0; i < MODEL_STORE_MAX_ENTRIES; ++i) {
+        if (directory->entries[i].filename[0] && (mappings[i].refs == 0) &&
+            ((oldest < 0) || (directory->entries[i].installed < directory->entries[oldest].installed))) {
+            oldest = i;
+        }
+    }
+
+    return oldest;
+}
+
+
+static int free_slot()
+{
+    for (int i = 0; i < MODEL_STORE_MAX_ENTRIES; ++i) {
+        if (!directory->entries[i].filename[0]) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+const uint8_t *get(const std::string &_fn, long *_size)
+{
+    if (!init()) {
+        return NULL;
+    }
+
+    struct stat stat_buf;
+    if (stat(_fn.c_str(), &stat_buf) != 0) {
+        return NULL;
+    }
+
+    const uint8_t *model = NULL;
+
+    xSemaphoreTake(mutex_handle, portMAX_DELAY);
+
+    int index = find(_fn);
+    if (index >= 0) {
+        Entry &entry = directory->entries[index];
+
+        if ((entry.file_size == (int32_t)stat_buf.st_size) && (entry.file_mtime == (int64_t)stat_buf.st_mtime)) {
+            if (map(index)) {
+                model = mappings[index].ptr;
+                *_size = entry.size;
+            }
+            else {
+                drop(index, true);
+            }
+        }
+    }
+
+    xSemaphoreGive(mutex_handle);
+
+    return model;
+}
+
+
+const uint8_t *install(const std::string &_fn, const uint8_t *_data, long _size)
+{
+    if (!init() || (_fn.length() >= STORE_MAX_PATH) || (_size <= 0)) {
+        return NULL;
+    }
+
+    struct stat stat_buf;
+    if (stat(_fn.c_str(), &stat_buf) != 0) {
+        return NULL;
+    }
+
+    xSemaphoreTake(mutex_handle, portMAX_DELAY);
+
+    int index = find(_fn);
+    if ((index >= 0) && !drop(index, false)) {
+        // Old copy is still used by a resident interpreter, it gets replaced once that one is released
+        xSemaphoreGive(mutex_handle);
+        return NULL;
+    }
+
+    long offset = find_space(_size);
+    int slot = free_slot();
+
+    while ((offset < 0) || (slot < 0)) {
+        int oldest = oldest_unused();
+        if (oldest < 0) {
+            break;
+        }
+        drop(oldest, false);
+        offset = find_space(_size);
+        slot = free_slot();
+    }
+
+    if ((offset < 0) || (slot < 0)) {
+        save_directory();
+        xSemaphoreGive(mutex_handle);
+        LogFile.WriteToFile(ESP_LOG_WARN, TAG, "Not enough space in the model store for " + _fn + " (" + std::to_string(_size) + " bytes)");
+        return NULL;
+    }
+
+    LogFile.WriteToFile(ESP_LOG_INFO, TAG, "Storing " + _fn + " in flash (" + std::to_string(_size) + " bytes)...");
+
+    // The model is in PSRAM, which is not accessible while writing to the flash, so copy it through an internal buffer
+    uint32_t erase_size = (_size + STORE_SECTOR_SIZE - 1) & ~(STORE_SECTOR_SIZE - 1);
+    esp_err_t err = esp_partition_erase_range(partition, offset, erase_size);
+
+    uint8_t *buffer = (uint8_t *)heap_caps_malloc(STORE_SECTOR_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (buffer == NULL) {
+        err = ESP_ERR_NO_MEM;
+    }
+
+    for (long pos = 0; (err == ESP_OK) && (pos < _size); pos += STORE_SECTOR_SIZE) {
+        size_t len = std::min((long)STORE_SECTOR_SIZE, _size - pos);
+        memcpy(buffer, _data + pos, len);
+        err = esp_partition_write(partition, offset + pos, buffer, len);
+    }
+    free(buffer);
+
+    Entry &entry = directory->entries[slot];
+
+    if (err == ESP_OK) {
+        strncpy(entry.filename, _fn.c_str(), sizeof(entry.filename) - 1);
+        entry.offset = offset;
+        entry.size = _size;
+        entry.file_size = stat_buf.st_size;
+        entry.file_mtime = stat_buf.st_mtime;
+        entry.installed = ++directory->install_counter;
+        sha256(_data, _size, entry.sha256);
+
+        // Read back through the mapping, so a broken flash write is not used
+        if (!map(slot)) {
+            err = ESP_ERR_INVALID_CRC;
+            memset(&entry, 0, sizeof(Entry));
+        }
+    }
+
+    save_directory();
+    const uint8_t *model = (err == ESP_OK) ? mappings[slot].ptr : NULL;
+
+    xSemaphoreGive(mutex_handle);
+
+    if (err != ESP_OK) {
+        LogFile.WriteToFile(ESP_LOG_ERROR, TAG, "Failed to store " + _fn + " (" + esp_err_to_name(err) + ")");
+    }
+
+    return model;
+}
+
+
+void release(const uint8_t *_model)
+{
+    if ((_model == NULL) || (partition == NULL)) {
+        return;
+    }
+
+    xSemaphoreTake(mutex_handle, portMAX_DELAY);
+
+    for (int i = 0; i < MODEL_STORE_MAX_ENTRIES; ++i) {
+        if ((mappings[i].refs > 0) && (mappings[i].ptr == _model)) {
+            if (--mappings[i].refs == 0) {
+                esp_partition_munmap(mappings[i].handle);
+                mappings[i].ptr = NULL;
+            }
+            break;
+        }
+    }
+
+    xSemaphoreGive(mutex_handle);
+}
+
+
+void remove(const std::string &_fn)
+{
+    if (!init()) {
+        return;
+    }
+
+    xSemaphoreTake(mutex_handle, portMAX_DELAY);
+
+    int index = find(_fn);
+    if (index >= 0) {
+        drop(index, true);
+    }
+
+    xSemaphoreGive(mutex_handle);
+}
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#ifndef MODEL_STORE_H
+#define MODEL_STORE_H
+
+#include <stdint.h>
+#include <string>
+
+/* Copies of the (decompressed) models in a raw flash partition (MODEL_STORE_PARTITION_LABEL), which get
+ * memory mapped instead of read into PSRAM. Without that partition (see partitions.csv) get() and install()
+ * return NULL and the models get loaded from the file system as before.
+ * A stored model is only used as long as its model file did not change (size + mtime). */
+namespace model_store {
+
+/* Maps the stored copy of the model file _fn, returns NULL if there is none or the file changed since.
+ * Every returned pointer has to be given back with release(). */
+const uint8_t *get(const std::string &_fn, long *_size);
+
+/* Writes the model _data (content of _fn) into the store, verifies it and returns the mapped copy (see get()).
+ * Returns NULL if there is no store partition or not enough space. */
+const uint8_t *install(const std::string &_fn, const uint8_t *_data, long _size);
+
+void release(const uint8_t *_model);
+
+/* Forgets the stored copy of _fn (e.g. model file got deleted) */
+void remove(const std::string &_fn);
+
+}
+
+#endif //MODEL_STORE_H
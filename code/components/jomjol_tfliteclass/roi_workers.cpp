@@ -0,0 +1,104 @@
+#include "roi_workers.h"
+
+#include <atomic>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "ClassLogFile.h"
+#include "../../include/defines.h"
+
+static const char *TAG = "ROI_WORKERS";
+
+namespace roi_workers {
+
+static SemaphoreHandle_t mutex_handle = NULL;  // One run() at a time
+static SemaphoreHandle_t start_handle = NULL;
+static SemaphoreHandle_t done_handle = NULL;
+static bool initialized = false;
+static bool worker_ok = false;
+
+static const Job *job = NULL;
+static int job_count = 0;
+static std::atomic<int> next_index(0);
+
+
+static void process(int _worker)
+{
+    int index;
+    while ((index = next_index.fetch_add(1)) < job_count) {
+        (*job)(index, _worker);
+    }
+}
+
+
+static void task_ROIWorker(void *pvParameter)
+{
+    while (true) {
+        xSemaphoreTake(start_handle, portMAX_DELAY);
+        process(1);
+        xSemaphoreGive(done_handle);
+    }
+}
+
+
+static bool init()
+{
+    if (initialized) {
+        return worker_ok;
+    }
+    initialized = true;
+
+#if ROI_WORKERS_ENABLE && !CONFIG_FREERTOS_UNICORE
+    mutex_handle = xSemaphoreCreateMutex();
+    start_handle = xSemaphoreCreateBinary();
+    done_handle = xSemaphoreCreateBinary();
+
+    // The stack has to be in internal RAM, leave enough for WLAN and the web server
+    if ((mutex_handle == NULL) || (start_handle == NULL) || (done_handle == NULL) ||
+        (heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) < ROI_WORKER_STACK_SIZE + ROI_WORKER_INTERNAL_RESERVE) ||
+        (xTaskCreatePinnedToCore(&task_ROIWorker, "task_ROIWorker", ROI_WORKER_STACK_SIZE, NULL, uxTaskPriorityGet(NULL),
+                                 NULL, ROI_WORKER_CORE) != pdPASS)) {
+        LogFile.WriteToFile(ESP_LOG_WARN, TAG, "Worker task not available, the ROIs get processed on one core");
+        return false;
+    }
+
+    LogFile.WriteToFile(ESP_LOG_DEBUG, TAG, "Worker task started on core " + std::to_string(ROI_WORKER_CORE));
+    worker_ok = true;
+#endif
+
+    return worker_ok;
+}
+
+
+void run(int _count, const Job &_job, bool _parallel)
+{
+    if (!_parallel || (_count < 2) || !init() || (xSemaphoreTake(mutex_handle, 0) != pdTRUE)) {
+        for (int i = 0; i < _count; ++i) {
+            _job(i, 0);
+        }
+        return;
+    }
+
+    job = &_job;
+    job_count = _count;
+    next_index = 0;
+
+    xSemaphoreGive(start_handle);
+    process(0);
+    xSemaphoreTake(done_handle, portMAX_DELAY);
+
+    job = NULL;
+    xSemaphoreGive(mutex_handle);
+}
+
+
+bool available()
+{
+    return init();
+}
+
+}
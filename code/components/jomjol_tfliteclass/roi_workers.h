@@ -0,0 +1,25 @@
+#pragma once
+
+#ifndef ROI_WORKERS_H
+#define ROI_WORKERS_H
+
+#include <functional>
+
+/* Second task on the other core (ROI_WORKER_CORE) which takes over part of the per-ROI work of the flow
+ * (cut/resize, inference). The items get handed out one by one to the calling task and the worker, every
+ * item writes its result into its own slot, so the result does not depend on which core processed it. */
+namespace roi_workers {
+
+/* _index: item to process, _worker: 0 = calling task, 1 = worker task (e.g. to pick the interpreter) */
+typedef std::function<void(int _index, int _worker)> Job;
+
+/* Runs _job for all items 0.._count-1 and returns once all are done. Runs everything on the calling task
+ * if _parallel is false, the worker task is not available or busy with another run() */
+void run(int _count, const Job &_job, bool _parallel = true);
+
+/* False if the worker task could not be created (not enough internal RAM) or ROI_WORKERS_ENABLE is 0 */
+bool available();
+
+}
+
+#endif //ROI_WORKERS_H
@@ -0,0 +1,52 @@
+#include "tensor_fill.h"
+
+#include <math.h>
+
+namespace tensor_fill {
+
+void to_float(float* dst, const uint8_t* src, size_t count)
+{
+    // Unrolled, so the FPU pipeline of the Xtensa cores stays busy and the compiler can vectorize on other targets
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        dst[i + 0] = (float)src[i + 0];
+        dst[i + 1] = (float)src[i + 1];
+        dst[i + 2] = (float)src[i + 2];
+        dst[i + 3] = (float)src[i + 3];
+        dst[i + 4] = (float)src[i + 4];
+        dst[i + 5] = (float)src[i + 5];
+        dst[i + 6] = (float)src[i + 6];
+        dst[i + 7] = (float)src[i + 7];
+    }
+    for (; i < count; ++i) {
+        dst[i] = (float)src[i];
+    }
+}
+
+void build_quant_lut(uint8_t* lut, float scale, int zero_point, bool is_signed)
+{
+    const int qmin = is_signed ? -128 : 0;
+    const int qmax = is_signed ? 127 : 255;
+
+    for (int pixel = 0; pixel < 256; ++pixel) {
+        int q = (int)lroundf((float)pixel / scale) + zero_point;
+        q = q < qmin ? qmin : (q > qmax ? qmax : q);
+        lut[pixel] = (uint8_t)q;
+    }
+}
+
+void to_quantized(uint8_t* dst, const uint8_t* src, size_t count, const uint8_t* lut)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        dst[i + 0] = lut[src[i + 0]];
+        dst[i + 1] = lut[src[i + 1]];
+        dst[i + 2] = lut[src[i + 2]];
+        dst[i + 3] = lut[src[i + 3]];
+    }
+    for (; i < count; ++i) {
+        dst[i] = lut[src[i]];
+    }
+}
+
+} // namespace tensor_fill
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Conversion of 8 bit RGB pixel data into the model input tensor.
+// Kept free of any ESP-IDF dependency, so it can be benchmarked on the host (see test/benchmark).
+namespace tensor_fill {
+
+// Converts _count uint8 values into float (0..255), reading and writing sequentially.
+void to_float(float* dst, const uint8_t* src, size_t count);
+
+// Builds the quantization table of an int8 (_is_signed) or uint8 input tensor: lut[pixel] = round(pixel / scale) + zero_point,
+// clamped to the value range of the tensor type. The table holds the raw bytes of the quantized values.
+void build_quant_lut(uint8_t* lut, float scale, int zero_point, bool is_signed);
+
+// Quantizes _count uint8 values with a table from build_quant_lut()
+void to_quantized(uint8_t* dst, const uint8_t* src, size_t count, const uint8_t* lut);
+
+} // namespace tensor_fill
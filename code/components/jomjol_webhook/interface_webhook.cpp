@@ -26,16 +26,16 @@ void WebhookInit(std::string _uri, std::string _apiKey)
     _lastTimestamp = 0L;
 }
 
-bool WebhookPublish(std::vector<NumberPost*>* numbers)
+bool WebhookPublish(const std::vector<result_snapshot::Number> &numbers)
 {
     bool numbersWithError = false;
     cJSON *jsonArray = cJSON_CreateArray();
 
-    for (int i = 0; i < (*numbers).size(); ++i)
+    for (int i = 0; i < numbers.size(); ++i)
     {
         string timezw = "";
         char buffer[80];
-        time_t &lastPreValue = (*numbers)[i]->timeStampLastPreValue;
+        const time_t &lastPreValue = numbers[i].time_last_pre_value;
         struct tm* timeinfo = localtime(&lastPreValue);
         _lastTimestamp = static_cast<long>(lastPreValue);
         strftime(buffer, 80, PREVALUE_TIME_FORMAT_OUTPUT, timeinfo);
@@ -44,17 +44,17 @@ bool WebhookPublish(std::vector<NumberPost*>* numbers)
         cJSON *json = cJSON_CreateObject();
         cJSON_AddStringToObject(json, "timestamp", timezw.c_str());
         cJSON_AddStringToObject(json, "timestampLong", std::to_string(_lastTimestamp).c_str());
-        cJSON_AddStringToObject(json, "name", (*numbers)[i]->name.c_str());
-        cJSON_AddStringToObject(json, "rawValue", (*numbers)[i]->ReturnRawValue.c_str());
-        cJSON_AddStringToObject(json, "value", (*numbers)[i]->ReturnValue.c_str());
-        cJSON_AddStringToObject(json, "preValue", (*numbers)[i]->ReturnPreValue.c_str());
-        cJSON_AddStringToObject(json, "rate", (*numbers)[i]->ReturnRateValue.c_str());
-        cJSON_AddStringToObject(json, "changeAbsolute", (*numbers)[i]->ReturnChangeAbsolute.c_str());
-        cJSON_AddStringToObject(json, "error", (*numbers)[i]->ErrorMessageText.c_str());
+        cJSON_AddStringToObject(json, "name", numbers[i].name.c_str());
+        cJSON_AddStringToObject(json, "rawValue", numbers[i].raw.c_str());
+        cJSON_AddStringToObject(json, "value", numbers[i].value.c_str());
+        cJSON_AddStringToObject(json, "preValue", numbers[i].pre.c_str());
+        cJSON_AddStringToObject(json, "rate", numbers[i].rate.c_str());
+        cJSON_AddStringToObject(json, "changeAbsolute", numbers[i].change_absolute.c_str());
+        cJSON_AddStringToObject(json, "error", numbers[i].error.c_str());
         
         cJSON_AddItemToArray(jsonArray, json);
 
-        if ((*numbers)[i]->ErrorMessage) {
+        if (numbers[i].error_flag) {
             numbersWithError = true;
         }
     }
@@ -97,7 +97,7 @@ bool WebhookPublish(std::vector<NumberPost*>* numbers)
     return numbersWithError;    
 }
 
-void WebhookUploadPic(ImageData *Img) {
+void WebhookUploadPic(const uint8_t *_data, size_t _size) {
     LogFile.WriteToFile(ESP_LOG_INFO, TAG, "Starting WebhookUploadPic");
 
     std::string fullURI = _webhookURI + "?timestamp=" + std::to_string(_lastTimestamp);
@@ -116,7 +116,7 @@ void WebhookUploadPic(ImageData *Img) {
     esp_http_client_set_header(http_client, "Content-Type", "image/jpeg");
     esp_http_client_set_header(http_client, "APIKEY", _webhookApiKey.c_str());
 
-    esp_err_t err = ESP_ERROR_CHECK_WITHOUT_ABORT(esp_http_client_set_post_field(http_client, (const char *)Img->data, Img->size));
+    esp_err_t err = ESP_ERROR_CHECK_WITHOUT_ABORT(esp_http_client_set_post_field(http_client, (const char *)_data, _size));
 
     err = ESP_ERROR_CHECK_WITHOUT_ABORT(esp_http_client_perform(http_client));
 
@@ -8,10 +8,11 @@
 #include <map>
 #include <functional>
 #include <ClassFlowDefineTypes.h>
+#include "result_snapshot.h"
 
 void WebhookInit(std::string _webhookURI, std::string _apiKey);
-bool WebhookPublish(std::vector<NumberPost*>* numbers);
-void WebhookUploadPic(ImageData *Img);
+bool WebhookPublish(const std::vector<result_snapshot::Number> &numbers);
+void WebhookUploadPic(const uint8_t *_data, size_t _size);
 
 #endif //INTERFACE_WEBHOOK_H
 #endif //ENABLE_WEBHOOK
\ No newline at end of file
@@ -12,6 +12,36 @@ std::string createMetric(const std::string &metricName, const std::string &help,
            metricName + " " + value + "\n";
 }
 
+/**
+ * create a metric with one sample per label value (e.g. one per flow step), samples are pairs of label value and value
+ **/
+std::string createMetric(const std::string &metricName, const std::string &help, const std::string &type, const std::string &labelName,
+                         const std::vector<std::pair<std::string, std::string>> &samples)
+{
+    std::string res;
+
+    for (const auto &sample : samples)
+    {
+        auto label = sample.first;
+        // except newline, double quote, and backslash (https://github.com/OpenObservability/OpenMetrics/blob/main/specification/OpenMetrics.md#abnf)
+        replaceAll(label, "\\", "");
+        replaceAll(label, "\"", "");
+        replaceAll(label, "\n", "");
+
+        res += metricName + "{" + labelName + "=\"" + label + "\"} " + sample.second + "\n";
+    }
+
+    // no samples -> no metadata (missing data is not reported)
+    if (res.length() == 0)
+    {
+        return res;
+    }
+
+    return "# HELP " + metricName + " " + help + "\n" +
+           "# TYPE " + metricName + " " + type + "\n" +
+           res;
+}
+
 typedef struct sequence_metric {
     const char *name;
     const char *help;
@@ -4,11 +4,16 @@
 #define OPENMETRICS_H
 
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "ClassFlowDefineTypes.h"
 
+#define OPENMETRICS_PREFIX "ai_on_the_edge_device"     // Prefix of all metric names
+
 std::string createMetric(const std::string &metricName, const std::string &help, const std::string &type, const std::string &value);
+std::string createMetric(const std::string &metricName, const std::string &help, const std::string &type, const std::string &labelName,
+                         const std::vector<std::pair<std::string, std::string>> &samples);
 std::string createSequenceMetrics(std::string prefix, const std::vector<NumberPost *> &numbers);
 
 #endif // OPENMETRICS_H
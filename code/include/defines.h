@@ -15,6 +15,7 @@
     //#define DEBUG_ENABLE_SYSINFO
     //#define DEBUG_ENABLE_PERFMON
     //#define DEBUG_HIMEM_MEMORY_CHECK
+    //#define DEBUG_ENABLE_TFLITE_BENCHMARK // ClassFlowCNNGeneral: compare batched and per-ROI inference each round
     // need [env:esp32cam-dev-himem]
     //=> CONFIG_SPIRAM_BANKSWITCH_ENABLE=y
     //=> CONFIG_SPIRAM_BANKSWITCH_RESERVE=4
@@ -47,10 +48,16 @@
     //#define HEAP_TRACING_CLASS_FLOW_CNN_GENERAL_DO_ALING_AND_CUT
 
     /* Uncomment this to keep the logfile open for appending.
-    * If commented out, the logfile gets opened/closed for each log measage (old behaviour) */
+    * If commented out, the logfile gets opened/closed for each log measage (old behaviour),
+    * respectively for each batch of the log writer task */
     // ClassLogFile
     //#define KEEP_LOGFILE_OPEN_FOR_APPENDING
 
+    /* Log lines get written to the logfile by a low priority task (ClassLogFile::StartWriterTask) in batches.
+    * Lines which do not fit into the buffer any more are dropped (and counted) instead of blocking the caller */
+    #define LOG_WRITER_BUFFER_SIZE (32 * 1024)      // Ring buffer in PSRAM
+    #define LOG_WRITER_INTERVAL_MS 1000             // Max. time a line stays in the buffer (= max. loss on a crash)
+
   //****************************************
 
     //compiler optimization for esp-tflite-micro
@@ -60,6 +67,11 @@
 
     //ClassControllCamera
     #define CAM_LIVESTREAM_REFRESHRATE 500      // Camera livestream feature: Waiting time in milliseconds to refresh image
+    #ifndef JOMJOL_CAMERA_DIRECT_DECODE
+        #define JOMJOL_CAMERA_DIRECT_DECODE 1   // Decode JPEG frames directly into the raw image (esp_jpg_decode), 0 = use stb_image via temporary image
+    #endif
+    #define CAMERA_FRAME_MAX_AGE_MS 500         // Captures without flash delay: a buffered frame started up to this long ago is used as is
+    #define CAMERA_FRAME_MAX_GRABS 3            // Max. frames taken from the driver until one started late enough
     // #define GRAYSCALE_AS_DEFAULT
 
 
@@ -96,6 +108,8 @@
     #define SERVER_FILER_SCRATCH_BUFSIZE  4096 
     #define SERVER_HELPER_SCRATCH_BUFSIZE  4096
     #define SERVER_OTA_SCRATCH_BUFSIZE  1024 
+    #define OTA_STREAM_BUFFER_SIZE  (16 * 1024)    // Firmware download: 2 buffers (PSRAM), one gets received while the other one gets written
+    #define OTA_STREAM_MAX_RESUMES  5               // Continue an interrupted firmware download with a range request
 
 
     //server_file + server_help
@@ -120,6 +134,14 @@
     #define READOUT_TYPE_RAWVALUE 2
     #define READOUT_TYPE_ERROR 3
 
+    //ClassFlowControll + flow_stats: Timing and heap usage of the flow steps (/metrics, /flow_stats)
+    #define FLOW_STATS_ROUNDS 10                // Number of rounds kept in the ring buffer (PSRAM)
+    #define FLOW_STATS_MAX_STEPS 12             // Max. number of flow steps per round
+
+    //ClassFlowControll: Pipelined flow ([AutoTimer] PipelinedFlow), MQTT/InfluxDB/Webhook run on their own task
+    #define FLOW_PUBLISH_TASK_STACK_SIZE (8 * 1024)
+    #define FLOW_PUBLISH_TASK_CORE 1            // The flow task runs on core 0
+
 
     //ClassFlowControll: Serve alg_roi.jpg from memory as JPG
     // Build-time feature toggles (can be overridden via PlatformIO build_flags)
@@ -156,6 +178,16 @@
     #define LWT_TOPIC        "connection"
     #define LWT_CONNECTED    "connected"
     #define LWT_DISCONNECTED "connection lost"
+    #define MQTT_COMBINED_TOPIC "readings"      // Topic below the main topic for PublishMode = combined
+
+
+    //mqtt_backlog
+    #define MQTT_BACKLOG_SIZE (32 * 1024)                       // Readings which could not be published are queued in PSRAM
+    #define MQTT_BACKLOG_SPILL_MAX_SIZE (256 * 1024)            // If full, the oldest get moved to a file (0 = drop them instead)
+    #define MQTT_BACKLOG_SPILL_FILE "/spiffs/log/mqtt_backlog.bin"
+    #define MQTT_BACKLOG_DRAIN_INTERVAL_MS 500                  // After a reconnect, queued messages get published at
+    #define MQTT_BACKLOG_DRAIN_BATCH 4                          // most N messages per interval
+    #define MQTT_BACKLOG_ACK_TIMEOUT_MS 5000                    // Queued messages stay queued until the broker acknowledged them
 
 
     //ClassFlowPostProcessing
@@ -176,6 +208,11 @@
 
     //interface_influxdb
     #define MAX_HTTP_OUTPUT_BUFFER 2048
+    #define INFLUXDB_BATCH_ROUNDS 1                             // Send the points of N rounds in one request (1 = every round)
+    #define INFLUXDB_BACKLOG_MAX_SIZE (16 * 1024)               // Points which could not be sent are kept on flash up to this size (the oldest get dropped)
+    #define INFLUXDB_CHUNK_SIZE (4 * 1024)                      // Request size when the server rejected the whole payload (400, 413, 422)
+    #define INFLUXDB_BACKLOG_FILE_V1 "/spiffs/log/influxdb_v1_backlog.txt"
+    #define INFLUXDB_BACKLOG_FILE_V2 "/spiffs/log/influxdb_v2_backlog.txt"
 
 
     //server_mqtt
@@ -211,6 +248,12 @@
     #define Digit_Transition_Area_Predecessor 0.7 // 9.3 - 0.7
     #define Digit_Transition_Area_Forward 9.7 // Pre-run zero crossing only happens from approx. 9.7 onwards
 
+
+    //CFindTemplate: AlignmentAlgo = Pyramid
+    #define ALIGNMENT_PYRAMID_LEVELS 3              // Max. number of pyramid levels (each level halves the resolution)
+    #define ALIGNMENT_PYRAMID_MIN_TEMPLATE_SIZE 8   // Smallest template width/height on the coarsest level
+    #define ALIGNMENT_PYRAMID_REFINE_RADIUS 2       // Search radius around the upscaled position on each finer level
+
     //#define DEBUG_DETAIL_ON 
 
 
@@ -218,8 +261,19 @@
 ////      PSRAM Allocations              ////
 /////////////////////////////////////////////
 #define MAX_MODEL_SIZE            (unsigned int)(1.3 * 1024 * 1024) // Space for the currently largest model (1.1 MB) + some spare
-#define TENSOR_ARENA_SIZE         800 * 1024 // Space for the Tensor Arena, (819200 Bytes)
+#define TENSOR_ARENA_SIZE         800 * 1024 // Space for the Tensor Arena, (819200 Bytes). Resident models only get arena_used_bytes() (int8 models need much less)
 #define IMAGE_SIZE                640 * 480 * 3 // Space for a extracted image (921600 Bytes)
+#define TFLITE_MODEL_CACHE_ENTRIES        2             // Max. number of models kept resident in PSRAM between rounds (Digits + Analog)
+#define TFLITE_MODEL_CACHE_PSRAM_RESERVE  256 * 1024    // PSRAM which has to stay free after making a model resident
+#define TFLITE_ARENA_HEADROOM             1024          // Added to the measured arena usage of a resident model (alignment)
+#define MODEL_STORE_PARTITION_LABEL       "models"      // Raw flash partition the models get mapped from instead of loaded into PSRAM (optional, see partitions.csv)
+#define MODEL_STORE_MAX_ENTRIES           8             // Max. number of models in that partition
+#ifndef ROI_WORKERS_ENABLE
+    #define ROI_WORKERS_ENABLE            1             // Cut/resize and inference of the ROIs on both cores (0 = only on the flow task)
+#endif
+#define ROI_WORKER_CORE                   1             // The flow task runs on core 0
+#define ROI_WORKER_STACK_SIZE             (6 * 1024)
+#define ROI_WORKER_INTERNAL_RESERVE       (32 * 1024)   // Internal RAM which has to stay free after creating the worker task
 /////////////////////////////////////////////
 ////      Conditionnal definitions       ////
 /////////////////////////////////////////////
@@ -277,6 +277,9 @@ extern "C" void app_main(void)
         LogFile.WriteToFile(ESP_LOG_INFO, TAG, "PSRAM size: " + std::to_string(psram_size) + " byte (" + std::to_string(psram_size/1024/1024) + 
                                                "MB / " + std::to_string(psram_size/1024/1024*8) + "MBit)");
 
+        // Write log lines from now on by a separate task, buffered in PSRAM
+        LogFile.StartWriterTask();
+
         // Check PSRAM size
         // ********************************************
         if (psram_size < (4*1024*1024)) { // PSRAM is below 4 MBytes (32Mbit)
@@ -194,6 +194,7 @@ function ParseConfig() {
     ParamAddValue(param, catname, "user");
     ParamAddValue(param, catname, "password");
     ParamAddValue(param, catname, "RetainMessages");
+    ParamAddValue(param, catname, "PublishMode");
     ParamAddValue(param, catname, "DomoticzTopicIn");
     ParamAddValue(param, catname, "DomoticzIDX", 1, true);
     ParamAddValue(param, catname, "HomeassistantDiscovery");
@@ -266,6 +267,7 @@ function ParseConfig() {
     param[catname] = new Object();
     //ParamAddValue(param, catname, "AutoStart");
     ParamAddValue(param, catname, "Interval");     
+    ParamAddValue(param, catname, "PipelinedFlow");
 
     var catname = "DataLogging";
     category[catname] = new Object();
@@ -1,7 +1,10 @@
 #include "ui_embedded.h"
 
+#include <stdio.h>
 #include <string.h>
 
+#include "ui_embedded_hashes.h"     // Generated by CMakeLists.txt
+
 static const char *content_type_for_name(const char *name)
 {
     const char *ext = strrchr(name, '.');
@@ -20,6 +23,7 @@ struct EmbeddedFile
     const char *name; // e.g. "index.html"
     const uint8_t *start;
     const uint8_t *end;
+    const char *hash; // Content hash, used as ETag and as "?v=" of the pages
 };
 
 extern const uint8_t _binary_common_js_gz_start[];            extern const uint8_t _binary_common_js_gz_end[];
@@ -49,41 +53,86 @@ extern const uint8_t _binary_reboot_page_html_gz_start[];     extern const uint8
 extern const uint8_t _binary_style_css_gz_start[];            extern const uint8_t _binary_style_css_gz_end[];
 extern const uint8_t _binary_timezones_html_gz_start[];       extern const uint8_t _binary_timezones_html_gz_end[];
 
-static const EmbeddedFile kFiles[] = {
-    {"common.js", _binary_common_js_gz_start, _binary_common_js_gz_end},
-    {"data.html", _binary_data_html_gz_start, _binary_data_html_gz_end},
-    {"edit_alignment.html", _binary_edit_alignment_html_gz_start, _binary_edit_alignment_html_gz_end},
-    {"edit_analog.html", _binary_edit_analog_html_gz_start, _binary_edit_analog_html_gz_end},
-    {"edit_config_raw.html", _binary_edit_config_raw_html_gz_start, _binary_edit_config_raw_html_gz_end},
-    {"edit_config_template.html", _binary_edit_config_template_html_gz_start, _binary_edit_config_template_html_gz_end},
-    {"edit_digits.html", _binary_edit_digits_html_gz_start, _binary_edit_digits_html_gz_end},
-    {"edit_reference.html", _binary_edit_reference_html_gz_start, _binary_edit_reference_html_gz_end},
-    {"edit_style.css", _binary_edit_style_css_gz_start, _binary_edit_style_css_gz_end},
-    {"file_server.css", _binary_file_server_css_gz_start, _binary_file_server_css_gz_end},
-    {"file_server.js", _binary_file_server_js_gz_start, _binary_file_server_js_gz_end},
-    {"firework.css", _binary_firework_css_gz_start, _binary_firework_css_gz_end},
-    {"firework.js", _binary_firework_js_gz_start, _binary_firework_js_gz_end},
-    {"index.html", _binary_index_html_gz_start, _binary_index_html_gz_end},
-    {"info.html", _binary_info_html_gz_start, _binary_info_html_gz_end},
-    {"log.html", _binary_log_html_gz_start, _binary_log_html_gz_end},
-    {"md5.min.js", _binary_md5_min_js_gz_start, _binary_md5_min_js_gz_end},
-    {"ota_page.html", _binary_ota_page_html_gz_start, _binary_ota_page_html_gz_end},
-    {"overview.html", _binary_overview_html_gz_start, _binary_overview_html_gz_end},
-    {"prevalue_set.html", _binary_prevalue_set_html_gz_start, _binary_prevalue_set_html_gz_end},
-    {"readconfigcommon.js", _binary_readconfigcommon_js_gz_start, _binary_readconfigcommon_js_gz_end},
-    {"readconfigparam.js", _binary_readconfigparam_js_gz_start, _binary_readconfigparam_js_gz_end},
-    {"model.html", _binary_model_html_gz_start, _binary_model_html_gz_end},
-    {"reboot_page.html", _binary_reboot_page_html_gz_start, _binary_reboot_page_html_gz_end},
-    {"style.css", _binary_style_css_gz_start, _binary_style_css_gz_end},
-    {"timezones.html", _binary_timezones_html_gz_start, _binary_timezones_html_gz_end},
+static constexpr EmbeddedFile kFiles[] = {
+    {"common.js", _binary_common_js_gz_start, _binary_common_js_gz_end, UI_HASH_common_js},
+    {"data.html", _binary_data_html_gz_start, _binary_data_html_gz_end, UI_HASH_data_html},
+    {"edit_alignment.html", _binary_edit_alignment_html_gz_start, _binary_edit_alignment_html_gz_end, UI_HASH_edit_alignment_html},
+    {"edit_analog.html", _binary_edit_analog_html_gz_start, _binary_edit_analog_html_gz_end, UI_HASH_edit_analog_html},
+    {"edit_config_raw.html", _binary_edit_config_raw_html_gz_start, _binary_edit_config_raw_html_gz_end, UI_HASH_edit_config_raw_html},
+    {"edit_config_template.html", _binary_edit_config_template_html_gz_start, _binary_edit_config_template_html_gz_end, UI_HASH_edit_config_template_html},
+    {"edit_digits.html", _binary_edit_digits_html_gz_start, _binary_edit_digits_html_gz_end, UI_HASH_edit_digits_html},
+    {"edit_reference.html", _binary_edit_reference_html_gz_start, _binary_edit_reference_html_gz_end, UI_HASH_edit_reference_html},
+    {"edit_style.css", _binary_edit_style_css_gz_start, _binary_edit_style_css_gz_end, UI_HASH_edit_style_css},
+    {"file_server.css", _binary_file_server_css_gz_start, _binary_file_server_css_gz_end, UI_HASH_file_server_css},
+    {"file_server.js", _binary_file_server_js_gz_start, _binary_file_server_js_gz_end, UI_HASH_file_server_js},
+    {"firework.css", _binary_firework_css_gz_start, _binary_firework_css_gz_end, UI_HASH_firework_css},
+    {"firework.js", _binary_firework_js_gz_start, _binary_firework_js_gz_end, UI_HASH_firework_js},
+    {"index.html", _binary_index_html_gz_start, _binary_index_html_gz_end, UI_HASH_index_html},
+    {"info.html", _binary_info_html_gz_start, _binary_info_html_gz_end, UI_HASH_info_html},
+    {"log.html", _binary_log_html_gz_start, _binary_log_html_gz_end, UI_HASH_log_html},
+    {"md5.min.js", _binary_md5_min_js_gz_start, _binary_md5_min_js_gz_end, UI_HASH_md5_min_js},
+    {"ota_page.html", _binary_ota_page_html_gz_start, _binary_ota_page_html_gz_end, UI_HASH_ota_page_html},
+    {"overview.html", _binary_overview_html_gz_start, _binary_overview_html_gz_end, UI_HASH_overview_html},
+    {"prevalue_set.html", _binary_prevalue_set_html_gz_start, _binary_prevalue_set_html_gz_end, UI_HASH_prevalue_set_html},
+    {"readconfigcommon.js", _binary_readconfigcommon_js_gz_start, _binary_readconfigcommon_js_gz_end, UI_HASH_readconfigcommon_js},
+    {"readconfigparam.js", _binary_readconfigparam_js_gz_start, _binary_readconfigparam_js_gz_end, UI_HASH_readconfigparam_js},
+    {"model.html", _binary_model_html_gz_start, _binary_model_html_gz_end, UI_HASH_model_html},
+    {"reboot_page.html", _binary_reboot_page_html_gz_start, _binary_reboot_page_html_gz_end, UI_HASH_reboot_page_html},
+    {"style.css", _binary_style_css_gz_start, _binary_style_css_gz_end, UI_HASH_style_css},
+    {"timezones.html", _binary_timezones_html_gz_start, _binary_timezones_html_gz_end, UI_HASH_timezones_html},
 };
 
-static const EmbeddedFile *find_embedded(const char *name)
+static constexpr size_t kFileCount = sizeof(kFiles) / sizeof(kFiles[0]);
+static constexpr size_t kSlots = 128;
+
+// FNV-1a, the seed gets chosen at compile time so that every file name gets its own slot
+static constexpr uint32_t name_hash(const char *name, uint32_t seed)
 {
-    for (size_t i = 0; i < sizeof(kFiles) / sizeof(kFiles[0]); i++) {
-        if (strcmp(kFiles[i].name, name) == 0) return &kFiles[i];
+    uint32_t h = 2166136261u ^ seed;
+    for (; *name; name++) {
+        h = (h ^ (uint8_t)*name) * 16777619u;
     }
-    return NULL;
+    return h;
+}
+
+static constexpr uint32_t find_seed()
+{
+    for (uint32_t seed = 1; seed < 10000; seed++) {
+        bool used[kSlots] = {};
+        bool collision = false;
+        for (size_t i = 0; i < kFileCount && !collision; i++) {
+            size_t slot = name_hash(kFiles[i].name, seed) % kSlots;
+            collision = used[slot];
+            used[slot] = true;
+        }
+        if (!collision) return seed;
+    }
+    return 0;
+}
+
+static constexpr uint32_t kSeed = find_seed();
+static_assert(kSeed != 0, "No perfect hash for the embedded UI files, increase kSlots");
+
+struct SlotTable
+{
+    uint8_t index[kSlots]; // Index in kFiles, 0xFF = empty
+};
+
+static constexpr SlotTable build_slots()
+{
+    SlotTable table = {};
+    for (size_t i = 0; i < kSlots; i++) table.index[i] = 0xFF;
+    for (size_t i = 0; i < kFileCount; i++) table.index[name_hash(kFiles[i].name, kSeed) % kSlots] = (uint8_t)i;
+    return table;
+}
+
+static constexpr SlotTable kSlotTable = build_slots();
+
+static const EmbeddedFile *find_embedded(const char *name)
+{
+    uint8_t i = kSlotTable.index[name_hash(name, kSeed) % kSlots];
+    if (i == 0xFF || strcmp(kFiles[i].name, name) != 0) return NULL;
+    return &kFiles[i];
 }
 
 esp_err_t ui_embedded_handler(httpd_req_t *req)
@@ -103,7 +152,9 @@ esp_err_t ui_embedded_handler(httpd_req_t *req)
     // Strip query string if any
     char name_buf[96];
     const char *q = strchr(name, '?');
+    char version[24] = "";
     if (q) {
+        httpd_query_key_value(q + 1, "v", version, sizeof(version));
         size_t n = (size_t)(q - name);
         if (n >= sizeof(name_buf)) {
             return httpd_resp_send_err(req, HTTPD_414_URI_TOO_LONG, "URI too long");
@@ -134,9 +185,22 @@ esp_err_t ui_embedded_handler(httpd_req_t *req)
         return httpd_resp_sendstr(req, "Client must support gzip");
     }
 
+    // Requested with the current content hash ("common.js?v=<hash>", see CMakeLists.txt): can be cached forever.
+    // Everything else gets revalidated with the ETag, which is answered with a 304 as long as the firmware did not change.
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%s\"", file->hash);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", (strcmp(version, file->hash) == 0) ? "public, max-age=31536000, immutable" : "no-cache");
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+    char if_none_match[96];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        (strstr(if_none_match, etag) != NULL || strcmp(if_none_match, "*") == 0)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
     httpd_resp_set_type(req, content_type_for_name(file->name));
     httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
-    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
-    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
     return httpd_resp_send(req, (const char *)file->start, (size_t)(file->end - file->start));
 }
@@ -0,0 +1,188 @@
+// Host benchmark for the warp kernel of the alignment step (jomjol_image_proc/affine_warp).
+// Compares the former CRotateImage kernels (float, column by column) with affine_warp::warp()
+// (row-major, 16.16 fixed point, span clipping, integer bilinear weights) on VGA and SVGA frames.
+//
+// Build and run from code/test/benchmark:
+//   g++ -O2 -I../../components/jomjol_image_proc bench_affine_warp.cpp ../../components/jomjol_image_proc/affine_warp.cpp -o bench_affine_warp
+//   ./bench_affine_warp
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "affine_warp.h"
+
+typedef std::vector<uint8_t> Image;
+
+/* Former CRotateImage::Rotate() / RotateAntiAliasing() (without flip), writing into _dst.
+ * _floor: round the source position down instead of truncating the linear part and the offset separately (reference for the new kernel) */
+static void __attribute__((noinline)) rotate_old(const uint8_t* rgb_image, uint8_t* odata, int width, int height, int channels, float _angle, bool _antialiasing, bool _floor = false)
+{
+    float m[2][3];
+    float x_center = width / 2;
+    float y_center = height / 2;
+    _angle = _angle / 180 * M_PI;
+
+    m[0][0] = cos(_angle);
+    m[0][1] = sin(_angle);
+    m[0][2] = (1 - m[0][0]) * x_center - m[0][1] * y_center;
+    m[1][0] = -m[0][1];
+    m[1][1] = m[0][0];
+    m[1][2] = m[0][1] * x_center + (1 - m[0][0]) * y_center;
+
+    for (int x = 0; x < width; ++x)
+        for (int y = 0; y < height; ++y) {
+            uint8_t* p_target = odata + (channels * (y * width + x));
+
+            if (!_antialiasing) {
+                int x_source = int(m[0][0] * x + m[0][1] * y) + int(m[0][2]);
+                int y_source = int(m[1][0] * x + m[1][1] * y) + int(m[1][2]);
+                if (_floor) {
+                    x_source = (int)floorf(m[0][0] * x + m[0][1] * y + m[0][2]);
+                    y_source = (int)floorf(m[1][0] * x + m[1][1] * y + m[1][2]);
+                }
+
+                if ((x_source >= 0) && (x_source < width) && (y_source >= 0) && (y_source < height)) {
+                    const uint8_t* p_source = rgb_image + (channels * (y_source * width + x_source));
+                    for (int _channels = 0; _channels < channels; ++_channels)
+                        p_target[_channels] = p_source[_channels];
+                }
+                else {
+                    for (int _channels = 0; _channels < channels; ++_channels)
+                        p_target[_channels] = 255;
+                }
+                continue;
+            }
+
+            float x_source = (m[0][0] * x + m[0][1] * y) + m[0][2];
+            float y_source = (m[1][0] * x + m[1][1] * y) + m[1][2];
+            int x_source_1 = (int)x_source;
+            int x_source_2 = x_source_1 + 1;
+            int y_source_1 = (int)y_source;
+            int y_source_2 = y_source_1 + 1;
+
+            float quad_ul = (x_source_2 - x_source) * (y_source_2 - y_source);
+            float quad_ur = (1 - (x_source_2 - x_source)) * (y_source_2 - y_source);
+            float quad_or = (x_source_2 - x_source) * (1 - (y_source_2 - y_source));
+            float quad_ol = (1 - (x_source_2 - x_source)) * (1 - (y_source_2 - y_source));
+
+            if ((x_source_1 >= 0) && (x_source_2 < width) && (y_source_1 >= 0) && (y_source_2 < height)) {
+                const uint8_t* p_source_ul = rgb_image + (channels * (y_source_1 * width + x_source_1));
+                const uint8_t* p_source_ur = rgb_image + (channels * (y_source_1 * width + x_source_2));
+                const uint8_t* p_source_or = rgb_image + (channels * (y_source_2 * width + x_source_1));
+                const uint8_t* p_source_ol = rgb_image + (channels * (y_source_2 * width + x_source_2));
+                for (int _channels = 0; _channels < channels; ++_channels)
+                    p_target[_channels] = (int)((float)p_source_ul[_channels] * quad_ul + (float)p_source_ur[_channels] * quad_ur +
+                                                (float)p_source_or[_channels] * quad_or + (float)p_source_ol[_channels] * quad_ol);
+            }
+            else {
+                for (int _channels = 0; _channels < channels; ++_channels)
+                    p_target[_channels] = 255;
+            }
+        }
+}
+
+/* Former CRotateImage::Translate(), writing into _dst */
+static void __attribute__((noinline)) translate_old(const uint8_t* rgb_image, uint8_t* odata, int width, int height, int channels, int _dx, int _dy)
+{
+    for (int x = 0; x < width; ++x)
+        for (int y = 0; y < height; ++y) {
+            uint8_t* p_target = odata + (channels * (y * width + x));
+            int x_source = x - _dx;
+            int y_source = y - _dy;
+
+            if ((x_source >= 0) && (x_source < width) && (y_source >= 0) && (y_source < height)) {
+                const uint8_t* p_source = rgb_image + (channels * (y_source * width + x_source));
+                for (int _channels = 0; _channels < channels; ++_channels)
+                    p_target[_channels] = p_source[_channels];
+            }
+            else {
+                for (int _channels = 0; _channels < channels; ++_channels)
+                    p_target[_channels] = 255;
+            }
+        }
+}
+
+/* Camera like test frame: smooth gradients with some noise */
+static Image make_frame(int width, int height)
+{
+    Image img(width * height * 3);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            for (int c = 0; c < 3; ++c)
+                img[3 * (y * width + x) + c] = (uint8_t)(128 + 60 * sin(x * 0.05 + c) + 50 * cos(y * 0.04 * (c + 1)) + rand() % 8);
+    return img;
+}
+
+template <typename F>
+static double measure(F run, int rounds)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i)
+        run();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count() / rounds;
+}
+
+/* max_mean_diff < 0: timing only, the outputs are not compared */
+static bool report(const char* name, int width, int height, double t_old, double t_new, const Image& a, const Image& b, double max_mean_diff)
+{
+    if (max_mean_diff < 0) {
+        printf("%-18s %dx%d: old %7.2f ms, new %7.2f ms, speedup %4.1fx | timing only\n", name, width, height, t_old, t_new, t_old / t_new);
+        return true;
+    }
+
+    long differing = 0;
+    long sum_diff = 0;
+    int max_diff = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        int d = abs((int)a[i] - (int)b[i]);
+        differing += (d != 0);
+        sum_diff += d;
+        max_diff = d > max_diff ? d : max_diff;
+    }
+    double mean_diff = (double)sum_diff / a.size();
+    bool ok = mean_diff <= max_mean_diff;
+
+    printf("%-18s %dx%d: old %7.2f ms, new %7.2f ms, speedup %4.1fx | differing bytes %5.2f%%, mean diff %.3f, max diff %3d %s\n",
+           name, width, height, t_old, t_new, t_old / t_new, 100.0 * differing / a.size(), mean_diff, max_diff, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+int main()
+{
+    const int sizes[][2] = {{640, 480}, {800, 600}};
+    const int rounds = 20;
+    const float angle = 2.3f;
+    bool ok = true;
+
+    for (auto& size : sizes) {
+        int w = size[0], h = size[1];
+        Image src = make_frame(w, h);
+        Image out_old(src.size()), out_new(src.size());
+
+        // Nearest neighbour: the old kernel truncated linear part and offset separately, which moves most pixels by 1.
+        // So it is only timed, the result gets checked against the same kernel rounding the source position down.
+        affine_warp::Transform rot = affine_warp::rotation(angle, w / 2, h / 2);
+        double t_old = measure([&] { rotate_old(src.data(), out_old.data(), w, h, 3, angle, false); }, rounds);
+        double t_new = measure([&] { affine_warp::warp(src.data(), w, h, out_new.data(), w, h, 3, rot, false); }, rounds);
+        ok &= report("Rotate", w, h, t_old, t_new, out_old, out_new, -1);
+
+        t_old = measure([&] { rotate_old(src.data(), out_old.data(), w, h, 3, angle, false, true); }, rounds);
+        ok &= report("Rotate (floor)", w, h, t_old, t_new, out_old, out_new, 0.05);
+
+        t_old = measure([&] { rotate_old(src.data(), out_old.data(), w, h, 3, angle, true); }, rounds);
+        t_new = measure([&] { affine_warp::warp(src.data(), w, h, out_new.data(), w, h, 3, rot, true); }, rounds);
+        ok &= report("RotateAntiAliasing", w, h, t_old, t_new, out_old, out_new, 1.0);
+
+        affine_warp::Transform tr = affine_warp::translation(7, -5);
+        t_old = measure([&] { translate_old(src.data(), out_old.data(), w, h, 3, 7, -5); }, rounds);
+        t_new = measure([&] { affine_warp::warp(src.data(), w, h, out_new.data(), w, h, 3, tr, false); }, rounds);
+        ok &= report("Translate", w, h, t_old, t_new, out_old, out_new, 0.0);
+    }
+
+    return ok ? 0 : 1;
+}
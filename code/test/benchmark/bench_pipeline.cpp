@@ -0,0 +1,541 @@
+// Host benchmark of the image pipeline of one flow round: take image (JPEG decode) -> align -> cut + resize -> infer -> evaluate.
+// Replays recorded camera JPEGs with the alignment references, ROIs and models of a config.ini and reports per stage
+// the latency, the number of heap allocations and the peak heap usage (see shim/host_shim.h).
+//
+// Build and run from code/test/benchmark (see CMakeLists.txt):
+//   cmake -S . -B build -DCMAKE_BUILD_TYPE=Release [-DTFLITE_MICRO_DIR=<path to esp-tflite-micro>]
+//   cmake --build build -j
+//   ./build/bench_pipeline [image file or directory] [sd-card directory] [rounds]
+//
+// Defaults: ../../../sd-card/config/reference.jpg, ../../../sd-card, 10 rounds.
+// Without TFLite (TFLITE_MICRO_DIR not found) the stages "infer" and "evaluate" get skipped.
+// The post-processing (ClassFlowPostProcessing: pre-value, rate checks) is not part of the host build.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "CImageBasis.h"
+#include "CAlignAndCutImage.h"
+#include "CFindTemplate.h"
+#include "affine_warp.h"
+#include "psram.h"
+#include "host_shim.h"
+
+#ifdef HOST_WITH_TFLITE
+#include "CTfLiteClass.h"
+#endif
+
+
+struct StageStats
+{
+    const char *name;
+    double total_us = 0;
+    double min_us = 1e30;
+    double max_us = 0;
+    int runs = 0;
+    size_t allocations = 0;
+    size_t peak = 0;
+};
+
+/* Measures one run of a stage from construction to destruction */
+class StageRun
+{
+    public:
+        StageRun(StageStats &_stats) : stats(_stats)
+        {
+            host_heap_reset_peak();
+            heap_start = host_heap_get_stats();
+            start = std::chrono::steady_clock::now();
+        }
+
+        ~StageRun()
+        {
+            double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            host_heap_stats_t heap_end = host_heap_get_stats();
+
+            stats.total_us += us;
+            stats.min_us = std::min(stats.min_us, us);
+            stats.max_us = std::max(stats.max_us, us);
+            stats.runs++;
+            stats.allocations += heap_end.allocations - heap_start.allocations;
+            stats.peak = std::max(stats.peak, heap_end.peak);
+        }
+
+    private:
+        StageStats &stats;
+        host_heap_stats_t heap_start;
+        std::chrono::steady_clock::time_point start;
+};
+
+
+struct RoiConfig
+{
+    std::string name;
+    int x, y, dx, dy;
+    bool ccw = false;
+    CImageBasis *image_org = NULL;
+    CImageBasis *image = NULL;
+    float value = -1;
+};
+
+struct ModelConfig
+{
+    std::string section;
+    std::string model;
+    std::vector<RoiConfig> rois;
+    int xsize = 0;
+    int ysize = 0;
+    std::vector<std::vector<float>> outputs;
+};
+
+struct PipelineConfig
+{
+    float initial_rotate = 0;
+    bool antialiasing = false;
+    int search_x = 40;
+    int search_y = 40;
+    int alignment_algo = 0;
+    RefInfo refs[2];
+    RefTemplate templates[2];
+    int ref_count = 0;
+    std::vector<ModelConfig> models;
+};
+
+
+static std::vector<std::string> SplitLine(const std::string &_line)
+{
+    std::vector<std::string> tokens;
+    std::istringstream in(_line);
+    std::string token;
+
+    while (in >> token) {
+        if ((token != "=") && !token.empty()) {
+            tokens.push_back(token);
+        }
+    }
+
+    return tokens;
+}
+
+
+static std::string Upper(std::string _s)
+{
+    std::transform(_s.begin(), _s.end(), _s.begin(), ::toupper);
+    return _s;
+}
+
+
+/* Reads the parts of config.ini which are needed for the image pipeline ([Alignment], [Digits], [Analog]) */
+static bool ReadConfig(const std::string &_sdcard, PipelineConfig &_config)
+{
+    std::ifstream file(_sdcard + "/config/config.ini");
+    std::string line, section;
+
+    if (!file) {
+        fprintf(stderr, "Can't open %s/config/config.ini\n", _sdcard.c_str());
+        return false;
+    }
+
+    while (std::getline(file, line)) {
+        line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+
+        if (line.compare(0, 2, ";[") == 0) { // Disabled section
+            section = "";
+            continue;
+        }
+
+        if (line.empty() || (line[0] == ';')) {
+            continue;
+        }
+
+        if (line[0] == '[') {
+            section = Upper(line.substr(1, line.find(']') - 1));
+
+            if ((section == "DIGITS") || (section == "ANALOG")) {
+                ModelConfig model;
+                model.section = section;
+                _config.models.push_back(model);
+            }
+            continue;
+        }
+
+        std::replace(line.begin(), line.end(), '=', ' ');
+        std::vector<std::string> tokens = SplitLine(line);
+
+        if (tokens.empty()) {
+            continue;
+        }
+
+        std::string key = Upper(tokens[0]);
+
+        if (section == "ALIGNMENT") {
+            if ((key == "INITIALROTATE") && (tokens.size() > 1)) {
+                _config.initial_rotate = std::stof(tokens[1]);
+            }
+            else if ((key == "ANTIALIASING") && (tokens.size() > 1)) {
+                _config.antialiasing = (Upper(tokens[1]) == "TRUE");
+            }
+            else if ((key == "SEARCHFIELDX") && (tokens.size() > 1)) {
+                _config.search_x = std::stoi(tokens[1]);
+            }
+            else if ((key == "SEARCHFIELDY") && (tokens.size() > 1)) {
+                _config.search_y = std::stoi(tokens[1]);
+            }
+            else if ((key == "ALIGNMENTALGO") && (tokens.size() > 1)) {
+                std::string algo = Upper(tokens[1]);
+                _config.alignment_algo = (algo == "HIGHACCURACY") ? 1 : (algo == "FAST") ? 2 : (algo == "OFF") ? 3 : (algo == "PYRAMID") ? 4 : 0;
+            }
+            else if ((tokens.size() == 3) && (tokens[0][0] == '/') && (_config.ref_count < 2)) {
+                RefInfo &ref = _config.refs[_config.ref_count];
+                ref.image_file = _sdcard + tokens[0];
+                ref.target_x = std::stoi(tokens[1]);
+                ref.target_y = std::stoi(tokens[2]);
+                ref.tpl = &_config.templates[_config.ref_count];
+                _config.ref_count++;
+            }
+        }
+        else if (((section == "DIGITS") || (section == "ANALOG")) && !_config.models.empty()) {
+            ModelConfig &model = _config.models.back();
+
+            if ((key == "MODEL") && (tokens.size() > 1)) {
+                model.model = _sdcard + tokens[1];
+            }
+            else if ((tokens.size() >= 5) && (tokens[0].find('.') != std::string::npos)) {
+                RoiConfig roi;
+                roi.name = tokens[0];
+                roi.x = std::stoi(tokens[1]);
+                roi.y = std::stoi(tokens[2]);
+                roi.dx = std::stoi(tokens[3]);
+                roi.dy = std::stoi(tokens[4]);
+                roi.ccw = (section == "ANALOG") && (tokens.size() > 5) && (Upper(tokens[5]) == "TRUE");
+                model.rois.push_back(roi);
+            }
+        }
+    }
+
+    for (int i = 0; i < _config.ref_count; ++i) {
+        _config.refs[i].search_x = _config.search_x;
+        _config.refs[i].search_y = _config.search_y;
+        _config.refs[i].alignment_algo = _config.alignment_algo;
+    }
+
+    return true;
+}
+
+
+static std::vector<std::string> ListImages(const std::string &_path)
+{
+    std::vector<std::string> images;
+    struct stat path_stat;
+
+    if ((stat(_path.c_str(), &path_stat) == 0) && S_ISDIR(path_stat.st_mode)) {
+        DIR *dir = opendir(_path.c_str());
+        struct dirent *entry;
+
+        while ((dir != NULL) && ((entry = readdir(dir)) != NULL)) {
+            std::string name = entry->d_name;
+            std::string ext = Upper(name.substr(name.find_last_of('.') + 1));
+
+            if ((ext == "JPG") || (ext == "JPEG")) {
+                images.push_back(_path + "/" + name);
+            }
+        }
+
+        if (dir != NULL) {
+            closedir(dir);
+        }
+
+        std::sort(images.begin(), images.end());
+    }
+    else {
+        images.push_back(_path);
+    }
+
+    return images;
+}
+
+
+static bool ReadFile(const std::string &_filename, std::vector<uint8_t> &_data)
+{
+    std::ifstream file(_filename, std::ios::binary);
+
+    if (!file) {
+        return false;
+    }
+
+    _data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return !_data.empty();
+}
+
+
+/* Same as the stb_image path of CCamera::CaptureToBasisImage() */
+static bool TakeImage(std::vector<uint8_t> &_jpeg, CImageBasis *&_rawImage)
+{
+    psram_init_shared_memory_for_take_image_step();
+
+    CImageBasis *zwImage = new CImageBasis("zwImage");
+    zwImage->LoadFromMemory(_jpeg.data(), _jpeg.size());
+
+    if (_rawImage == NULL) {
+        _rawImage = new CImageBasis("rawImage");
+        _rawImage->CreateEmptyImage(zwImage->width, zwImage->height, 3);
+    }
+
+    bool ok = (zwImage->width == _rawImage->width) && (zwImage->height == _rawImage->height) && (zwImage->channels == _rawImage->channels);
+
+    if (ok) {
+        if (zwImage->OwnsHeapImage() && _rawImage->OwnsHeapImage()) {
+            *_rawImage = std::move(*zwImage);
+        }
+        else {
+            _rawImage->CopyFromMemory(zwImage->rgb_image, _rawImage->width * _rawImage->height * _rawImage->channels);
+        }
+    }
+
+    delete zwImage;
+    psram_deinit_shared_memory_for_take_image_step();
+
+    return ok;
+}
+
+
+/* Same as ClassFlowAlignment::doFlow() without the flip and without the debug images */
+static CAlignAndCutImage* Align(PipelineConfig &_config, CImageBasis *_rawImage)
+{
+    CImageBasis *imageTMP = new CImageBasis("tmpImage", _rawImage);
+    CAlignAndCutImage *caic = new CAlignAndCutImage("AlignAndCutImage", _rawImage, imageTMP);
+
+    int raw_width = caic->width;
+    int raw_height = caic->height;
+    bool initialtransform = (_config.initial_rotate != 0);
+    affine_warp::Transform initial = affine_warp::initial_rotation(_config.initial_rotate, false, raw_width, raw_height);
+
+    if ((_config.alignment_algo != 3) && (_config.ref_count == 2)) {
+        for (int i = 0; i < 2; ++i) {
+            RefTemplateUpdate(_config.refs[i].tpl, _config.refs[i].image_file, _rawImage->channels);
+        }
+
+        uint8_t *searchimage = caic->rgb_image;
+
+        if (initialtransform) {
+            caic->PrepareSearchImage(&_config.refs[0], &_config.refs[1], initial, raw_width, raw_height, _config.antialiasing, false);
+            searchimage = imageTMP->rgb_image;
+        }
+
+        affine_warp::Transform align;
+        caic->FindAlignment(&_config.refs[0], &_config.refs[1], searchimage, align);
+        caic->Warp(affine_warp::compose(initial, align), raw_width, raw_height, _config.antialiasing);
+    }
+    else if (initialtransform) {
+        caic->Warp(initial, raw_width, raw_height, _config.antialiasing);
+    }
+
+    delete imageTMP;
+    caic->ImageTMP = NULL;
+
+    return caic;
+}
+
+
+/* Same as ClassFlowCNNGeneral::doAlignAndCut() */
+static void CutAndResize(PipelineConfig &_config, CAlignAndCutImage *_caic)
+{
+    for (ModelConfig &model : _config.models) {
+        for (RoiConfig &roi : model.rois) {
+            if (roi.image_org == NULL) {
+                roi.image_org = new CImageBasis("ROI " + roi.name + " original", roi.dx, roi.dy, 3);
+                roi.image = new CImageBasis("ROI " + roi.name, model.xsize, model.ysize, 3);
+            }
+
+            _caic->CutAndSave(roi.x, roi.y, roi.dx, roi.dy, roi.image_org);
+            roi.image_org->Resize(model.xsize, model.ysize, roi.image);
+        }
+    }
+}
+
+
+#ifdef HOST_WITH_TFLITE
+/* Same as ClassFlowCNNGeneral::doNeuralNetwork() up to the inference */
+static bool Infer(PipelineConfig &_config)
+{
+    for (ModelConfig &model : _config.models) {
+        CTfLiteClass tflite;
+        std::vector<CImageBasis*> images;
+
+        if (!tflite.LoadModelCached(model.model)) {
+            fprintf(stderr, "Can't load model %s\n", model.model.c_str());
+            return false;
+        }
+
+        for (RoiConfig &roi : model.rois) {
+            images.push_back(roi.image);
+        }
+
+        if (!tflite.InvokeBatch(images, model.outputs)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/* Converts the model outputs into ROI values, as ClassFlowCNNGeneral::doNeuralNetwork() does for the common model types */
+static void Evaluate(PipelineConfig &_config)
+{
+    for (ModelConfig &model : _config.models) {
+        for (int i = 0; i < model.rois.size(); ++i) {
+            const std::vector<float> &output = model.outputs[i];
+            RoiConfig &roi = model.rois[i];
+
+            if (output.size() == 2) { // Analogue
+                float result = fmod(atan2(output[0], output[1]) / (M_PI * 2) + 2, 1);
+                roi.value = roi.ccw ? 10 - (result * 10) : result * 10;
+            }
+            else if (output.size() == 100) { // Digit100 / Analogue100
+                roi.value = CTfLiteClass::GetClassification(output) / 10.0f;
+            }
+            else { // Digit (class 10 = NaN)
+                roi.value = CTfLiteClass::GetClassification(output);
+            }
+        }
+    }
+}
+
+
+/* Input size of the model, the ROI images get resized to it */
+static bool GetModelInputSize(ModelConfig &_model)
+{
+    CTfLiteClass tflite;
+
+    if (!tflite.LoadModelCached(_model.model)) {
+        return false;
+    }
+
+    tflite.GetInputDimension(true);
+    _model.xsize = tflite.ReadInputDimenstion(0);
+    _model.ysize = tflite.ReadInputDimenstion(1);
+
+    return true;
+}
+#endif
+
+
+int main(int argc, char **argv)
+{
+    std::string sdcard = (argc > 2) ? argv[2] : "../../../sd-card";
+    std::string imagepath = (argc > 1) ? argv[1] : sdcard + "/config/reference.jpg";
+    int rounds = (argc > 3) ? atoi(argv[3]) : 10;
+
+    PipelineConfig config;
+
+    if (!ReadConfig(sdcard, config)) {
+        return 1;
+    }
+
+    std::vector<std::string> images = ListImages(imagepath);
+
+    if (images.empty()) {
+        fprintf(stderr, "No images found in %s\n", imagepath.c_str());
+        return 1;
+    }
+
+    if (!reserve_psram_shared_region()) {
+        return 1;
+    }
+
+    for (ModelConfig &model : config.models) {
+#ifdef HOST_WITH_TFLITE
+        if (!GetModelInputSize(model)) {
+            fprintf(stderr, "Can't load model %s\n", model.model.c_str());
+            return 1;
+        }
+#else
+        // Input sizes of the default models (dig-cont/dig-class11: 20x32, ana-cont: 32x32)
+        model.xsize = (model.section == "DIGITS") ? 20 : 32;
+        model.ysize = 32;
+#endif
+    }
+
+    StageStats stages[] = {{"take image"}, {"align"}, {"cut + resize"}, {"infer"}, {"evaluate"}};
+    CImageBasis *rawImage = NULL;
+    std::vector<uint8_t> jpeg;
+
+    printf("%d image(s), %d round(s), %d reference(s), %d model(s)\n", (int)images.size(), rounds, config.ref_count, (int)config.models.size());
+
+    for (int round = 0; round < rounds; ++round) {
+        for (const std::string &image : images) {
+            if (!ReadFile(image, jpeg)) {
+                fprintf(stderr, "Can't read %s\n", image.c_str());
+                return 1;
+            }
+
+            {
+                StageRun run(stages[0]);
+                if (!TakeImage(jpeg, rawImage)) {
+                    fprintf(stderr, "%s: image size differs from the first image, skipped\n", image.c_str());
+                    continue;
+                }
+            }
+
+            CAlignAndCutImage *caic;
+            {
+                StageRun run(stages[1]);
+                caic = Align(config, rawImage);
+            }
+
+            {
+                StageRun run(stages[2]);
+                CutAndResize(config, caic);
+            }
+
+            delete caic;
+
+#ifdef HOST_WITH_TFLITE
+            {
+                StageRun run(stages[3]);
+                if (!Infer(config)) {
+                    return 1;
+                }
+            }
+
+            {
+                StageRun run(stages[4]);
+                Evaluate(config);
+            }
+#endif
+        }
+    }
+
+    printf("\n%-14s %6s %12s %12s %12s %14s %14s\n", "stage", "runs", "avg [us]", "min [us]", "max [us]", "allocs/run", "peak heap [B]");
+
+    for (const StageStats &s : stages) {
+        if (s.runs == 0) {
+            printf("%-14s %6s\n", s.name, "skipped");
+            continue;
+        }
+
+        printf("%-14s %6d %12.0f %12.0f %12.0f %14.1f %14zu\n", s.name, s.runs, s.total_us / s.runs, s.min_us, s.max_us,
+               (double)s.allocations / s.runs, s.peak);
+    }
+
+#ifdef HOST_WITH_TFLITE
+    printf("\nReadout of the last image:\n");
+    for (const ModelConfig &model : config.models) {
+        for (const RoiConfig &roi : model.rois) {
+            printf("  %-16s %6.2f\n", roi.name.c_str(), roi.value);
+        }
+    }
+#endif
+
+    return 0;
+}
@@ -0,0 +1,172 @@
+// Host micro-benchmark for the model input tensor fill (jomjol_tfliteclass/tensor_fill).
+// Compares the former per-pixel GetPixelColor() fill with tensor_fill::to_float(), and the quantization of int8/uint8
+// input tensors by tensor_fill::to_quantized() with the float formula round(x / scale) + zero_point.
+//
+// Build and run from code/test/benchmark:
+//   g++ -O2 -I../../components/jomjol_tfliteclass bench_tensor_fill.cpp ../../components/jomjol_tfliteclass/tensor_fill.cpp -o bench_tensor_fill
+//   ./bench_tensor_fill
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "tensor_fill.h"
+
+struct Image {
+    int width, height, channels;
+    std::vector<uint8_t> rgb_image;
+
+    // Same bounds-checked accessor as CImageBasis::GetPixelColor()
+    uint8_t GetPixelColor(int x, int y, int ch)
+    {
+        if ((x < 0) || (x >= width) || (y < 0) || (y >= height)) {
+            return 0;
+        }
+        return rgb_image[(channels * (y * width + x)) + ch];
+    }
+};
+
+static void __attribute__((noinline)) fill_per_pixel(float* _input_data, Image* rs)
+{
+    for (int y = 0; y < rs->height; ++y) {
+        for (int x = 0; x < rs->width; ++x) {
+            *(_input_data++) = (float)rs->GetPixelColor(x, y, 0);
+            *(_input_data++) = (float)rs->GetPixelColor(x, y, 1);
+            *(_input_data++) = (float)rs->GetPixelColor(x, y, 2);
+        }
+    }
+}
+
+static void __attribute__((noinline)) fill_span(float* _input_data, Image* rs)
+{
+    tensor_fill::to_float(_input_data, rs->rgb_image.data(), (size_t)rs->width * rs->height * rs->channels);
+}
+
+// Quantization parameters of an input tensor
+struct Quant {
+    float scale;
+    int zero_point;
+    bool is_signed;
+};
+
+// Per-value float quantization, as without the table
+static void __attribute__((noinline)) quantize_float(uint8_t* dst, const uint8_t* src, size_t count, const Quant& q)
+{
+    const int qmin = q.is_signed ? -128 : 0;
+    const int qmax = q.is_signed ? 127 : 255;
+
+    for (size_t i = 0; i < count; ++i) {
+        int v = (int)roundf((float)src[i] / q.scale) + q.zero_point;
+        v = v < qmin ? qmin : (v > qmax ? qmax : v);
+        if (q.is_signed) {
+            ((int8_t*)dst)[i] = (int8_t)v;
+        }
+        else {
+            dst[i] = (uint8_t)v;
+        }
+    }
+}
+
+// Checks to_quantized() against the float formula for all 256 input values and a random image, returns false on a mismatch
+static bool check_quantized(const Quant& q, const std::vector<uint8_t>& img, int rounds)
+{
+    std::vector<uint8_t> all(256);
+    for (int i = 0; i < 256; ++i) {
+        all[i] = (uint8_t)i;
+    }
+
+    uint8_t lut[256];
+    tensor_fill::build_quant_lut(lut, q.scale, q.zero_point, q.is_signed);
+
+    const std::vector<uint8_t>* sources[] = {&all, &img};
+    for (const std::vector<uint8_t>* src : sources) {
+        std::vector<uint8_t> ref(src->size()), out(src->size());
+        quantize_float(ref.data(), src->data(), src->size(), q);
+        tensor_fill::to_quantized(out.data(), src->data(), src->size(), lut);
+
+        for (size_t i = 0; i < ref.size(); ++i) {
+            if (ref[i] != out[i]) {
+                printf("%s scale %g, zero point %d: MISMATCH at input %d (%d instead of %d)\n", q.is_signed ? "int8" : "uint8",
+                       q.scale, q.zero_point, (*src)[i], q.is_signed ? (int8_t)out[i] : out[i], q.is_signed ? (int8_t)ref[i] : ref[i]);
+                return false;
+            }
+        }
+    }
+
+    std::vector<uint8_t> out(img.size());
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        quantize_float(out.data(), img.data(), img.size(), q);
+    }
+    auto mid = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        tensor_fill::to_quantized(out.data(), img.data(), img.size(), lut);
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    double t_float = std::chrono::duration<double, std::micro>(mid - start).count() / rounds;
+    double t_lut = std::chrono::duration<double, std::micro>(stop - mid).count() / rounds;
+    printf("%s scale %g, zero point %d: float %.3f us, table %.3f us, speedup %.1fx\n", q.is_signed ? "int8" : "uint8",
+           q.scale, q.zero_point, t_float, t_lut, t_float / t_lut);
+    return true;
+}
+
+template <typename F>
+static double measure(F fill, float* dst, Image* img, int rounds)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        fill(dst, img);
+    }
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(stop - start).count() / rounds;
+}
+
+int main()
+{
+    // Input sizes of the shipped models: dig-class11/dig-cont (20x32), ana-class100/ana-cont (32x32)
+    const int sizes[][2] = {{20, 32}, {32, 32}};
+    const int rounds = 20000;
+
+    for (auto& size : sizes) {
+        Image img{size[0], size[1], 3, {}};
+        img.rgb_image.resize(img.width * img.height * img.channels);
+        for (auto& p : img.rgb_image) {
+            p = (uint8_t)rand();
+        }
+
+        std::vector<float> ref(img.rgb_image.size()), out(img.rgb_image.size());
+        fill_per_pixel(ref.data(), &img);
+        fill_span(out.data(), &img);
+        if (memcmp(ref.data(), out.data(), ref.size() * sizeof(float)) != 0) {
+            printf("%dx%d: MISMATCH\n", img.width, img.height);
+            return 1;
+        }
+
+        double t_old = measure(fill_per_pixel, ref.data(), &img, rounds);
+        double t_new = measure(fill_span, out.data(), &img, rounds);
+        printf("%dx%d: per-pixel %.3f us, span %.3f us, speedup %.1fx\n", img.width, img.height, t_old, t_new, t_old / t_new);
+    }
+
+    // Typical input quantizations (0..255 as is, normalized to 0..1) and ones which round and clamp within the range
+    const Quant quants[] = {
+        {1.0f, -128, true}, {1.0f / 255.0f, -128, true}, {0.7f, -100, true}, {2.0f, 5, true},
+        {1.0f, 0, false}, {1.0f / 255.0f, 0, false}, {0.7f, 3, false}, {2.0f, 200, false},
+    };
+
+    std::vector<uint8_t> img(32 * 32 * 3);
+    for (auto& p : img) {
+        p = (uint8_t)rand();
+    }
+
+    for (const Quant& q : quants) {
+        if (!check_quantized(q, img, rounds)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,12 @@
+// Host shim (see ../CMakeLists.txt): subset of esp_err.h
+#pragma once
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK          0
+#define ESP_FAIL        -1
+#define ESP_ERR_NO_MEM  0x101
+
+#define ESP_ERROR_CHECK(x) (void)(x)
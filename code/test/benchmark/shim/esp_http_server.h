@@ -0,0 +1,17 @@
+// Host shim (see ../CMakeLists.txt): only what CImageBasis::SendJPGtoHTTP() needs to compile, sending always fails
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "esp_err.h"
+
+typedef void *httpd_handle_t;
+typedef struct httpd_req { const char *uri; void *user_ctx; } httpd_req_t;
+
+typedef enum {
+    HTTPD_500_INTERNAL_SERVER_ERROR,
+    HTTPD_501_METHOD_NOT_IMPLEMENTED
+} httpd_err_code_t;
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t len);
+esp_err_t httpd_resp_send_err(httpd_req_t *r, httpd_err_code_t error, const char *msg);
@@ -0,0 +1,30 @@
+// Host shim (see ../CMakeLists.txt): ESP_LOGx go to stderr, filtered by HOST_LOG_LEVEL
+#pragma once
+
+#include <stdio.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#ifndef HOST_LOG_LEVEL
+#define HOST_LOG_LEVEL ESP_LOG_WARN
+#endif
+
+#define LOG_LOCAL_LEVEL HOST_LOG_LEVEL
+
+#define ESP_LOG_LEVEL(level, tag, format, ...) do { \
+        if ((level) <= HOST_LOG_LEVEL) { fprintf(stderr, "[%s] " format "\n", tag, ##__VA_ARGS__); } \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
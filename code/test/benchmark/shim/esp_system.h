@@ -0,0 +1,8 @@
+// Host shim (see ../CMakeLists.txt)
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+void esp_restart(void);
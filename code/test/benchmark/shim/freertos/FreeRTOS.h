@@ -0,0 +1,9 @@
+// Host shim (see ../../CMakeLists.txt)
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+
+#define portTICK_PERIOD_MS 1
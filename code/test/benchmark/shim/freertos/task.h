@@ -0,0 +1,14 @@
+// Host shim (see ../../CMakeLists.txt): ticks are milliseconds
+#pragma once
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void vTaskDelay(TickType_t ticks);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,293 @@
+// Host shim (see ../CMakeLists.txt): replacements for the ESP-IDF and firmware functions which the
+// image processing and TFLite code calls, so it can run on Linux.
+
+#include "host_shim.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <sys/stat.h>
+#include <chrono>
+#include <thread>
+
+#include "esp_heap_caps.h"
+#include "esp_http_server.h"
+#include "esp_system.h"
+#include "freertos/task.h"
+
+#include "ClassLogFile.h"
+#include "Helper.h"
+#include "server_ota.h"
+#include "model_store.h"
+#include "roi_workers.h"
+
+#ifndef HOST_PSRAM_SIZE
+#define HOST_PSRAM_SIZE (8 * 1024 * 1024) // ESP32 with 8 MB PSRAM, used for heap_caps_get_free_size()
+#endif
+
+
+/* heap_caps_* with a size header in front of every block, so frees can be accounted */
+static host_heap_stats_t heap_stats = {0, 0, 0, 0};
+
+union block_header_t {
+    size_t size;
+    max_align_t align;
+};
+
+
+static void account_alloc(size_t size)
+{
+    heap_stats.in_use += size;
+    heap_stats.allocations++;
+
+    if (heap_stats.in_use > heap_stats.peak) {
+        heap_stats.peak = heap_stats.in_use;
+    }
+}
+
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+
+    block_header_t *block = (block_header_t *)malloc(sizeof(block_header_t) + size);
+
+    if (block == NULL) {
+        return NULL;
+    }
+
+    block->size = size;
+    account_alloc(size);
+
+    return block + 1;
+}
+
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    void *ptr = heap_caps_malloc(n * size, caps);
+
+    if (ptr != NULL) {
+        memset(ptr, 0, n * size);
+    }
+
+    return ptr;
+}
+
+
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps)
+{
+    if (ptr == NULL) {
+        return heap_caps_malloc(size, caps);
+    }
+
+    block_header_t *block = (block_header_t *)ptr - 1;
+    size_t old_size = block->size;
+
+    block = (block_header_t *)realloc(block, sizeof(block_header_t) + size);
+
+    if (block == NULL) {
+        return NULL;
+    }
+
+    block->size = size;
+    heap_stats.in_use -= old_size;
+    account_alloc(size);
+
+    return block + 1;
+}
+
+
+void heap_caps_free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    block_header_t *block = (block_header_t *)ptr - 1;
+
+    heap_stats.in_use -= block->size;
+    heap_stats.frees++;
+    free(block);
+}
+
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    (void)caps;
+    return (heap_stats.in_use < HOST_PSRAM_SIZE) ? HOST_PSRAM_SIZE - heap_stats.in_use : 0;
+}
+
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return heap_caps_get_free_size(caps);
+}
+
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    (void)caps;
+    return (heap_stats.peak < HOST_PSRAM_SIZE) ? HOST_PSRAM_SIZE - heap_stats.peak : 0;
+}
+
+
+host_heap_stats_t host_heap_get_stats(void)
+{
+    return heap_stats;
+}
+
+
+void host_heap_reset_peak(void)
+{
+    heap_stats.peak = heap_stats.in_use;
+}
+
+
+/* FreeRTOS / system */
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+
+void esp_restart(void)
+{
+    fprintf(stderr, "esp_restart() called\n");
+    exit(1);
+}
+
+
+void doReboot()
+{
+    fprintf(stderr, "doReboot() called\n");
+    exit(1);
+}
+
+
+/* HTTP server: there is no client on the host */
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t len)
+{
+    (void)r;
+    (void)buf;
+    (void)len;
+    return ESP_FAIL;
+}
+
+
+esp_err_t httpd_resp_send_err(httpd_req_t *r, httpd_err_code_t error, const char *msg)
+{
+    (void)r;
+    (void)error;
+    (void)msg;
+    return ESP_FAIL;
+}
+
+
+/* Helper */
+std::size_t file_size(const std::string& file_name)
+{
+    struct stat file_stat;
+
+    if (stat(file_name.c_str(), &file_stat) != 0) {
+        return 0;
+    }
+
+    return file_stat.st_size;
+}
+
+
+std::string getFileType(std::string filename)
+{
+    size_t pos = filename.rfind('.');
+
+    if (pos == std::string::npos) {
+        return "";
+    }
+
+    std::string type = filename.substr(pos + 1);
+    std::transform(type.begin(), type.end(), type.begin(), ::toupper);
+
+    return type;
+}
+
+
+/* ClassLogFile: log lines go to stderr, filtered by HOST_LOG_LEVEL */
+ClassLogFile LogFile("", "", "", "");
+
+ClassLogFile::ClassLogFile(std::string _logpath, std::string _logfile, std::string _logdatapath, std::string _datafile)
+{
+    logroot = _logpath;
+    logfile = _logfile;
+    dataroot = _logdatapath;
+    datafile = _datafile;
+    loglevel = HOST_LOG_LEVEL;
+}
+
+
+void ClassLogFile::WriteToFile(esp_log_level_t level, std::string tag, std::string message, bool _time)
+{
+    (void)_time;
+
+    if ((level != ESP_LOG_NONE) && (level <= loglevel)) {
+        fprintf(stderr, "[%s] %s\n", tag.c_str(), message.c_str());
+    }
+}
+
+
+void ClassLogFile::WriteToFile(esp_log_level_t level, std::string tag, std::string message)
+{
+    WriteToFile(level, tag, message, true);
+}
+
+
+void ClassLogFile::WriteToFileF(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    char message[LOGFILE_MAX_LINE_LENGTH];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    if ((level != ESP_LOG_NONE) && (level <= loglevel)) {
+        fprintf(stderr, "[%s] %s\n", tag, message);
+    }
+}
+
+
+void ClassLogFile::WriteHeapInfo(std::string _id)
+{
+    host_heap_stats_t stats = host_heap_get_stats();
+
+    WriteToFile(ESP_LOG_DEBUG, "HEAP", _id + ": in use " + std::to_string(stats.in_use) + " bytes, peak " + std::to_string(stats.peak) + " bytes");
+}
+
+
+/* Model store: there is no flash partition on the host, models always get loaded from the file */
+namespace model_store {
+
+const uint8_t *get(const std::string &_fn, long *_size) { return NULL; }
+const uint8_t *install(const std::string &_fn, const uint8_t *_data, long _size) { return NULL; }
+void release(const uint8_t *_model) {}
+void remove(const std::string &_fn) {}
+
+}
+
+
+/* ROI workers: no second FreeRTOS core on the host, everything runs on the calling thread */
+namespace roi_workers {
+
+void run(int _count, const Job &_job, bool _parallel)
+{
+    for (int i = 0; i < _count; ++i) {
+        _job(i, 0);
+    }
+}
+
+bool available() { return false; }
+
+}
@@ -0,0 +1,15 @@
+// Host shim (see ../CMakeLists.txt): statistics of the heap_caps_* allocations
+#pragma once
+
+#include <stddef.h>
+
+struct host_heap_stats_t
+{
+    size_t in_use;          // bytes currently allocated
+    size_t peak;            // high-water mark of in_use since the last host_heap_reset_peak()
+    size_t allocations;     // number of malloc/calloc/realloc calls
+    size_t frees;
+};
+
+host_heap_stats_t host_heap_get_stats(void);
+void host_heap_reset_peak(void);
@@ -0,0 +1,27 @@
+// Host shim (see ../../CMakeLists.txt): mbedtls SHA-256 API on top of OpenSSL
+#pragma once
+
+#include <stddef.h>
+#include <openssl/evp.h>
+
+typedef struct {
+    EVP_MD_CTX *ctx;
+} mbedtls_sha256_context;
+
+static inline void mbedtls_sha256_init(mbedtls_sha256_context *c) { c->ctx = EVP_MD_CTX_new(); }
+static inline void mbedtls_sha256_free(mbedtls_sha256_context *c) { EVP_MD_CTX_free(c->ctx); c->ctx = NULL; }
+
+static inline int mbedtls_sha256_starts(mbedtls_sha256_context *c, int is224)
+{
+    return (EVP_DigestInit_ex(c->ctx, is224 ? EVP_sha224() : EVP_sha256(), NULL) == 1) ? 0 : -1;
+}
+
+static inline int mbedtls_sha256_update(mbedtls_sha256_context *c, const unsigned char *input, size_t ilen)
+{
+    return (EVP_DigestUpdate(c->ctx, input, ilen) == 1) ? 0 : -1;
+}
+
+static inline int mbedtls_sha256_finish(mbedtls_sha256_context *c, unsigned char output[32])
+{
+    return (EVP_DigestFinal_ex(c->ctx, output, NULL) == 1) ? 0 : -1;
+}
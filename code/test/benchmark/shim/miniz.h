@@ -0,0 +1,60 @@
+// Host shim (see ../CMakeLists.txt): the tinfl streaming inflate API of the ESP-IDF ROM miniz, on top of zlib (raw deflate)
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+typedef uint8_t mz_uint8;
+typedef uint32_t mz_uint32;
+
+#define TINFL_FLAG_HAS_MORE_INPUT                2
+#define TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF 4
+
+typedef enum {
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+typedef struct {
+    z_stream zs;
+    int active;
+} tinfl_decompressor;
+
+static inline void tinfl_init(tinfl_decompressor *r)
+{
+    memset(&r->zs, 0, sizeof(r->zs));
+    r->active = (inflateInit2(&r->zs, -MAX_WBITS) == Z_OK);
+}
+
+static inline tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *in_buf, size_t *in_size,
+                                            mz_uint8 *out_start, mz_uint8 *out_next, size_t *out_size, mz_uint32 flags)
+{
+    (void)out_start;
+    (void)flags;
+
+    if (!r->active) {
+        return TINFL_STATUS_FAILED;
+    }
+
+    r->zs.next_in = (Bytef *)in_buf;
+    r->zs.avail_in = (uInt)*in_size;
+    r->zs.next_out = out_next;
+    r->zs.avail_out = (uInt)*out_size;
+
+    int ret = inflate(&r->zs, Z_NO_FLUSH);
+
+    *in_size -= r->zs.avail_in;
+    *out_size -= r->zs.avail_out;
+
+    if ((ret != Z_OK) && (ret != Z_BUF_ERROR)) {
+        inflateEnd(&r->zs);
+        r->active = 0;
+        return (ret == Z_STREAM_END) ? TINFL_STATUS_DONE : TINFL_STATUS_FAILED;
+    }
+
+    return (r->zs.avail_out == 0) ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
@@ -92,9 +92,28 @@ void test_createSequenceMetrics()
     TEST_ASSERT_EQUAL_STRING(expected2.c_str(), createSequenceMetrics(metricNamePrefix, NUMBERS).c_str());
 }
 
+/**
+ * test the labeled metric (one sample per label value)
+ **/
+void test_createLabeledMetric()
+{
+    std::vector<std::pair<std::string, std::string>> samples = {{"Take Image", "1.500000"}, {"Dig\"it\\s", "0.250000"}};
+
+    std::string result = createMetric("step_duration", "duration of the step", "gauge", "step", samples);
+    TEST_ASSERT_EQUAL_STRING("# HELP step_duration duration of the step\n# TYPE step_duration gauge\n"
+                             "step_duration{step=\"Take Image\"} 1.500000\n"
+                             "step_duration{step=\"Digits\"} 0.250000\n", result.c_str());
+
+    // no samples -> no metadata
+    samples.clear();
+    result = createMetric("step_duration", "duration of the step", "gauge", "step", samples);
+    TEST_ASSERT_EQUAL_STRING("", result.c_str());
+}
+
 void test_openmetrics()
 {
     test_createMetric();
+    test_createLabeledMetric();
     test_replaceString();
     test_createSequenceMetrics();
 }